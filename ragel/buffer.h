@@ -22,7 +22,11 @@
 #ifndef _BUFFER_H
 #define _BUFFER_H
 
+#include <stdlib.h>
+#include <string.h>
+
 #define BUFFER_INITIAL_SIZE 4096
+#define ARENA_BLOCK_SIZE ( 64 * 1024 )
 
 /* An automatically grown buffer for collecting tokens. Always reuses space;
  * never down resizes. */
@@ -52,4 +56,59 @@ struct Buffer
 	int length;
 };
 
+/* Storage for strings that are kept until the program exits, such as the
+ * text of tokens. Strings are cut from large blocks and never freed one at a
+ * time. The last string appended to is given twice the room it needs, so
+ * that building a long string from many small pieces is linear. */
+struct StringArena
+{
+	StringArena() : next(0), end(0), growing(0), growAllocated(0) {}
+
+	/* Copy in len characters and terminate them. */
+	char *copy( const char *str, long len )
+	{
+		char *dest = alloc( len + 1 );
+		memcpy( dest, str, len );
+		dest[len] = 0;
+		return dest;
+	}
+
+	/* Append to a string from the arena. Returns where the result is, which
+	 * is str if it was the last string grown and there is room. */
+	char *append( char *str, long len, const char *other, long otherLen )
+	{
+		long newLen = len + otherLen;
+		if ( str != growing || newLen + 1 > growAllocated ) {
+			growAllocated = ( newLen + 1 ) * 2;
+			growing = alloc( growAllocated );
+			memcpy( growing, str, len );
+		}
+		memcpy( growing + len, other, otherLen );
+		growing[newLen] = 0;
+		return growing;
+	}
+
+private:
+	char *alloc( long size )
+	{
+		/* Large strings get their own allocation so that little of the
+		 * current block is lost. */
+		if ( size > ARENA_BLOCK_SIZE / 4 )
+			return new char[size];
+
+		if ( size > end - next ) {
+			next = new char[ARENA_BLOCK_SIZE];
+			end = next + ARENA_BLOCK_SIZE;
+		}
+
+		char *dest = next;
+		next += size;
+		return dest;
+	}
+
+	char *next, *end;
+	char *growing;
+	long growAllocated;
+};
+
 #endif
@@ -25,6 +25,7 @@
 #include "ragel.h"
 #include "redfsm.h"
 #include "gendata.h"
+#include "avlmap.h"
 #include <sstream>
 #include <string>
 #include <assert.h>
@@ -69,6 +70,19 @@ void cdLineDirective( ostream &out, const char *fileName, int line )
 	out << '\n';
 }
 
+/* The SSE headers. They go at the top of the output file because write data
+ * is often inside a class or a function, where a system header can't be
+ * included. */
+void cdSimdIncludes( ostream &out )
+{
+	out <<
+		"#if defined(__SSE4_2__)\n"
+		"#include <nmmintrin.h>\n"
+		"#elif defined(__SSE2__)\n"
+		"#include <emmintrin.h>\n"
+		"#endif\n";
+}
+
 void FsmCodeGen::genLineDirective( ostream &out )
 {
 	std::streambuf *sbuf = out.rdbuf();
@@ -80,7 +94,11 @@ void FsmCodeGen::genLineDirective( ostream &out )
 /* Init code gen with in parameters. */
 FsmCodeGen::FsmCodeGen( ostream &out )
 :
-	CodeGenData(out)
+	CodeGenData(out),
+	simd(false),
+	instrument(false),
+	numProfilePoints(0),
+	arrayCounter(0)
 {
 }
 
@@ -92,6 +110,83 @@ unsigned int FsmCodeGen::arrayTypeSize( unsigned long maxVal )
 	return arrayType->size;
 }
 
+/* Passes output through to the real buffer, counting the elements of the
+ * array being written. */
+class array_counter : public std::streambuf
+{
+public:
+	array_counter( std::streambuf *dest ) : dest(dest), commas(0) { }
+
+	std::streambuf *dest;
+	long commas;
+
+protected:
+	/* Single characters and syncs go through as they would to the real
+	 * buffer, which counts the line of an endl at the sync. */
+	int overflow( int c )
+	{
+		if ( c == EOF )
+			return 0;
+		if ( c == ',' )
+			commas += 1;
+		return dest->sputc( c );
+	}
+
+	int sync()
+	{
+		return dest->pubsync();
+	}
+
+	std::streamsize xsputn( const char *s, std::streamsize n )
+	{
+		for ( std::streamsize i = 0; i < n; i++ ) {
+			if ( s[i] == ',' )
+				commas += 1;
+		}
+		return dest->sputn( s, n );
+	}
+};
+
+unsigned int FsmCodeGen::typeSize( string type )
+{
+	for ( int i = 0; i < hostLang->numHostTypes; i++ ) {
+		HostType *hostType = &hostLang->hostTypes[i];
+		string name = hostType->data1;
+		if ( hostType->data2 != 0 ) {
+			name += " ";
+			name += hostType->data2;
+		}
+		if ( name == type )
+			return hostType->size;
+	}
+	return 0;
+}
+
+/* Called after an array is opened. Until it is closed the output goes
+ * through a counter. */
+void FsmCodeGen::openArrayStat( string type, string name )
+{
+	if ( printStatistics ) {
+		arrayCounter = new array_counter( out.rdbuf() );
+		arrayType = type;
+		arrayName = name;
+		out.rdbuf( arrayCounter );
+	}
+}
+
+/* Called before an array is closed. The arrays are always written with a
+ * trailing element, so there is one more element than there are commas. */
+void FsmCodeGen::closeArrayStat()
+{
+	if ( arrayCounter != 0 ) {
+		out.rdbuf( arrayCounter->dest );
+		long bytes = ( arrayCounter->commas + 1 ) * typeSize( arrayType );
+		tableSizes.append( TableSize( arrayName, bytes ) );
+		delete arrayCounter;
+		arrayCounter = 0;
+	}
+}
+
 string FsmCodeGen::ARRAY_TYPE( unsigned long maxVal )
 {
 	long long maxValLL = (long long) maxVal;
@@ -317,16 +412,56 @@ string FsmCodeGen::TABS( int level )
 	return result;
 }
 
+static char *formatKey( char *&end, Key key )
+{
+	char *start;
+	if ( keyOps->isSigned || !hostLang->explicitUnsigned )
+		start = formatInt( end, key.getVal() );
+	else {
+		start = formatUInt( end, (unsigned long) key.getVal() );
+		*end++ = 'u';
+	}
+	return start;
+}
+
 /* Write out a key from the fsm code gen. Depends on wether or not the key is
  * signed. */
 string FsmCodeGen::KEY( Key key )
 {
-	ostringstream ret;
-	if ( keyOps->isSigned || !hostLang->explicitUnsigned )
-		ret << key.getVal();
-	else
-		ret << (unsigned long) key.getVal() << 'u';
-	return ret.str();
+	char buf[32], *end = buf + 24;
+	char *start = formatKey( end, key );
+	return string( start, end );
+}
+
+/* Write out an item of an array of numbers. All but the last are followed by
+ * a comma and a new line is started every IALL items. */
+void FsmCodeGen::ARRAY_ITEM( long long item, int &count, bool last )
+{
+	char buf[32], *end = buf + 24;
+	char *start = formatInt( end, item );
+	ARRAY_WRITE( start, end, count, last );
+}
+
+void FsmCodeGen::ARRAY_KEY( Key key, int &count, bool last )
+{
+	char buf[32], *end = buf + 24;
+	char *start = formatKey( end, key );
+	ARRAY_WRITE( start, end, count, last );
+}
+
+/* Adds the separator after an array item formatted into a buffer with room
+ * for it and writes the whole thing at once. */
+void FsmCodeGen::ARRAY_WRITE( char *start, char *end, int &count, bool last )
+{
+	if ( !last ) {
+		*end++ = ',';
+		*end++ = ' ';
+		if ( ++count % IALL == 0 ) {
+			*end++ = '\n';
+			*end++ = '\t';
+		}
+	}
+	out.write( start, end - start );
 }
 
 bool FsmCodeGen::isAlphTypeSigned()
@@ -697,11 +832,13 @@ string CCodeGen::PTR_CONST_END()
 std::ostream &CCodeGen::OPEN_ARRAY( string type, string name )
 {
 	out << "static const " << type << " " << name << "[] = {\n";
+	openArrayStat( type, name );
 	return out;
 }
 
 std::ostream &CCodeGen::CLOSE_ARRAY()
 {
+	closeArrayStat();
 	return out << "};\n";
 }
 
@@ -785,11 +922,13 @@ string DCodeGen::PTR_CONST_END()
 std::ostream &DCodeGen::OPEN_ARRAY( string type, string name )
 {
 	out << "static const " << type << "[] " << name << " = [\n";
+	openArrayStat( type, name );
 	return out;
 }
 
 std::ostream &DCodeGen::CLOSE_ARRAY()
 {
+	closeArrayStat();
 	return out << "];\n";
 }
 
@@ -868,11 +1007,13 @@ string D2CodeGen::PTR_CONST_END()
 std::ostream &D2CodeGen::OPEN_ARRAY( string type, string name )
 {
 	out << "enum " << type << "[] " << name << " = [\n";
+	openArrayStat( type, name );
 	return out;
 }
 
 std::ostream &D2CodeGen::CLOSE_ARRAY()
 {
+	closeArrayStat();
 	return out << "];\n";
 }
 
@@ -946,6 +1087,9 @@ void D2CodeGen::ACTION( ostream &ret, GenAction *action, int targState,
  * End D2-specific code.
  */
 
+/* The goto styles only skip in states that leave on at most this many keys. */
+static const long gotoSkipMaxExits = 16;
+
 void FsmCodeGen::finishRagelDef()
 {
 	if ( codeStyle == GenGoto || codeStyle == GenFGoto || 
@@ -962,11 +1106,24 @@ void FsmCodeGen::finishRagelDef()
 		redFsm->sortByStateId();
 	}
 
+	/* Self loops are found on the complete out ranges, so this must come
+	 * before the default transitions are taken out. */
+	if ( useSimd() )
+		redFsm->findSelfLoops( 16 );
+	else if ( ( codeStyle == GenGoto || codeStyle == GenFGoto ||
+			codeStyle == GenIpGoto || codeStyle == GenSplit ) &&
+			keyOps->alphType->size == 1 )
+	{
+		/* The goto styles scan self loops ahead of the dispatch. That only
+		 * pays when the state spins on nearly every key. */
+		redFsm->findSelfLoops( gotoSkipMaxExits );
+	}
+
 	/* Choose default transitions and the single transition. */
 	redFsm->chooseDefaultSpan();
 		
 	/* Maybe do flat expand, otherwise choose single. */
-	if ( codeStyle == GenFlat || codeStyle == GenFFlat )
+	if ( codeStyle == GenFlat || codeStyle == GenFFlat || codeStyle == GenClassFlat )
 		redFsm->makeFlat();
 	else
 		redFsm->chooseSingle();
@@ -974,6 +1131,18 @@ void FsmCodeGen::finishRagelDef()
 	/* If any errors have occured in the input file then don't write anything. */
 	if ( gblErrorCount > 0 )
 		return;
+
+	/* With the counts of a profiling run the goto styles write the hottest
+	 * states first, so they sit together in the code and the partitions. */
+	if ( profileFileName != 0 && ( codeStyle == GenGoto || codeStyle == GenFGoto ||
+			codeStyle == GenIpGoto || codeStyle == GenSplit ) )
+	{
+		readProfile();
+		redFsm->sortStatesByHits();
+	}
+
+	if ( instrument )
+		numberProfilePoints();
 	
 	if ( codeStyle == GenSplit )
 		redFsm->partitionFsm( numSplitPartitions );
@@ -986,10 +1155,233 @@ void FsmCodeGen::finishRagelDef()
 	 * of fsm directives in action code. */
 	analyzeMachine();
 
+	/* Byte alphabets without conditions map every key to a class. Otherwise
+	 * only the keys covered by the flat spans are mapped. */
+	if ( codeStyle == GenClassFlat ) {
+		redFsm->makeCharClasses( !redFsm->anyConditions() && 
+				keyOps->alphSize() <= 256 );
+	}
+
+	/* Pack the table rows into a comb vector. Very wide key spans keep
+	 * the plain tables. */
+	if ( codeStyle == GenCombTable )
+		redFsm->makeCombVector( 0x10000 );
+
 	/* Determine if we should use indicies. */
 	calcIndexSize();
 }
 
+/* The SIMD code works on bytes loaded straight from the input buffer, so it
+ * needs a single byte alphabet and no user supplied getkey. */
+bool FsmCodeGen::useSimd()
+{
+	return simd && keyOps->alphType->size == 1 && getKeyExpr == 0;
+}
+
+struct ProfilePoint
+{
+	int state;
+	bool isDefault;
+	long low, high;
+};
+
+struct CmpProfilePoint
+{
+	static int compare( const ProfilePoint &p1, const ProfilePoint &p2 )
+	{
+		if ( p1.state != p2.state )
+			return p1.state < p2.state ? -1 : 1;
+		else if ( p1.isDefault != p2.isDefault )
+			return p1.isDefault ? 1 : -1;
+		else if ( p1.low != p2.low )
+			return p1.low < p2.low ? -1 : 1;
+		else if ( p1.high != p2.high )
+			return p1.high < p2.high ? -1 : 1;
+		return 0;
+	}
+};
+
+typedef AvlMap<ProfilePoint, unsigned long long, CmpProfilePoint> ProfileMap;
+typedef AvlMapEl<ProfilePoint, unsigned long long> ProfileMapEl;
+
+static unsigned long long profileHits( ProfileMap &profile, int state,
+		bool isDefault, Key low, Key high )
+{
+	ProfilePoint point;
+	point.state = state;
+	point.isDefault = isDefault;
+	point.low = isDefault ? 0 : low.getVal();
+	point.high = isDefault ? 0 : high.getVal();
+
+	ProfileMapEl *el = profile.find( point );
+	return el != 0 ? el->value : 0;
+}
+
+/* Attach the counts written by an instrumented build of the machine to the
+ * states and transitions. Each line of the profile is "machine state kind
+ * low high count", where kind is 'k' for a key range and 'd' for the default
+ * transition. Lines for the same point are added, so the profiles of several
+ * runs can be concatenated. */
+void FsmCodeGen::readProfile()
+{
+	ifstream in( profileFileName );
+	if ( !in.is_open() ) {
+		error() << "could not open profile \"" << profileFileName << 
+				"\" for reading" << endl;
+		return;
+	}
+
+	ProfileMap profile;
+	string machine;
+	ProfilePoint point;
+	char kind;
+	unsigned long long count;
+	while ( in >> machine >> point.state >> kind >> point.low >> point.high >> count ) {
+		if ( machine != fsmName )
+			continue;
+
+		point.isDefault = kind == 'd';
+		ProfileMapEl *el = profile.find( point );
+		if ( el != 0 )
+			el->value += count;
+		else
+			profile.insert( point, count );
+	}
+
+	if ( !in.eof() ) {
+		error() << "profile \"" << profileFileName << "\" is malformed" << endl;
+		return;
+	}
+
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		st->hits = 0;
+		for ( RedTransList::Iter rtel = st->outSingle; rtel.lte(); rtel++ ) {
+			rtel->hits = profileHits( profile, st->id, false, rtel->lowKey, rtel->highKey );
+			st->hits += rtel->hits;
+		}
+		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
+			rtel->hits = profileHits( profile, st->id, false, rtel->lowKey, rtel->highKey );
+			st->hits += rtel->hits;
+		}
+		if ( st->defTrans != 0 )
+			st->hits += profileHits( profile, st->id, true, Key(0), Key(0) );
+	}
+}
+
+/* A state's points are its singles, then its ranges, then its default. */
+void FsmCodeGen::numberProfilePoints()
+{
+	numProfilePoints = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		st->profileBase = numProfilePoints;
+		if ( st != redFsm->errState ) {
+			numProfilePoints += st->outSingle.length() + 
+					st->outRange.length() + 1;
+		}
+	}
+}
+
+bool FsmCodeGen::anySelfLoops()
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st->selfLoop )
+			return true;
+	}
+	return false;
+}
+
+std::ostream &FsmCodeGen::SKIP_OFFSETS()
+{
+	out << "\t";
+	int totalStateNum = 0, curOffset = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		ARRAY_ITEM( curOffset, totalStateNum, st.last() );
+		curOffset += st->exitKeys.length();
+	}
+	out << "\n";
+	return out;
+}
+
+std::ostream &FsmCodeGen::SKIP_LENS()
+{
+	out << "\t";
+	int totalStateNum = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		ARRAY_ITEM( st->exitKeys.length(), totalStateNum, st.last() );
+	}
+	out << "\n";
+	return out;
+}
+
+std::ostream &FsmCodeGen::SKIP_KEYS()
+{
+	out << "\t";
+	int totalKeys = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		for ( KeyVect::Iter key = st->exitKeys; key.lte(); key++ ) {
+			ARRAY_KEY( *key, totalKeys, false );
+		}
+	}
+
+	/* Pad so that a full vector can be loaded from the last state's keys. */
+	for ( int i = 0; i < 16; i++ ) {
+		ARRAY_ITEM( 0, totalKeys, false );
+	}
+	out << 0 << "\n";
+	return out;
+}
+
+void FsmCodeGen::writeSimdData()
+{
+	if ( anySelfLoops() ) {
+		long maxOffset = 0;
+		for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ )
+			maxOffset += st->exitKeys.length();
+
+		OPEN_ARRAY( ARRAY_TYPE(maxOffset), SKO() );
+		SKIP_OFFSETS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(16), SKL() );
+		SKIP_LENS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ALPH_TYPE(), SKK() );
+		SKIP_KEYS();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+}
+
+/* In a state that spins on everything but its exit keys, advance over whole
+ * vectors that contain no exit key. At least one key is always left for the
+ * regular transition. */
+void FsmCodeGen::SIMD_SKIP()
+{
+	if ( noEnd || !anySelfLoops() )
+		return;
+
+	out <<
+		"#if defined(__SSE4_2__)\n"
+		"	if ( " << SKL() << "[" << vCS() << "] != 0 ) {\n"
+		"		__m128i _set = _mm_loadu_si128( (const __m128i*) "
+				"(" << SKK() << " + " << SKO() << "[" << vCS() << "]) );\n"
+		"		int _sklen = " << SKL() << "[" << vCS() << "];\n"
+		"		while ( " << PE() << " - " << P() << " > 16 ) {\n"
+		"			int _i = _mm_cmpestri( _set, _sklen, _mm_loadu_si128( "
+				"(const __m128i*) " << P() << " ), 16,\n"
+		"					_SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY );\n"
+		"			" << P() << " += _i;\n"
+		"			if ( _i < 16 )\n"
+		"				break;\n"
+		"		}\n"
+		"	}\n"
+		"#endif\n"
+		"\n";
+}
+
 ostream &FsmCodeGen::source_warning( const InputLoc &loc )
 {
 	cerr << sourceFileName << ":" << loc.line << ":" << loc.col << ": warning: ";
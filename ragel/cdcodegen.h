@@ -47,6 +47,7 @@ struct GenInlineList;
 struct RedAction;
 struct LongestMatch;
 struct LongestMatchPart;
+class array_counter;
 
 string itoa( int i );
 
@@ -65,6 +66,12 @@ public:
 	virtual void writeFirstFinal();
 	virtual void writeError();
 
+	/* Use SSE for key lookup and for skipping self loops. */
+	bool simd;
+
+	/* Count the transitions taken, for use with --profile. */
+	bool instrument;
+
 protected:
 	string FSM_NAME();
 	string START_STATE_ID();
@@ -73,6 +80,9 @@ protected:
 	string GET_WIDE_KEY( RedStateAp *state );
 	string TABS( int level );
 	string KEY( Key key );
+	void ARRAY_ITEM( long long item, int &count, bool last );
+	void ARRAY_KEY( Key key, int &count, bool last );
+	void ARRAY_WRITE( char *start, char *end, int &count, bool last );
 	string WIDE_KEY( RedStateAp *state, Key key );
 	string LDIR_PATH( char *path );
 	virtual void ACTION( ostream &ret, GenAction *action, int targState, 
@@ -126,6 +136,22 @@ protected:
 	string ET() { return "_" + DATA_PREFIX() + "eof_trans"; }
 	string SP() { return "_" + DATA_PREFIX() + "key_spans"; }
 	string CSP() { return "_" + DATA_PREFIX() + "cond_key_spans"; }
+	string SKO() { return "_" + DATA_PREFIX() + "skip_offsets"; }
+	string SKL() { return "_" + DATA_PREFIX() + "skip_lengths"; }
+	string SKK() { return "_" + DATA_PREFIX() + "skip_keys"; }
+	string SKB() { return "_" + DATA_PREFIX() + "skip_bits"; }
+	string CC() { return "_" + DATA_PREFIX() + "char_class"; }
+	string CB() { return "_" + DATA_PREFIX() + "comb_base"; }
+	string CCH() { return "_" + DATA_PREFIX() + "comb_check"; }
+	string CN() { return "_" + DATA_PREFIX() + "comb_next"; }
+	string DT() { return "_" + DATA_PREFIX() + "default_trans"; }
+	string KB() { return "_" + DATA_PREFIX() + "key_bits"; }
+	string KI() { return "_" + DATA_PREFIX() + "key_index"; }
+	string PFC() { return "_" + DATA_PREFIX() + "profile_counts"; }
+	string PFS() { return "_" + DATA_PREFIX() + "profile_states"; }
+	string PFD() { return "_" + DATA_PREFIX() + "profile_defaults"; }
+	string PFL() { return "_" + DATA_PREFIX() + "profile_low"; }
+	string PFH() { return "_" + DATA_PREFIX() + "profile_high"; }
 	string START() { return DATA_PREFIX() + "start"; }
 	string ERROR() { return DATA_PREFIX() + "error"; }
 	string FIRST_FINAL() { return DATA_PREFIX() + "first_final"; }
@@ -173,6 +199,28 @@ protected:
 
 	unsigned int arrayTypeSize( unsigned long maxVal );
 
+	/* Profiling. Every single, range and default transition of a state is
+	 * a point that an instrumented machine counts. */
+	long numProfilePoints;
+	void readProfile();
+	void numberProfilePoints();
+
+	/* Measuring the arrays written, for the statistics. */
+	unsigned int typeSize( string type );
+	void openArrayStat( string type, string name );
+	void closeArrayStat();
+	array_counter *arrayCounter;
+	string arrayType, arrayName;
+
+	/* SIMD lookup and self-loop skipping. */
+	bool useSimd();
+	bool anySelfLoops();
+	std::ostream &SKIP_OFFSETS();
+	std::ostream &SKIP_LENS();
+	std::ostream &SKIP_KEYS();
+	void writeSimdData();
+	void SIMD_SKIP();
+
 	bool outLabelUsed;
 	bool testEofUsed;
 	bool againLabelUsed;
@@ -151,6 +151,9 @@ std::ostream &FFlatCodeGen::ACTION_SWITCH()
 
 void FFlatCodeGen::writeData()
 {
+	if ( useSimd() )
+		writeSimdData();
+
 	if ( redFsm->anyConditions() ) {
 		OPEN_ARRAY( WIDE_ALPH_TYPE(), CK() );
 		COND_KEYS();
@@ -282,6 +285,9 @@ void FFlatCodeGen::writeExec()
 
 	out << "_resume:\n";
 
+	if ( useSimd() )
+		SIMD_SKIP();
+
 	if ( redFsm->anyFromStateActions() ) {
 		out <<
 			"	switch ( " << FSA() << "[" << vCS() << "] ) {\n";
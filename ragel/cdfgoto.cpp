@@ -174,6 +174,8 @@ void FGotoCodeGen::writeData()
 	}
 
 	STATE_IDS();
+
+	PROFILE_DATA();
 }
 
 void FGotoCodeGen::writeExec()
@@ -183,6 +185,9 @@ void FGotoCodeGen::writeExec()
 
 	out << "	{\n";
 
+	SKIP_BITS();
+	KEY_TABLES();
+
 	if ( redFsm->anyRegCurStateRef() )
 		out << "	int _ps = 0;\n";
 
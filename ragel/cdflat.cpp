@@ -25,6 +25,9 @@
 #include "cdflat.h"
 #include "redfsm.h"
 #include "gendata.h"
+#include <sstream>
+
+using std::ostringstream;
 
 std::ostream &FlatCodeGen::TO_STATE_ACTION( RedStateAp *state )
 {
@@ -139,12 +142,7 @@ std::ostream &FlatCodeGen::FLAT_INDEX_OFFSET()
 	int totalStateNum = 0, curIndOffset = 0;
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
 		/* Write the index offset. */
-		out << curIndOffset;
-		if ( !st.last() ) {
-			out << ", ";
-			if ( ++totalStateNum % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( curIndOffset, totalStateNum, st.last() );
 		
 		/* Move the index offset ahead. */
 		if ( st->transList != 0 )
@@ -166,12 +164,7 @@ std::ostream &FlatCodeGen::KEY_SPANS()
 		unsigned long long span = 0;
 		if ( st->transList != 0 )
 			span = keyOps->span( st->lowKey, st->highKey );
-		out << span;
-		if ( !st.last() ) {
-			out << ", ";
-			if ( ++totalStateNum % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( span, totalStateNum, st.last() );
 	}
 	out << "\n";
 	return out;
@@ -240,13 +233,7 @@ std::ostream &FlatCodeGen::EOF_TRANS()
 			assert( st->eofTrans->pos >= 0 );
 			trans = st->eofTrans->pos+1;
 		}
-		out << trans;
-
-		if ( !st.last() ) {
-			out << ", ";
-			if ( ++totalStateNum % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( trans, totalStateNum, st.last() );
 	}
 	out << "\n";
 	return out;
@@ -280,12 +267,7 @@ std::ostream &FlatCodeGen::COND_KEY_SPANS()
 		unsigned long long span = 0;
 		if ( st->condList != 0 )
 			span = keyOps->span( st->condLowKey, st->condHighKey );
-		out << span;
-		if ( !st.last() ) {
-			out << ", ";
-			if ( ++totalStateNum % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( span, totalStateNum, st.last() );
 	}
 	out << "\n";
 	return out;
@@ -322,12 +304,7 @@ std::ostream &FlatCodeGen::COND_INDEX_OFFSET()
 	int totalStateNum = 0, curIndOffset = 0;
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
 		/* Write the index offset. */
-		out << curIndOffset;
-		if ( !st.last() ) {
-			out << ", ";
-			if ( ++totalStateNum % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( curIndOffset, totalStateNum, st.last() );
 		
 		/* Move the index offset ahead. */
 		if ( st->condList != 0 )
@@ -365,9 +342,7 @@ std::ostream &FlatCodeGen::INDICIES()
 			/* Walk the singles. */
 			unsigned long long span = keyOps->span( st->lowKey, st->highKey );
 			for ( unsigned long long pos = 0; pos < span; pos++ ) {
-				out << st->transList[pos]->id << ", ";
-				if ( ++totalTrans % IALL == 0 )
-					out << "\n\t";
+				ARRAY_ITEM( st->transList[pos]->id, totalTrans, false );
 			}
 		}
 
@@ -401,12 +376,7 @@ std::ostream &FlatCodeGen::TRANS_TARGS()
 		trans->pos = t;
 
 		/* Write out the target state. */
-		out << trans->targ->id;
-		if ( t < redFsm->transSet.length()-1 ) {
-			out << ", ";
-			if ( ++totalStates % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( trans->targ->id, totalStates, t == redFsm->transSet.length()-1 );
 	}
 	out << "\n";
 	delete[] transPtrs;
@@ -439,8 +409,75 @@ std::ostream &FlatCodeGen::TRANS_ACTIONS()
 	return out;
 }
 
+std::ostream &FlatCodeGen::CHAR_CLASSES()
+{
+	out << '\t';
+	unsigned long long span = keyOps->span( redFsm->classLowKey, redFsm->classHighKey );
+	for ( unsigned long long pos = 0; pos < span; pos++ ) {
+		out << redFsm->charClass[pos];
+		if ( pos < span - 1 ) {
+			out << ", ";
+			if ( (pos + 1) % IALL == 0 )
+				out << "\n\t";
+		}
+	}
+	out << "\n";
+	return out;
+}
+
+/* The states by classes matrix of transition ids. */
+std::ostream &FlatCodeGen::CLASS_INDICIES()
+{
+	int numMapped = redFsm->classBounded ? 
+			redFsm->numClasses - 1 : redFsm->numClasses;
+
+	out << '\t';
+	int totalTrans = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		for ( int c = 0; c < redFsm->numClasses; c++ ) {
+			RedTransAp *trans = c < numMapped ?
+					redFsm->flatTrans( st, redFsm->classRep[c] ) : st->defTrans;
+			ARRAY_ITEM( trans != 0 ? trans->id : 0, totalTrans, false );
+		}
+	}
+
+	/* Output one last number so we don't have to figure out when the last
+	 * entry is and avoid writing a comma. */
+	out << 0 << "\n";
+	return out;
+}
+
+/* Offset of the wide key into the class map. */
+string FlatCodeGen::CLASS_OFFSET()
+{
+	ostringstream ret;
+	ret << GET_WIDE_KEY();
+	if ( redFsm->classLowKey.getVal() < 0 )
+		ret << " + " << -redFsm->classLowKey.getVal();
+	else if ( redFsm->classLowKey.getVal() > 0 )
+		ret << " - " << KEY( redFsm->classLowKey );
+	return ret.str();
+}
+
 void FlatCodeGen::LOCATE_TRANS()
 {
+	if ( charClasses ) {
+		out << "	_trans = " << I() << "[" << vCS() << " * " << redFsm->numClasses << " +";
+		if ( redFsm->classBounded ) {
+			out << "\n"
+				"		( " << KEY( redFsm->classLowKey ) << " <= " << GET_WIDE_KEY() << 
+						" && " << GET_WIDE_KEY() << " <= " << KEY( redFsm->classHighKey ) << " ?\n"
+				"		" << CC() << "[" << CLASS_OFFSET() << "] : " << 
+						redFsm->numClasses - 1 << " )";
+		}
+		else {
+			out << " " << CC() << "[" << CLASS_OFFSET() << "]";
+		}
+		out << "];\n"
+			"\n";
+		return;
+	}
+
 	out <<
 		"	_keys = " << ARR_OFF( K(), "(" + vCS() + "<<1)" ) << ";\n"
 		"	_inds = " << ARR_OFF( I(), IO() + "[" + vCS() + "]" ) << ";\n"
@@ -539,6 +576,9 @@ void FlatCodeGen::BREAK( ostream &ret, int targState, bool csForced )
 
 void FlatCodeGen::writeData()
 {
+	if ( useSimd() )
+		writeSimdData();
+
 	/* If there are any transtion functions then output the array. If there
 	 * are none, don't bother emitting an empty array that won't be used. */
 	if ( redFsm->anyActions() ) {
@@ -570,25 +610,38 @@ void FlatCodeGen::writeData()
 		"\n";
 	}
 
-	OPEN_ARRAY( WIDE_ALPH_TYPE(), K() );
-	KEYS();
-	CLOSE_ARRAY() <<
-	"\n";
+	if ( charClasses ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->numClasses), CC() );
+		CHAR_CLASSES();
+		CLOSE_ARRAY() <<
+		"\n";
 
-	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxSpan), SP() );
-	KEY_SPANS();
-	CLOSE_ARRAY() <<
-	"\n";
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxIndex), I() );
+		CLASS_INDICIES();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+	else {
+		OPEN_ARRAY( WIDE_ALPH_TYPE(), K() );
+		KEYS();
+		CLOSE_ARRAY() <<
+		"\n";
 
-	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxFlatIndexOffset), IO() );
-	FLAT_INDEX_OFFSET();
-	CLOSE_ARRAY() <<
-	"\n";
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxSpan), SP() );
+		KEY_SPANS();
+		CLOSE_ARRAY() <<
+		"\n";
 
-	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxIndex), I() );
-	INDICIES();
-	CLOSE_ARRAY() <<
-	"\n";
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxFlatIndexOffset), IO() );
+		FLAT_INDEX_OFFSET();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxIndex), I() );
+		INDICIES();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
 
 	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxState), TT() );
 	TRANS_TARGS();
@@ -679,16 +732,21 @@ void FlatCodeGen::writeExec()
 	testEofUsed = false;
 	outLabelUsed = false;
 
-	out << 
-		"	{\n"
-		"	int _slen";
+	/* The class lookup needs the key span variables only for conditions. */
+	bool keySpans = !charClasses || redFsm->anyConditions();
 
-	if ( redFsm->anyRegCurStateRef() )
-		out << ", _ps";
+	out << "	{\n";
 
-	out << 
-		";\n"
-		"	int _trans";
+	if ( keySpans ) {
+		out << "	int _slen";
+		if ( redFsm->anyRegCurStateRef() )
+			out << ", _ps";
+		out << ";\n";
+	}
+	else if ( redFsm->anyRegCurStateRef() )
+		out << "	int _ps;\n";
+
+	out << "	int _trans";
 
 	if ( redFsm->anyConditions() )
 		out << ", _cond";
@@ -702,9 +760,10 @@ void FlatCodeGen::writeExec()
 			"	" << UINT() << " _nacts;\n"; 
 	}
 
-	out <<
-		"	" << PTR_CONST() << WIDE_ALPH_TYPE() << PTR_CONST_END() << POINTER() << "_keys;\n"
-		"	" << PTR_CONST() << ARRAY_TYPE(redFsm->maxIndex) << PTR_CONST_END() << POINTER() << "_inds;\n";
+	if ( keySpans )
+		out << "	" << PTR_CONST() << WIDE_ALPH_TYPE() << PTR_CONST_END() << POINTER() << "_keys;\n";
+	if ( !charClasses )
+		out << "	" << PTR_CONST() << ARRAY_TYPE(redFsm->maxIndex) << PTR_CONST_END() << POINTER() << "_inds;\n";
 
 	if ( redFsm->anyConditions() ) {
 		out << 
@@ -730,6 +789,9 @@ void FlatCodeGen::writeExec()
 
 	out << "_resume:\n";
 
+	if ( useSimd() )
+		SIMD_SKIP();
+
 	if ( redFsm->anyFromStateActions() ) {
 		out <<
 			"	_acts = " << ARR_OFF( A(), FSA() + "[" + vCS() + "]" ) << ";\n"
@@ -39,9 +39,12 @@ struct RedStateAp;
 class FlatCodeGen : virtual public FsmCodeGen
 {
 public:
-	FlatCodeGen( ostream &out ) : FsmCodeGen(out) {}
+	FlatCodeGen( ostream &out ) : FsmCodeGen(out), charClasses(false) {}
 	virtual ~FlatCodeGen() { }
 
+	/* Index the transitions by alphabet equivalence class. */
+	bool charClasses;
+
 protected:
 	std::ostream &TO_STATE_ACTION_SWITCH();
 	std::ostream &FROM_STATE_ACTION_SWITCH();
@@ -59,6 +62,10 @@ protected:
 	std::ostream &TRANS_ACTIONS();
 	void LOCATE_TRANS();
 
+	std::ostream &CHAR_CLASSES();
+	std::ostream &CLASS_INDICIES();
+	string CLASS_OFFSET();
+
 	std::ostream &COND_INDEX_OFFSET();
 	void COND_TRANSLATE();
 	std::ostream &CONDS();
@@ -180,6 +180,9 @@ std::ostream &FTabCodeGen::ACTION_SWITCH()
 
 void FTabCodeGen::writeData()
 {
+	if ( useSimd() )
+		writeSimdData();
+
 	if ( redFsm->anyConditions() ) {
 		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxCondOffset), CO() );
 		COND_OFFSETS();
@@ -328,6 +331,9 @@ void FTabCodeGen::writeExec()
 
 	out << "_resume:\n";
 
+	if ( useSimd() )
+		SIMD_SKIP();
+
 	if ( redFsm->anyFromStateActions() ) {
 		out <<
 			"	switch ( " << FSA() << "[" << vCS() << "] ) {\n";
@@ -26,6 +26,7 @@
 #include "redfsm.h"
 #include "bstmap.h"
 #include "gendata.h"
+#include <string.h>
 
 /* Emit the goto to take for a given transition. */
 std::ostream &GotoCodeGen::TRANS_GOTO( RedTransAp *trans, int level )
@@ -109,6 +110,413 @@ void GotoCodeGen::GOTO_HEADER( RedStateAp *state )
 }
 
 
+/* Exit sets larger than this are tested with a bit table rather than by
+ * comparing against each exit key. */
+static const int skipMaxCompare = 3;
+
+/* Writes the 256 bit exit tables of the self-looping states, numbering the
+ * states as it goes. With a partition given only that partition's states are
+ * written. */
+std::ostream &GotoCodeGen::SKIP_BITS( int partition )
+{
+	int numTables = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		st->skipOffset = -1;
+		if ( st->selfLoop && st->exitKeys.length() > skipMaxCompare &&
+				( partition < 0 || st->partition == partition ) )
+			st->skipOffset = 32 * numTables++;
+	}
+
+	if ( noEnd || numTables == 0 )
+		return out;
+
+	OPEN_ARRAY( ARRAY_TYPE(255), SKB() );
+	out << "\t";
+	int totalBytes = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st->skipOffset < 0 )
+			continue;
+
+		unsigned char bits[32];
+		memset( bits, 0, sizeof(bits) );
+		for ( KeyVect::Iter key = st->exitKeys; key.lte(); key++ ) {
+			unsigned char c = (unsigned char) key->getVal();
+			bits[c >> 3] |= 1 << (c & 7);
+		}
+
+		for ( int i = 0; i < 32; i++ ) {
+			ARRAY_ITEM( bits[i], totalBytes, false );
+		}
+	}
+
+	/* Output one last number so we don't have to figure out when the last
+	 * entry is and avoid writing a comma. */
+	out << 0 << "\n";
+	CLOSE_ARRAY() <<
+	"\n";
+	return out;
+}
+
+string GotoCodeGen::SKIP_EOF_LABEL( RedStateAp *state )
+{
+	testEofUsed = true;
+	return "_test_eof";
+}
+
+/* Limits of the key lookup cost model. States with fewer tests than
+ * keyMinTests are cheap to search. A switch over every key is used for up
+ * to keySwitchMaxKeys keys that fill at least half of their span, which
+ * compilers turn into a single jump table. An index table costs 256 bytes
+ * of data, so it needs keyIndexMinTests tests to pay for itself. */
+static const int keyMinTests = 4;
+static const int keySwitchMaxKeys = 64;
+static const int keyIndexMinTests = 8;
+
+/* The singles and ranges of a state, merged into key order. */
+static void keyTransList( RedStateAp *state, RedTransList &list )
+{
+	RedTransEl *single = state->outSingle.data;
+	RedTransEl *singleEnd = single + state->outSingle.length();
+	RedTransEl *range = state->outRange.data;
+	RedTransEl *rangeEnd = range + state->outRange.length();
+
+	while ( single < singleEnd || range < rangeEnd ) {
+		if ( range == rangeEnd || ( single < singleEnd && single->lowKey < range->lowKey ) )
+			list.append( *single++ );
+		else
+			list.append( *range++ );
+	}
+}
+
+/* The distinct transitions taken on keys, in order of first appearance. An
+ * index table gives each its position plus one, leaving zero for the
+ * default. */
+static void keyTargs( RedTransList &list, Vector<RedTransAp*> &targs )
+{
+	for ( RedTransList::Iter rtel = list; rtel.lte(); rtel++ ) {
+		long t = 0;
+		while ( t < targs.length() && targs[t] != rtel->value )
+			t += 1;
+		if ( t == targs.length() )
+			targs.append( rtel->value );
+	}
+}
+
+/* Estimates which lookup takes the fewest branches for a state. A search
+ * takes a branch for the singles switch and about log2 of the number of
+ * ranges more. The others take one or two branches regardless of the
+ * number of keys but need a byte alphabet, and must not stand in for the
+ * per range counters of an instrumented machine. */
+KeyDispatch GotoCodeGen::chooseKeyDispatch( RedStateAp *state )
+{
+	int numTests = state->outSingle.length() + state->outRange.length();
+	if ( instrument || keyOps->alphType->size != 1 || 
+			state->stateCondVect.length() > 0 || numTests < keyMinTests )
+		return KeySearch;
+
+	RedTransList list;
+	keyTransList( state, list );
+
+	Vector<RedTransAp*> targs;
+	keyTargs( list, targs );
+
+	/* Every key that does not take the default takes the same transition. */
+	if ( targs.length() == 1 )
+		return KeyBits;
+
+	long numKeys = 0;
+	for ( RedTransList::Iter rtel = list; rtel.lte(); rtel++ )
+		numKeys += rtel->highKey.getVal() - rtel->lowKey.getVal() + 1;
+	long span = list[list.length()-1].highKey.getVal() - list[0].lowKey.getVal() + 1;
+
+	if ( numKeys <= keySwitchMaxKeys && numKeys * 2 >= span )
+		return KeySwitch;
+
+	if ( numTests >= keyIndexMinTests )
+		return KeyIndex;
+
+	return KeySearch;
+}
+
+/* Chooses the key lookup of the states and writes the bitmaps and index
+ * tables they need, numbering the states as it goes. With a partition given
+ * only that partition's states are written. */
+std::ostream &GotoCodeGen::KEY_TABLES( int partition )
+{
+	int numBits = 0, numIndex = 0;
+	long maxIndex = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		st->keyDispatch = KeySearch;
+		st->keyTableOffset = -1;
+		if ( st == redFsm->errState || ( partition >= 0 && st->partition != partition ) )
+			continue;
+
+		st->keyDispatch = chooseKeyDispatch( st );
+		if ( st->keyDispatch == KeyBits )
+			st->keyTableOffset = 32 * numBits++;
+		else if ( st->keyDispatch == KeyIndex ) {
+			st->keyTableOffset = 256 * numIndex++;
+
+			RedTransList list;
+			keyTransList( st, list );
+			Vector<RedTransAp*> targs;
+			keyTargs( list, targs );
+			if ( targs.length() > maxIndex )
+				maxIndex = targs.length();
+		}
+	}
+
+	if ( numBits > 0 ) {
+		OPEN_ARRAY( ARRAY_TYPE(255), KB() );
+		out << "\t";
+		int totalBytes = 0;
+		for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+			if ( st->keyDispatch != KeyBits )
+				continue;
+
+			unsigned char bits[32];
+			memset( bits, 0, sizeof(bits) );
+			RedTransList list;
+			keyTransList( st, list );
+			for ( RedTransList::Iter rtel = list; rtel.lte(); rtel++ ) {
+				for ( long k = rtel->lowKey.getVal(); k <= rtel->highKey.getVal(); k++ ) {
+					unsigned char c = (unsigned char) k;
+					bits[c >> 3] |= 1 << (c & 7);
+				}
+			}
+
+			for ( int i = 0; i < 32; i++ )
+				ARRAY_ITEM( bits[i], totalBytes, false );
+		}
+
+		/* Output one last number so we don't have to figure out when the last
+		 * entry is and avoid writing a comma. */
+		out << 0 << "\n";
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( numIndex > 0 ) {
+		OPEN_ARRAY( ARRAY_TYPE(maxIndex), KI() );
+		out << "\t";
+		int totalItems = 0;
+		for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+			if ( st->keyDispatch != KeyIndex )
+				continue;
+
+			unsigned char index[256];
+			memset( index, 0, sizeof(index) );
+			RedTransList list;
+			keyTransList( st, list );
+			Vector<RedTransAp*> targs;
+			keyTargs( list, targs );
+			for ( RedTransList::Iter rtel = list; rtel.lte(); rtel++ ) {
+				long t = 0;
+				while ( targs[t] != rtel->value )
+					t += 1;
+				for ( long k = rtel->lowKey.getVal(); k <= rtel->highKey.getVal(); k++ )
+					index[(unsigned char) k] = t + 1;
+			}
+
+			for ( int i = 0; i < 256; i++ )
+				ARRAY_ITEM( index[i], totalItems, false );
+		}
+
+		out << 0 << "\n";
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	return out;
+}
+
+/* One case for every key, with the keys of a transition grouped. */
+void GotoCodeGen::emitKeySwitch( RedStateAp *state )
+{
+	RedTransList list;
+	keyTransList( state, list );
+
+	out << "\tswitch( " << GET_KEY() << " ) {\n";
+	for ( RedTransList::Iter rtel = list; rtel.lte(); rtel++ ) {
+		out << "\t\t";
+		for ( long k = rtel->lowKey.getVal(); k <= rtel->highKey.getVal(); k++ )
+			out << "case " << KEY( Key( k ) ) << ": ";
+		TRANS_GOTO( rtel->value, 0 ) << "\n";
+	}
+
+	/* Emits a default case for D code. */
+	SWITCH_DEFAULT();
+
+	out << "\t}\n";
+}
+
+void GotoCodeGen::emitKeyBits( RedStateAp *state )
+{
+	string ch = CAST( ARRAY_TYPE(255) ) + GET_KEY();
+	out << "\tif ( " << KB() << "[" << state->keyTableOffset << " + (" << ch << 
+			" >> 3)] & (1 << (" << ch << " & 7)) )\n";
+	TRANS_GOTO( state->outSingle.length() > 0 ? 
+			state->outSingle[0].value : state->outRange[0].value, 2 ) << "\n";
+}
+
+void GotoCodeGen::emitKeyIndex( RedStateAp *state )
+{
+	RedTransList list;
+	keyTransList( state, list );
+	Vector<RedTransAp*> targs;
+	keyTargs( list, targs );
+
+	string ch = CAST( ARRAY_TYPE(255) ) + GET_KEY();
+	out << "\tswitch( " << KI() << "[" << state->keyTableOffset << " + " << ch << "] ) {\n";
+	for ( long t = 0; t < targs.length(); t++ ) {
+		out << "\t\tcase " << t + 1 << ": ";
+		TRANS_GOTO( targs[t], 0 ) << "\n";
+	}
+
+	/* Emits a default case for D code. */
+	SWITCH_DEFAULT();
+
+	out << "\t}\n";
+}
+
+/* Writes the lookup of the key chosen for the state. The default transition
+ * follows it. */
+void GotoCodeGen::emitKeyDispatch( RedStateAp *state )
+{
+	switch ( state->keyDispatch ) {
+	case KeySearch:
+		/* Try singles. */
+		if ( state->outSingle.length() > 0 )
+			emitSingleSwitch( state );
+
+		/* Default case is to binary search for the ranges, if that fails then */
+		if ( state->outRange.length() > 0 )
+			emitRangeBSearch( state, 1, 0, state->outRange.length() - 1 );
+		break;
+	case KeySwitch:
+		emitKeySwitch( state );
+		break;
+	case KeyBits:
+		emitKeyBits( state );
+		break;
+	case KeyIndex:
+		emitKeyIndex( state );
+		break;
+	}
+}
+
+/* In a state that loops back to itself on all but its exit keys, advance over
+ * the keys until an exit key is found, then carry on with the regular
+ * dispatch. */
+void GotoCodeGen::SELF_LOOP_SKIP( RedStateAp *state )
+{
+	if ( noEnd || !state->selfLoop )
+		return;
+
+	string eofLabel = SKIP_EOF_LABEL( state );
+	KeyVect &exits = state->exitKeys;
+
+	/* A single exit byte can be found with memchr. */
+	bool useMemchr = exits.length() == 1 && 
+			hostLang->lang == HostLang::C && getKeyExpr == 0;
+	if ( useMemchr ) {
+		out <<
+			"#if defined(__GNUC__)\n"
+			"	{\n"
+			"		const char *_e = (const char*) __builtin_memchr( " << P() << ", " << 
+					KEY( exits[0] ) << ", " << PE() << " - " << P() << " );\n"
+			"		if ( _e == 0 ) {\n"
+			"			" << P() << " = " << PE() << ";\n"
+			"			goto " << eofLabel << ";\n"
+			"		}\n"
+			"		" << P() << " += _e - (const char*) " << P() << ";\n"
+			"	}\n"
+			"#else\n";
+	}
+
+	out << "	while ( ";
+	if ( state->skipOffset < 0 ) {
+		for ( KeyVect::Iter key = exits; key.lte(); key++ ) {
+			if ( !key.first() )
+				out << " && ";
+			out << GET_KEY() << " != " << KEY( *key );
+		}
+	}
+	else {
+		string ch = CAST( ARRAY_TYPE(255) ) + GET_KEY();
+		out << "!(" << SKB() << "[" << state->skipOffset << " + (" << ch << 
+				" >> 3)] & (1 << (" << ch << " & 7)))";
+	}
+	out << " ) {\n"
+		"		if ( ++" << P() << " == " << PE() << " )\n"
+		"			goto " << eofLabel << ";\n"
+		"	}\n";
+
+	if ( useMemchr )
+		out << "#endif\n";
+}
+
+/* Counts the transition before taking it in an instrumented machine. The
+ * point is the transition's index among the state's singles, ranges and
+ * default, in that order. */
+std::ostream &GotoCodeGen::STATE_TRANS_GOTO( RedStateAp *state, long point,
+		RedTransAp *trans, int level )
+{
+	if ( !instrument )
+		return TRANS_GOTO( trans, level );
+
+	out << TABS(level) << "{ " << PFC() << "[" << 
+			state->profileBase + point << "]++; ";
+	TRANS_GOTO( trans, 0 ) << " }";
+	return out;
+}
+
+/* When one key transition took most of a state's profiled hits it is tested
+ * before the others. */
+void GotoCodeGen::emitHotTest( RedStateAp *state )
+{
+	int numSingles = state->outSingle.length();
+	int numRanges = state->outRange.length();
+	if ( state->hits == 0 || numSingles + numRanges < 2 )
+		return;
+
+	long point = -1;
+	RedTransEl *hot = 0;
+	for ( int j = 0; j < numSingles; j++ ) {
+		if ( hot == 0 || state->outSingle[j].hits > hot->hits ) {
+			point = j;
+			hot = &state->outSingle[j];
+		}
+	}
+	for ( int j = 0; j < numRanges; j++ ) {
+		if ( hot == 0 || state->outRange[j].hits > hot->hits ) {
+			point = numSingles + j;
+			hot = &state->outRange[j];
+		}
+	}
+
+	if ( hot->hits * 2 <= state->hits )
+		return;
+
+	bool limitLow = hot->lowKey == keyOps->minKey;
+	bool limitHigh = hot->highKey == keyOps->maxKey;
+
+	out << "\tif ( ";
+	if ( hot->lowKey == hot->highKey )
+		out << GET_WIDE_KEY(state) << " == " << WIDE_KEY(state, hot->lowKey);
+	else {
+		if ( !limitLow ) {
+			out << WIDE_KEY(state, hot->lowKey) << " <= " << GET_WIDE_KEY(state);
+			if ( !limitHigh )
+				out << " && ";
+		}
+		if ( !limitHigh )
+			out << GET_WIDE_KEY(state) << " <= " << WIDE_KEY(state, hot->highKey);
+	}
+	out << " )\n";
+	STATE_TRANS_GOTO( state, point, hot->value, 2 ) << "\n";
+}
+
 void GotoCodeGen::emitSingleSwitch( RedStateAp *state )
 {
 	/* Load up the singles. */
@@ -121,16 +529,28 @@ void GotoCodeGen::emitSingleSwitch( RedStateAp *state )
 				WIDE_KEY(state, data[0].lowKey) << " )\n\t\t"; 
 
 		/* Virtual function for writing the target of the transition. */
-		TRANS_GOTO(data[0].value, 0) << "\n";
+		STATE_TRANS_GOTO(state, 0, data[0].value, 0) << "\n";
 	}
 	else if ( numSingles > 1 ) {
+		/* Profiled states list the hottest cases first. Keys with equal
+		 * counts stay in key order. */
+		int *order = new int[numSingles];
+		for ( int j = 0; j < numSingles; j++ ) {
+			int pos = j;
+			while ( pos > 0 && data[order[pos-1]].hits < data[j].hits ) {
+				order[pos] = order[pos-1];
+				pos -= 1;
+			}
+			order[pos] = j;
+		}
+
 		/* Write out single keys in a switch if there is more than one. */
 		out << "\tswitch( " << GET_WIDE_KEY(state) << " ) {\n";
 
 		/* Write out the single indicies. */
 		for ( int j = 0; j < numSingles; j++ ) {
-			out << "\t\tcase " << WIDE_KEY(state, data[j].lowKey) << ": ";
-			TRANS_GOTO(data[j].value, 0) << "\n";
+			out << "\t\tcase " << WIDE_KEY(state, data[order[j]].lowKey) << ": ";
+			STATE_TRANS_GOTO(state, order[j], data[order[j]].value, 0) << "\n";
 		}
 		
 		/* Emits a default case for D code. */
@@ -138,6 +558,8 @@ void GotoCodeGen::emitSingleSwitch( RedStateAp *state )
 
 		/* Close off the transition switch. */
 		out << "\t}\n";
+
+		delete[] order;
 	}
 }
 
@@ -146,6 +568,7 @@ void GotoCodeGen::emitRangeBSearch( RedStateAp *state, int level, int low, int h
 	/* Get the mid position, staying on the lower end of the range. */
 	int mid = (low + high) >> 1;
 	RedTransEl *data = state->outRange.data;
+	long point = state->outSingle.length() + mid;
 
 	/* Determine if we need to look higher or lower. */
 	bool anyLower = mid > low;
@@ -164,7 +587,7 @@ void GotoCodeGen::emitRangeBSearch( RedStateAp *state, int level, int low, int h
 				WIDE_KEY(state, data[mid].highKey) << " ) {\n";
 		emitRangeBSearch( state, level+1, mid+1, high );
 		out << TABS(level) << "} else\n";
-		TRANS_GOTO(data[mid].value, level+1) << "\n";
+		STATE_TRANS_GOTO(state, point, data[mid].value, level+1) << "\n";
 	}
 	else if ( anyLower && !anyHigher ) {
 		/* Can go lower than mid but not higher. */
@@ -176,12 +599,12 @@ void GotoCodeGen::emitRangeBSearch( RedStateAp *state, int level, int low, int h
 		 * sense testing it. */
 		if ( limitHigh ) {
 			out << TABS(level) << "} else\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			STATE_TRANS_GOTO(state, point, data[mid].value, level+1) << "\n";
 		}
 		else {
 			out << TABS(level) << "} else if ( " << GET_WIDE_KEY(state) << " <= " << 
 					WIDE_KEY(state, data[mid].highKey) << " )\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			STATE_TRANS_GOTO(state, point, data[mid].value, level+1) << "\n";
 		}
 	}
 	else if ( !anyLower && anyHigher ) {
@@ -194,12 +617,12 @@ void GotoCodeGen::emitRangeBSearch( RedStateAp *state, int level, int low, int h
 		 * sense testing it. */
 		if ( limitLow ) {
 			out << TABS(level) << "} else\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			STATE_TRANS_GOTO(state, point, data[mid].value, level+1) << "\n";
 		}
 		else {
 			out << TABS(level) << "} else if ( " << GET_WIDE_KEY(state) << " >= " << 
 					WIDE_KEY(state, data[mid].lowKey) << " )\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			STATE_TRANS_GOTO(state, point, data[mid].value, level+1) << "\n";
 		}
 	}
 	else {
@@ -209,21 +632,21 @@ void GotoCodeGen::emitRangeBSearch( RedStateAp *state, int level, int low, int h
 			out << TABS(level) << "if ( " << WIDE_KEY(state, data[mid].lowKey) << " <= " << 
 					GET_WIDE_KEY(state) << " && " << GET_WIDE_KEY(state) << " <= " << 
 					WIDE_KEY(state, data[mid].highKey) << " )\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			STATE_TRANS_GOTO(state, point, data[mid].value, level+1) << "\n";
 		}
 		else if ( limitLow && !limitHigh ) {
 			out << TABS(level) << "if ( " << GET_WIDE_KEY(state) << " <= " << 
 					WIDE_KEY(state, data[mid].highKey) << " )\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			STATE_TRANS_GOTO(state, point, data[mid].value, level+1) << "\n";
 		}
 		else if ( !limitLow && limitHigh ) {
 			out << TABS(level) << "if ( " << WIDE_KEY(state, data[mid].lowKey) << " <= " << 
 					GET_WIDE_KEY(state) << " )\n";
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			STATE_TRANS_GOTO(state, point, data[mid].value, level+1) << "\n";
 		}
 		else {
 			/* Both high and low are at the limit. No tests to do. */
-			TRANS_GOTO(data[mid].value, level+1) << "\n";
+			STATE_TRANS_GOTO(state, point, data[mid].value, level+1) << "\n";
 		}
 	}
 }
@@ -356,21 +779,22 @@ std::ostream &GotoCodeGen::STATE_GOTOS()
 			/* Writing code above state gotos. */
 			GOTO_HEADER( st );
 
+			SELF_LOOP_SKIP( st );
+
 			if ( st->stateCondVect.length() > 0 ) {
 				out << "	_widec = " << GET_KEY() << ";\n";
 				emitCondBSearch( st, 1, 0, st->stateCondVect.length() - 1 );
 			}
 
-			/* Try singles. */
-			if ( st->outSingle.length() > 0 )
-				emitSingleSwitch( st );
+			/* The transition most often taken in a profiling run. */
+			emitHotTest( st );
 
-			/* Default case is to binary search for the ranges, if that fails then */
-			if ( st->outRange.length() > 0 )
-				emitRangeBSearch( st, 1, 0, st->outRange.length() - 1 );
+			/* Look up the key. */
+			emitKeyDispatch( st );
 
 			/* Write the default transition. */
-			TRANS_GOTO( st->defTrans, 1 ) << "\n";
+			STATE_TRANS_GOTO( st, st->outSingle.length() + 
+					st->outRange.length(), st->defTrans, 1 ) << "\n";
 		}
 	}
 	return out;
@@ -525,6 +949,83 @@ std::ostream &GotoCodeGen::EOF_ACTIONS()
 	return out;
 }
 
+/* The counters of an instrumented machine, what each one counts, and a
+ * function that writes them out in the form that --profile reads. */
+void GotoCodeGen::PROFILE_DATA()
+{
+	if ( !instrument || numProfilePoints == 0 )
+		return;
+
+	Vector<long> states, defaults, lows, highs;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st == redFsm->errState )
+			continue;
+
+		for ( RedTransList::Iter rtel = st->outSingle; rtel.lte(); rtel++ ) {
+			states.append( st->id );
+			defaults.append( 0 );
+			lows.append( rtel->lowKey.getVal() );
+			highs.append( rtel->highKey.getVal() );
+		}
+		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
+			states.append( st->id );
+			defaults.append( 0 );
+			lows.append( rtel->lowKey.getVal() );
+			highs.append( rtel->highKey.getVal() );
+		}
+		states.append( st->id );
+		defaults.append( 1 );
+		lows.append( 0 );
+		highs.append( 0 );
+	}
+
+	int totalPoints = 0;
+	OPEN_ARRAY( ARRAY_TYPE(redFsm->nextStateId), PFS() );
+	out << "\t";
+	for ( long i = 0; i < numProfilePoints; i++ )
+		ARRAY_ITEM( states[i], totalPoints, i == numProfilePoints-1 );
+	out << "\n";
+	CLOSE_ARRAY() << "\n";
+
+	totalPoints = 0;
+	OPEN_ARRAY( ARRAY_TYPE(1), PFD() );
+	out << "\t";
+	for ( long i = 0; i < numProfilePoints; i++ )
+		ARRAY_ITEM( defaults[i], totalPoints, i == numProfilePoints-1 );
+	out << "\n";
+	CLOSE_ARRAY() << "\n";
+
+	totalPoints = 0;
+	OPEN_ARRAY( "long", PFL() );
+	out << "\t";
+	for ( long i = 0; i < numProfilePoints; i++ )
+		ARRAY_ITEM( lows[i], totalPoints, i == numProfilePoints-1 );
+	out << "\n";
+	CLOSE_ARRAY() << "\n";
+
+	totalPoints = 0;
+	OPEN_ARRAY( "long", PFH() );
+	out << "\t";
+	for ( long i = 0; i < numProfilePoints; i++ )
+		ARRAY_ITEM( highs[i], totalPoints, i == numProfilePoints-1 );
+	out << "\n";
+	CLOSE_ARRAY() << "\n";
+
+	out <<
+		"static unsigned long " << PFC() << "[" << numProfilePoints << "];\n"
+		"\n"
+		"static void " << DATA_PREFIX() << "write_profile( FILE *file )\n"
+		"{\n"
+		"	int _i;\n"
+		"	for ( _i = 0; _i < " << numProfilePoints << "; _i++ ) {\n"
+		"		fprintf( file, \"" << FSM_NAME() << " %d %c %ld %ld %lu\\n\",\n"
+		"				(int) " << PFS() << "[_i], " << PFD() << "[_i] ? 'd' : 'k',\n"
+		"				" << PFL() << "[_i], " << PFH() << "[_i], " << PFC() << "[_i] );\n"
+		"	}\n"
+		"}\n"
+		"\n";
+}
+
 std::ostream &GotoCodeGen::FINISH_CASES()
 {
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
@@ -655,6 +1156,8 @@ void GotoCodeGen::writeData()
 	}
 
 	STATE_IDS();
+
+	PROFILE_DATA();
 }
 
 void GotoCodeGen::writeExec()
@@ -664,6 +1167,9 @@ void GotoCodeGen::writeExec()
 
 	out << "	{\n";
 
+	SKIP_BITS();
+	KEY_TABLES();
+
 	if ( redFsm->anyRegCurStateRef() )
 		out << "	int _ps = 0;\n";
 
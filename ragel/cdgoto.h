@@ -75,13 +75,32 @@ public:
 
 	virtual std::ostream &TRANS_GOTO( RedTransAp *trans, int level );
 
+	/* Counting transitions in instrumented machines. */
+	std::ostream &STATE_TRANS_GOTO( RedStateAp *state, long point, 
+			RedTransAp *trans, int level );
+	void PROFILE_DATA();
+
+	void emitHotTest( RedStateAp *state );
 	void emitSingleSwitch( RedStateAp *state );
 	void emitRangeBSearch( RedStateAp *state, int level, int low, int high );
 
+	/* Choosing and writing the key lookup of each state. */
+	KeyDispatch chooseKeyDispatch( RedStateAp *state );
+	std::ostream &KEY_TABLES( int partition = -1 );
+	void emitKeySwitch( RedStateAp *state );
+	void emitKeyBits( RedStateAp *state );
+	void emitKeyIndex( RedStateAp *state );
+	void emitKeyDispatch( RedStateAp *state );
+
 	/* Called from STATE_GOTOS just before writing the gotos */
 	virtual void GOTO_HEADER( RedStateAp *state );
 	virtual void STATE_GOTO_ERROR();
 
+	/* Scanning runs of keys that loop back to the same state. */
+	std::ostream &SKIP_BITS( int partition = -1 );
+	void SELF_LOOP_SKIP( RedStateAp *state );
+	virtual string SKIP_EOF_LABEL( RedStateAp *state );
+
 	virtual void writeData();
 	virtual void writeExec();
 };
@@ -208,6 +208,12 @@ void IpGotoCodeGen::GOTO_HEADER( RedStateAp *state )
 		out << "	_ps = " << state->id << ";\n";
 }
 
+string IpGotoCodeGen::SKIP_EOF_LABEL( RedStateAp *state )
+{
+	state->outNeeded = true;
+	return "_test_eof" + itoa( state->id );
+}
+
 void IpGotoCodeGen::STATE_GOTO_ERROR()
 {
 	/* In the error state we need to emit some stuff that usually goes into
@@ -363,6 +369,8 @@ void IpGotoCodeGen::setLabelsNeeded()
 void IpGotoCodeGen::writeData()
 {
 	STATE_IDS();
+
+	PROFILE_DATA();
 }
 
 void IpGotoCodeGen::writeExec()
@@ -375,6 +383,9 @@ void IpGotoCodeGen::writeExec()
 
 	out << "	{\n";
 
+	SKIP_BITS();
+	KEY_TABLES();
+
 	if ( redFsm->anyRegCurStateRef() )
 		out << "	int _ps = 0;\n";
 
@@ -65,6 +65,7 @@ protected:
 	bool IN_TRANS_ACTIONS( RedStateAp *state );
 	void GOTO_HEADER( RedStateAp *state );
 	void STATE_GOTO_ERROR();
+	string SKIP_EOF_LABEL( RedStateAp *state );
 
 	/* Set up labelNeeded flag for each state. */
 	void setLabelsNeeded( GenInlineList *inlineList );
@@ -122,18 +122,18 @@ std::ostream &SplitCodeGen::STATE_GOTOS( int partition )
 				/* Writing code above state gotos. */
 				GOTO_HEADER( st, st->partition == partition );
 
+				SELF_LOOP_SKIP( st );
+
 				if ( st->stateCondVect.length() > 0 ) {
 					out << "	_widec = " << GET_KEY() << ";\n";
 					emitCondBSearch( st, 1, 0, st->stateCondVect.length() - 1 );
 				}
 
-				/* Try singles. */
-				if ( st->outSingle.length() > 0 )
-					emitSingleSwitch( st );
+				/* The transition most often taken in a profiling run. */
+				emitHotTest( st );
 
-				/* Default case is to binary search for the ranges, if that fails then */
-				if ( st->outRange.length() > 0 )
-					emitRangeBSearch( st, 1, 0, st->outRange.length() - 1 );
+				/* Look up the key. */
+				emitKeyDispatch( st );
 
 				/* Write the default transition. */
 				TRANS_GOTO( st->defTrans, 1 ) << "\n";
@@ -192,6 +192,12 @@ std::ostream &SplitCodeGen::PART_TRANS( int partition )
 	return out;
 }
 
+string SplitCodeGen::SKIP_EOF_LABEL( RedStateAp *state )
+{
+	state->outNeeded = true;
+	return "_out" + itoa( state->id );
+}
+
 std::ostream &SplitCodeGen::EXIT_STATES( int partition )
 {
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
@@ -217,6 +223,9 @@ std::ostream &SplitCodeGen::PARTITION( int partition )
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ )
 		st->partitionBoundary = false;
 
+	SKIP_BITS( partition );
+	KEY_TABLES( partition );
+
 	out << "	" << ALPH_TYPE() << " *p = *_pp, *pe = *_ppe;\n";
 
 	if ( redFsm->anyRegCurStateRef() )
@@ -291,12 +300,7 @@ std::ostream &SplitCodeGen::PART_MAP()
 	out << "\t";
 	int totalItem = 0;
 	for ( int i = 0; i < redFsm->stateList.length(); i++ ) {
-		out << partMap[i];
-		if ( i != redFsm->stateList.length() - 1 ) {
-			out << ", ";
-			if ( ++totalItem % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( partMap[i], totalItem, i == redFsm->stateList.length() - 1 );
 	}
 
 	delete[] partMap;
@@ -372,8 +376,9 @@ std::ostream &SplitCodeGen::ALL_PARTITIONS()
 			"}\n\n";
 		out.flush();
 
-		/* Fix the output stream. */
+		/* Fix the output stream. Deleting the filter writes out the file. */
 		out.rdbuf( prev_rdbuf );
+		delete partFilter;
 	}
 	return out;
 }
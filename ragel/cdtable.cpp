@@ -25,10 +25,25 @@
 #include "cdtable.h"
 #include "redfsm.h"
 #include "gendata.h"
+#include <sstream>
+
+using std::ostringstream;
+
+/* The comb vector is only made when the key span is small enough. */
+bool TabCodeGen::useComb()
+{
+	return combVector && redFsm->combCheck != 0;
+}
 
 /* Determine if we should use indicies or not. */
 void TabCodeGen::calcIndexSize()
 {
+	/* The comb vector holds transition ids. */
+	if ( useComb() ) {
+		useIndicies = false;
+		return;
+	}
+
 	int sizeWithInds = 0, sizeWithoutInds = 0;
 
 	/* Calculate cost of using with indicies. */
@@ -167,12 +182,7 @@ std::ostream &TabCodeGen::COND_OFFSETS()
 	int totalStateNum = 0, curKeyOffset = 0;
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
 		/* Write the key offset. */
-		out << curKeyOffset;
-		if ( !st.last() ) {
-			out << ", ";
-			if ( ++totalStateNum % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( curKeyOffset, totalStateNum, st.last() );
 
 		/* Move the key offset ahead. */
 		curKeyOffset += st->stateCondList.length();
@@ -187,12 +197,7 @@ std::ostream &TabCodeGen::KEY_OFFSETS()
 	int totalStateNum = 0, curKeyOffset = 0;
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
 		/* Write the key offset. */
-		out << curKeyOffset;
-		if ( !st.last() ) {
-			out << ", ";
-			if ( ++totalStateNum % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( curKeyOffset, totalStateNum, st.last() );
 
 		/* Move the key offset ahead. */
 		curKeyOffset += st->outSingle.length() + st->outRange.length()*2;
@@ -208,12 +213,7 @@ std::ostream &TabCodeGen::INDEX_OFFSETS()
 	int totalStateNum = 0, curIndOffset = 0;
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
 		/* Write the index offset. */
-		out << curIndOffset;
-		if ( !st.last() ) {
-			out << ", ";
-			if ( ++totalStateNum % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( curIndOffset, totalStateNum, st.last() );
 
 		/* Move the index offset ahead. */
 		curIndOffset += st->outSingle.length() + st->outRange.length();
@@ -230,12 +230,7 @@ std::ostream &TabCodeGen::COND_LENS()
 	int totalStateNum = 0;
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
 		/* Write singles length. */
-		out << st->stateCondList.length();
-		if ( !st.last() ) {
-			out << ", ";
-			if ( ++totalStateNum % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( st->stateCondList.length(), totalStateNum, st.last() );
 	}
 	out << "\n";
 	return out;
@@ -248,12 +243,7 @@ std::ostream &TabCodeGen::SINGLE_LENS()
 	int totalStateNum = 0;
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
 		/* Write singles length. */
-		out << st->outSingle.length();
-		if ( !st.last() ) {
-			out << ", ";
-			if ( ++totalStateNum % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( st->outSingle.length(), totalStateNum, st.last() );
 	}
 	out << "\n";
 	return out;
@@ -265,12 +255,7 @@ std::ostream &TabCodeGen::RANGE_LENS()
 	int totalStateNum = 0;
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
 		/* Emit length of range index. */
-		out << st->outRange.length();
-		if ( !st.last() ) {
-			out << ", ";
-			if ( ++totalStateNum % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( st->outRange.length(), totalStateNum, st.last() );
 	}
 	out << "\n";
 	return out;
@@ -338,13 +323,7 @@ std::ostream &TabCodeGen::EOF_TRANS()
 			assert( st->eofTrans->pos >= 0 );
 			trans = st->eofTrans->pos+1;
 		}
-		out << trans;
-
-		if ( !st.last() ) {
-			out << ", ";
-			if ( ++totalStateNum % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( trans, totalStateNum, st.last() );
 	}
 	out << "\n";
 	return out;
@@ -359,14 +338,10 @@ std::ostream &TabCodeGen::COND_KEYS()
 		/* Loop the state's transitions. */
 		for ( GenStateCondList::Iter sc = st->stateCondList; sc.lte(); sc++ ) {
 			/* Lower key. */
-			out << KEY( sc->lowKey ) << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_KEY( sc->lowKey, totalTrans, false );
 
 			/* Upper key. */
-			out << KEY( sc->highKey ) << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_KEY( sc->highKey, totalTrans, false );
 		}
 	}
 
@@ -384,9 +359,7 @@ std::ostream &TabCodeGen::COND_SPACES()
 		/* Loop the state's transitions. */
 		for ( GenStateCondList::Iter sc = st->stateCondList; sc.lte(); sc++ ) {
 			/* Cond Space id. */
-			out << sc->condSpace->condSpaceId << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_ITEM( sc->condSpace->condSpaceId, totalTrans, false );
 		}
 	}
 
@@ -403,22 +376,24 @@ std::ostream &TabCodeGen::KEYS()
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
 		/* Loop the singles. */
 		for ( RedTransList::Iter stel = st->outSingle; stel.lte(); stel++ ) {
-			out << KEY( stel->lowKey ) << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_KEY( stel->lowKey, totalTrans, false );
 		}
 
 		/* Loop the state's transitions. */
 		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
 			/* Lower key. */
-			out << KEY( rtel->lowKey ) << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_KEY( rtel->lowKey, totalTrans, false );
 
 			/* Upper key. */
-			out << KEY( rtel->highKey ) << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_KEY( rtel->highKey, totalTrans, false );
+		}
+	}
+
+	/* The SIMD lookup loads a full vector of singles, which may run past the
+	 * last state's keys. */
+	if ( useSimd() ) {
+		for ( int i = 0; i < 16; i++ ) {
+			ARRAY_ITEM( 0, totalTrans, false );
 		}
 	}
 
@@ -435,23 +410,17 @@ std::ostream &TabCodeGen::INDICIES()
 	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
 		/* Walk the singles. */
 		for ( RedTransList::Iter stel = st->outSingle; stel.lte(); stel++ ) {
-			out << stel->value->id << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_ITEM( stel->value->id, totalTrans, false );
 		}
 
 		/* Walk the ranges. */
 		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
-			out << rtel->value->id << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_ITEM( rtel->value->id, totalTrans, false );
 		}
 
 		/* The state's default index goes next. */
 		if ( st->defTrans != 0 ) {
-			out << st->defTrans->id << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_ITEM( st->defTrans->id, totalTrans, false );
 		}
 	}
 
@@ -469,25 +438,19 @@ std::ostream &TabCodeGen::TRANS_TARGS()
 		/* Walk the singles. */
 		for ( RedTransList::Iter stel = st->outSingle; stel.lte(); stel++ ) {
 			RedTransAp *trans = stel->value;
-			out << trans->targ->id << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_ITEM( trans->targ->id, totalTrans, false );
 		}
 
 		/* Walk the ranges. */
 		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
 			RedTransAp *trans = rtel->value;
-			out << trans->targ->id << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_ITEM( trans->targ->id, totalTrans, false );
 		}
 
 		/* The state's default target state. */
 		if ( st->defTrans != 0 ) {
 			RedTransAp *trans = st->defTrans;
-			out << trans->targ->id << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_ITEM( trans->targ->id, totalTrans, false );
 		}
 	}
 
@@ -496,9 +459,7 @@ std::ostream &TabCodeGen::TRANS_TARGS()
 		if ( st->eofTrans != 0 ) {
 			RedTransAp *trans = st->eofTrans;
 			trans->pos = totalTrans;
-			out << trans->targ->id << ", ";
-			if ( ++totalTrans % IALL == 0 )
-				out << "\n\t";
+			ARRAY_ITEM( trans->targ->id, totalTrans, false );
 		}
 	}
 
@@ -573,12 +534,7 @@ std::ostream &TabCodeGen::TRANS_TARGS_WI()
 		trans->pos = t;
 
 		/* Write out the target state. */
-		out << trans->targ->id;
-		if ( t < redFsm->transSet.length()-1 ) {
-			out << ", ";
-			if ( ++totalStates % IALL == 0 )
-				out << "\n\t";
-		}
+		ARRAY_ITEM( trans->targ->id, totalStates, t == redFsm->transSet.length()-1 );
 	}
 	out << "\n";
 	delete[] transPtrs;
@@ -611,6 +567,95 @@ std::ostream &TabCodeGen::TRANS_ACTIONS_WI()
 	return out;
 }
 
+std::ostream &TabCodeGen::COMB_BASES()
+{
+	out << "\t";
+	int totalStateNum = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		ARRAY_ITEM( st->combBase, totalStateNum, st.last() );
+	}
+	out << "\n";
+	return out;
+}
+
+std::ostream &TabCodeGen::COMB_CHECKS()
+{
+	out << "\t";
+	int totalSlots = 0;
+	for ( long slot = 0; slot < redFsm->combLength; slot++ ) {
+		/* Free slots get an id that no state has. */
+		RedStateAp *state = redFsm->combCheck[slot];
+		ARRAY_ITEM( state != 0 ? state->id : redFsm->maxState + 1, totalSlots, slot == redFsm->combLength-1 );
+	}
+	out << "\n";
+	return out;
+}
+
+std::ostream &TabCodeGen::COMB_NEXTS()
+{
+	out << "\t";
+	int totalSlots = 0;
+	for ( long slot = 0; slot < redFsm->combLength; slot++ ) {
+		RedTransAp *trans = redFsm->combNext[slot];
+		ARRAY_ITEM( trans != 0 ? trans->id : 0, totalSlots, slot == redFsm->combLength-1 );
+	}
+	out << "\n";
+	return out;
+}
+
+std::ostream &TabCodeGen::DEFAULT_TRANS()
+{
+	out << "\t";
+	int totalStateNum = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		/* Only the error state is without a default and it is never
+		 * looked up. */
+		ARRAY_ITEM( st->defTrans != 0 ? st->defTrans->id : 0, totalStateNum, st.last() );
+	}
+	out << "\n";
+	return out;
+}
+
+string TabCodeGen::COMB_OFFSET()
+{
+	ostringstream ret;
+	ret << GET_WIDE_KEY();
+	if ( redFsm->combLowKey.getVal() < 0 )
+		ret << " + " << -redFsm->combLowKey.getVal();
+	else if ( redFsm->combLowKey.getVal() > 0 )
+		ret << " - " << KEY( redFsm->combLowKey );
+	return ret.str();
+}
+
+void TabCodeGen::COMB_LOCATE_TRANS()
+{
+	/* Every row is as long as the key span, so keys in the span index
+	 * inside the vector from any base. */
+	bool bounded = redFsm->anyConditions() || 
+			keyOps->minKey < redFsm->combLowKey ||
+			redFsm->combHighKey < keyOps->maxKey;
+
+	out << "	_trans = " << DT() << "[" << vCS() << "];\n";
+
+	string indent = "	";
+	if ( bounded ) {
+		out << 
+			"	if ( " << KEY( redFsm->combLowKey ) << " <= " << GET_WIDE_KEY() << 
+					" && " << GET_WIDE_KEY() << " <= " << KEY( redFsm->combHighKey ) << " ) {\n";
+		indent += "\t";
+	}
+
+	out <<
+		indent << "_slot = " << CB() << "[" << vCS() << "] + (" << COMB_OFFSET() << ");\n" <<
+		indent << "if ( " << CCH() << "[_slot] == " << vCS() << " )\n" <<
+		indent << "	_trans = " << CN() << "[_slot];\n";
+
+	if ( bounded )
+		out << "	}\n";
+
+	out << "\n";
+}
+
 void TabCodeGen::LOCATE_TRANS()
 {
 	out <<
@@ -621,7 +666,25 @@ void TabCodeGen::LOCATE_TRANS()
 		"	if ( _klen > 0 ) {\n"
 		"		" << PTR_CONST() << WIDE_ALPH_TYPE() << PTR_CONST_END() << POINTER() << "_lower = _keys;\n"
 		"		" << PTR_CONST() << WIDE_ALPH_TYPE() << PTR_CONST_END() << POINTER() << "_mid;\n"
-		"		" << PTR_CONST() << WIDE_ALPH_TYPE() << PTR_CONST_END() << POINTER() << "_upper = _keys + _klen - 1;\n"
+		"		" << PTR_CONST() << WIDE_ALPH_TYPE() << PTR_CONST_END() << POINTER() << "_upper = _keys + _klen - 1;\n";
+
+	if ( useSimd() && !redFsm->anyConditions() ) {
+		/* Compare the key against up to 16 singles at once. */
+		out <<
+			"#if defined(__SSE2__) && defined(__GNUC__)\n"
+			"		if ( _klen <= 16 ) {\n"
+			"			int _mask = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_set1_epi8( " << GET_KEY() << " ),\n"
+			"					_mm_loadu_si128( (const __m128i*) _keys ) ) ) & ((1 << _klen) - 1);\n"
+			"			if ( _mask != 0 ) {\n"
+			"				_trans += " << CAST(UINT()) << "__builtin_ctz( _mask );\n"
+			"				goto _match;\n"
+			"			}\n"
+			"		}\n"
+			"		else\n"
+			"#endif\n";
+	}
+
+	out <<
 		"		while (1) {\n"
 		"			if ( _upper < _lower )\n"
 		"				break;\n"
@@ -750,6 +813,9 @@ void TabCodeGen::BREAK( ostream &ret, int targState, bool csForced )
 
 void TabCodeGen::writeData()
 {
+	if ( useSimd() )
+		writeSimdData();
+
 	/* If there are any transtion functions then output the array. If there
 	 * are none, don't bother emitting an empty array that won't be used. */
 	if ( redFsm->anyActions() ) {
@@ -781,34 +847,24 @@ void TabCodeGen::writeData()
 		"\n";
 	}
 
-	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxKeyOffset), KO() );
-	KEY_OFFSETS();
-	CLOSE_ARRAY() <<
-	"\n";
-
-	OPEN_ARRAY( WIDE_ALPH_TYPE(), K() );
-	KEYS();
-	CLOSE_ARRAY() <<
-	"\n";
-
-	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxSingleLen), SL() );
-	SINGLE_LENS();
-	CLOSE_ARRAY() <<
-	"\n";
-
-	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxRangeLen), RL() );
-	RANGE_LENS();
-	CLOSE_ARRAY() <<
-	"\n";
-
-	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxIndexOffset), IO() );
-	INDEX_OFFSETS();
-	CLOSE_ARRAY() <<
-	"\n";
-
-	if ( useIndicies ) {
-		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxIndex), I() );
-		INDICIES();
+	if ( useComb() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxCombBase), CB() );
+		COMB_BASES();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxState+1), CCH() );
+		COMB_CHECKS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxIndex), CN() );
+		COMB_NEXTS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxIndex), DT() );
+		DEFAULT_TRANS();
 		CLOSE_ARRAY() <<
 		"\n";
 
@@ -825,16 +881,61 @@ void TabCodeGen::writeData()
 		}
 	}
 	else {
-		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxState), TT() );
-		TRANS_TARGS();
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxKeyOffset), KO() );
+		KEY_OFFSETS();
 		CLOSE_ARRAY() <<
 		"\n";
 
-		if ( redFsm->anyActions() ) {
-			OPEN_ARRAY( ARRAY_TYPE(redFsm->maxActionLoc), TA() );
-			TRANS_ACTIONS();
+		OPEN_ARRAY( WIDE_ALPH_TYPE(), K() );
+		KEYS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxSingleLen), SL() );
+		SINGLE_LENS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxRangeLen), RL() );
+		RANGE_LENS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxIndexOffset), IO() );
+		INDEX_OFFSETS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		if ( useIndicies ) {
+			OPEN_ARRAY( ARRAY_TYPE(redFsm->maxIndex), I() );
+			INDICIES();
+			CLOSE_ARRAY() <<
+			"\n";
+
+			OPEN_ARRAY( ARRAY_TYPE(redFsm->maxState), TT() );
+			TRANS_TARGS_WI();
 			CLOSE_ARRAY() <<
 			"\n";
+
+			if ( redFsm->anyActions() ) {
+				OPEN_ARRAY( ARRAY_TYPE(redFsm->maxActionLoc), TA() );
+				TRANS_ACTIONS_WI();
+				CLOSE_ARRAY() <<
+				"\n";
+			}
+		}
+		else {
+			OPEN_ARRAY( ARRAY_TYPE(redFsm->maxState), TT() );
+			TRANS_TARGS();
+			CLOSE_ARRAY() <<
+			"\n";
+
+			if ( redFsm->anyActions() ) {
+				OPEN_ARRAY( ARRAY_TYPE(redFsm->maxActionLoc), TA() );
+				TRANS_ACTIONS();
+				CLOSE_ARRAY() <<
+				"\n";
+			}
 		}
 	}
 
@@ -927,9 +1028,15 @@ void TabCodeGen::writeExec()
 	testEofUsed = false;
 	outLabelUsed = false;
 
+	/* The comb vector only needs the keys for translating conditions. */
+	bool keysUsed = !useComb() || redFsm->anyConditions();
+
 	out <<
 		"	{\n"
-		"	int _klen";
+		"	int " << ( useComb() ? "_slot" : "_klen" );
+
+	if ( useComb() && keysUsed )
+		out << ", _klen";
 
 	if ( redFsm->anyRegCurStateRef() )
 		out << ", _ps";
@@ -950,9 +1057,12 @@ void TabCodeGen::writeExec()
 			"	" << UINT() << " _nacts;\n";
 	}
 
-	out <<
-		"	" << PTR_CONST() << WIDE_ALPH_TYPE() << PTR_CONST_END() << POINTER() << "_keys;\n"
-		"\n";
+	if ( keysUsed ) {
+		out <<
+			"	" << PTR_CONST() << WIDE_ALPH_TYPE() << PTR_CONST_END() << POINTER() << "_keys;\n";
+	}
+
+	out << "\n";
 
 	if ( !noEnd ) {
 		testEofUsed = true;
@@ -970,6 +1080,9 @@ void TabCodeGen::writeExec()
 
 	out << "_resume:\n";
 
+	if ( useSimd() )
+		SIMD_SKIP();
+
 	if ( redFsm->anyFromStateActions() ) {
 		out <<
 			"	_acts = " << ARR_OFF( A(),  FSA() + "[" + vCS() + "]" ) << ";\n"
@@ -986,9 +1099,12 @@ void TabCodeGen::writeExec()
 	if ( redFsm->anyConditions() )
 		COND_TRANSLATE();
 
-	LOCATE_TRANS();
-
-	out << "_match:\n";
+	if ( useComb() )
+		COMB_LOCATE_TRANS();
+	else {
+		LOCATE_TRANS();
+		out << "_match:\n";
+	}
 
 	if ( useIndicies )
 		out << "	_trans = " << I() << "[_trans];\n";
@@ -39,11 +39,14 @@ struct RedStateAp;
 class TabCodeGen : virtual public FsmCodeGen
 {
 public:
-	TabCodeGen( ostream &out ) : FsmCodeGen(out) {}
+	TabCodeGen( ostream &out ) : FsmCodeGen(out), combVector(false) {}
 	virtual ~TabCodeGen() { }
 	virtual void writeData();
 	virtual void writeExec();
 
+	/* Pack the transitions into a comb vector. */
+	bool combVector;
+
 protected:
 	std::ostream &TO_STATE_ACTION_SWITCH();
 	std::ostream &FROM_STATE_ACTION_SWITCH();
@@ -70,6 +73,14 @@ protected:
 	std::ostream &TRANS_ACTIONS_WI();
 	void LOCATE_TRANS();
 
+	bool useComb();
+	std::ostream &COMB_BASES();
+	std::ostream &COMB_CHECKS();
+	std::ostream &COMB_NEXTS();
+	std::ostream &DEFAULT_TRANS();
+	string COMB_OFFSET();
+	void COMB_LOCATE_TRANS();
+
 	void COND_TRANSLATE();
 
 	void GOTO( ostream &ret, int gotoDest, bool inFinish );
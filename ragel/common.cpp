@@ -24,6 +24,10 @@
 #include "stdlib.h"
 #include <string.h>
 #include <assert.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 
 HostType hostTypesC[] =
 {
@@ -315,21 +319,151 @@ bool ParamCheck::check()
 	return true;
 }
 
-/* Counts newlines before sending sync. */
+/* Size of the buffer generated code is collected in. */
+#define OUTPUT_BUFFER_SIZE ( 256 * 1024 )
+
+static long countLines( const char *s, long n )
+{
+	long lines = 0;
+	const char *end = s + n;
+	while ( ( s = (const char*)memchr( s, '\n', end - s ) ) != 0 ) {
+		lines += 1;
+		s += 1;
+	}
+	return lines;
+}
+
+output_filter::output_filter( const char *fileName )
+:
+	fileName(fileName),
+	line(1),
+	fd(-1),
+	buffer(0)
+{
+}
+
+output_filter::~output_filter()
+{
+	close();
+	delete[] buffer;
+}
+
+output_filter *output_filter::open( const char *fileName, std::ios_base::openmode mode )
+{
+	if ( fd >= 0 )
+		return 0;
+
+	int flags = O_WRONLY | O_CREAT | ( mode & std::ios::app ? O_APPEND : O_TRUNC );
+	fd = ::open( fileName, flags, 0666 );
+	if ( fd < 0 )
+		return 0;
+
+	if ( buffer == 0 )
+		buffer = new char[OUTPUT_BUFFER_SIZE];
+	setp( buffer, buffer + OUTPUT_BUFFER_SIZE );
+	return this;
+}
+
+output_filter *output_filter::close()
+{
+	if ( fd < 0 )
+		return 0;
+
+	bool written = writeBuffer();
+	bool closed = ::close( fd ) == 0;
+	fd = -1;
+	setp( 0, 0 );
+	return written && closed ? this : 0;
+}
+
+bool output_filter::writeData( const char *data, long len )
+{
+	while ( len > 0 ) {
+		long w = ::write( fd, data, len );
+		if ( w < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			return false;
+		}
+		data += w;
+		len -= w;
+	}
+	return true;
+}
+
+/* Empties the buffer into the file. */
+bool output_filter::writeBuffer()
+{
+	bool written = writeData( pbase(), pptr() - pbase() );
+	setp( buffer, buffer + OUTPUT_BUFFER_SIZE );
+	return written;
+}
+
+/* A sync comes with an endl, it counts the newline that was put. Nothing is
+ * written, the data goes out when the buffer fills or the file is closed. */
 int output_filter::sync( )
 {
 	line += 1;
-	return std::filebuf::sync();
+	return 0;
 }
 
 /* Counts newlines before sending data out to file. */
 std::streamsize output_filter::xsputn( const char *s, std::streamsize n )
 {
-	for ( int i = 0; i < n; i++ ) {
-		if ( s[i] == '\n' )
-			line += 1;
+	line += countLines( s, n );
+
+	if ( n <= epptr() - pptr() ) {
+		memcpy( pptr(), s, n );
+		pbump( n );
+		return n;
+	}
+
+	if ( fd < 0 || !writeBuffer() )
+		return 0;
+
+	/* Too big to be worth copying. */
+	if ( n >= OUTPUT_BUFFER_SIZE )
+		return writeData( s, n ) ? n : 0;
+
+	memcpy( pptr(), s, n );
+	pbump( n );
+	return n;
+}
+
+/* Single characters are put into the buffer without being counted. This is
+ * called when there is no room for one. */
+int output_filter::overflow( int c )
+{
+	if ( fd < 0 || !writeBuffer() )
+		return EOF;
+
+	if ( c != EOF ) {
+		*pptr() = c;
+		pbump( 1 );
 	}
-	return std::filebuf::xsputn( s, n );
+	return c == EOF ? 0 : c;
+}
+
+int cache_filter::sync()
+{
+	line += 1;
+	return 0;
+}
+
+std::streamsize cache_filter::xsputn( const char *s, std::streamsize n )
+{
+	line += countLines( s, n );
+	data.append( s, n );
+	return n;
+}
+
+/* Single characters are counted at the sync, as they are for a buffered
+ * output_filter. */
+int cache_filter::overflow( int c )
+{
+	if ( c != EOF )
+		data += (char)c;
+	return c;
 }
 
 /* Scans a string looking for the file extension. If there is a file
@@ -385,6 +519,52 @@ const char *fileNameFromStem( const char *stemFile, const char *suffix )
 	return retVal;
 }
 
+double wallClock()
+{
+	struct timeval tv;
+	gettimeofday( &tv, 0 );
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+unsigned long long fnvHash( unsigned long long h, const void *data, long len )
+{
+	const unsigned char *p = (const unsigned char*)data;
+	for ( long i = 0; i < len; i++ ) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/* Hashes the string and its terminator, so consecutive strings are kept
+ * apart. */
+unsigned long long fnvHash( unsigned long long h, const char *str )
+{
+	if ( str == 0 )
+		str = "";
+	return fnvHash( h, str, strlen( str ) + 1 );
+}
+
+char *formatUInt( char *end, unsigned long long value )
+{
+	do {
+		*--end = '0' + value % 10;
+		value /= 10;
+	}
+	while ( value != 0 );
+	return end;
+}
+
+char *formatInt( char *end, long long value )
+{
+	/* Negate unsigned so the most negative value comes out right. */
+	if ( value >= 0 )
+		return formatUInt( end, value );
+	char *start = formatUInt( end, -(unsigned long long)value );
+	*--start = '-';
+	return start;
+}
+
 exit_object endp;
 
 void operator<<( std::ostream &out, exit_object & )
@@ -23,9 +23,18 @@
 #define _COMMON_H
 
 #include <fstream>
+#include <string>
 #include <climits>
 #include "dlist.h"
 
+/* Globals that belong to the section being processed are kept per thread, so
+ * that machines of separate sections can be built in parallel. */
+#if defined(__GNUC__)
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
+
 /* Location in an input file. */
 struct InputLoc
 {
@@ -219,7 +228,7 @@ struct KeyOps
 	}
 };
 
-extern KeyOps *keyOps;
+extern THREAD_LOCAL KeyOps *keyOps;
 
 inline bool operator<( const Key key1, const Key key2 )
 {
@@ -305,17 +314,48 @@ inline Key operator/(const Key key1, const Key key2)
 }
 
 /* Filter on the output stream that keeps track of the number of lines
- * output. */
-class output_filter : public std::filebuf
+ * output. Output is collected in a large buffer and written with write(2)
+ * when the buffer fills and when the file is closed. */
+class output_filter : public std::streambuf
 {
 public:
-	output_filter( const char *fileName ) : fileName(fileName), line(1) { }
+	output_filter( const char *fileName );
+	virtual ~output_filter();
+
+	output_filter *open( const char *fileName, std::ios_base::openmode mode );
+	bool is_open() { return fd >= 0; }
+	output_filter *close();
 
 	virtual int sync();
 	virtual std::streamsize xsputn(const char* s, std::streamsize n);
+	virtual int overflow( int c );
 
 	const char *fileName;
 	int line;
+
+private:
+	bool writeBuffer();
+	bool writeData( const char *data, long len );
+
+	int fd;
+	char *buffer;
+};
+
+/* Collects output in memory for the output cache, counting lines the same
+ * way, starting from zero. Line directives that point back into the output
+ * carry the file name this is made with and a line relative to the start, so
+ * they can be found and redone when the text is copied into the real
+ * output. */
+class cache_filter : public output_filter
+{
+public:
+	cache_filter( const char *fileName ) : output_filter( fileName ) { line = 0; }
+
+	virtual int sync();
+	virtual std::streamsize xsputn(const char* s, std::streamsize n);
+	virtual int overflow( int c );
+
+	std::string data;
 };
 
 class cfilebuf : public std::streambuf
@@ -364,6 +404,21 @@ public:
 const char *findFileExtension( const char *stemFile );
 const char *fileNameFromStem( const char *stemFile, const char *suffix );
 
+/* Wall clock time in seconds, for the statistics. */
+double wallClock();
+
+/* FNV-1a hashing of a run of bytes into h, for the output cache. Start from
+ * FNV_OFFSET. */
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+unsigned long long fnvHash( unsigned long long h, const void *data, long len );
+unsigned long long fnvHash( unsigned long long h, const char *str );
+
+/* Decimal text of a number, written backwards so that it ends at end. Returns
+ * the first character. Large tables of numbers are written with these rather
+ * than operator<<, which spends most of its time on the locale. */
+char *formatInt( char *end, long long value );
+char *formatUInt( char *end, unsigned long long value );
+
 struct Export
 {
 	Export( const char *name, Key key )
@@ -364,8 +364,9 @@ std::ostream &CSharpSplitCodeGen::ALL_PARTITIONS()
 			"}\n\n";
 		out.flush();
 
-		/* Fix the output stream. */
+		/* Fix the output stream. Deleting the filter writes out the file. */
 		out.rdbuf( prev_rdbuf );
+		delete partFilter;
 	}
 	return out;
 }
@@ -24,8 +24,8 @@
 using std::cerr;
 using std::endl;
 
-CondData *condData = 0;
-KeyOps *keyOps = 0;
+THREAD_LOCAL CondData *condData = 0;
+THREAD_LOCAL KeyOps *keyOps = 0;
 
 /* Insert an action into an action table. */
 void ActionTable::setAction( int ordering, Action *action )
@@ -41,6 +41,132 @@ void MergeData::fillListAppend( StateAp *state )
 	}
 }
 
+THREAD_LOCAL FsmStats *fsmStats = 0;
+
+FsmStats::FsmStats()
+:
+	minimizeRounds(0),
+	peakStates(0),
+	peakTrans(0)
+{
+	memset( ops, 0, sizeof(ops) );
+}
+
+const char *FsmStats::opName( int op )
+{
+	switch ( op ) {
+		case FsmStatUnion: return "union";
+		case FsmStatConcat: return "concat";
+		case FsmStatStar: return "star";
+		case FsmStatIntersect: return "intersect";
+		case FsmStatSubtract: return "subtract";
+		case FsmStatJoin: return "join";
+		case FsmStatMinimize: return "minimize";
+	}
+	return "";
+}
+
+FsmStatTimer::FsmStatTimer( FsmAp *fsm, FsmStatOp op )
+:
+	fsm(fsm),
+	op(op),
+	start(fsmStats != 0 ? wallClock() : 0)
+{
+}
+
+FsmStatTimer::~FsmStatTimer()
+{
+	if ( fsmStats == 0 )
+		return;
+
+	long numTrans = 0;
+	for ( StateList::Iter st = fsm->stateList; st.lte(); st++ )
+		numTrans += st->outList.length();
+	long numStates = fsm->stateList.length();
+
+	FsmOpStats &stats = fsmStats->ops[op];
+	stats.count += 1;
+	stats.seconds += wallClock() - start;
+	if ( numStates > stats.peakStates )
+		stats.peakStates = numStates;
+	if ( numTrans > stats.peakTrans )
+		stats.peakTrans = numTrans;
+
+	if ( numStates > fsmStats->peakStates )
+		fsmStats->peakStates = numStates;
+	if ( numTrans > fsmStats->peakTrans )
+		fsmStats->peakTrans = numTrans;
+}
+
+THREAD_LOCAL long StateDict::hits = 0;
+THREAD_LOCAL long StateDict::collisions = 0;
+
+/* Mix the addresses of the states in the set. The hash only decides where
+ * sets go in the table, so it has no effect on the generated machine. */
+unsigned long long StateDict::hashSet( const StateSet &stateSet )
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for ( StateSet::Iter st = stateSet; st.lte(); st++ ) {
+		hash ^= (unsigned long long)(size_t)*st;
+		hash *= 1099511628211ULL;
+		hash ^= hash >> 29;
+	}
+	return hash;
+}
+
+/* Double the table, or make the first one, and reinsert the elements. */
+void StateDict::grow()
+{
+	long oldSize = tableSize;
+	StateDictEl **oldTable = table;
+
+	tableSize = oldSize == 0 ? 64 : oldSize * 2;
+	table = new StateDictEl*[tableSize];
+	memset( table, 0, sizeof(StateDictEl*) * tableSize );
+
+	for ( long i = 0; i < oldSize; i++ ) {
+		if ( oldTable[i] != 0 ) {
+			long pos = oldTable[i]->hash & ( tableSize - 1 );
+			while ( table[pos] != 0 )
+				pos = ( pos + 1 ) & ( tableSize - 1 );
+			table[pos] = oldTable[i];
+		}
+	}
+
+	delete[] oldTable;
+}
+
+bool StateDict::insert( const StateSet &stateSet, StateDictEl **lastFound )
+{
+	/* Keep the table at most half full. */
+	if ( ( numEls + 1 ) * 2 > tableSize )
+		grow();
+
+	unsigned long long hash = hashSet( stateSet );
+	long pos = hash & ( tableSize - 1 );
+	while ( table[pos] != 0 ) {
+		StateDictEl *el = table[pos];
+		if ( el->hash == hash && CmpTable<StateAp*>::compare( 
+				el->stateSet, stateSet ) == 0 )
+		{
+			hits += 1;
+			*lastFound = el;
+			return false;
+		}
+
+		collisions += 1;
+		pos = ( pos + 1 ) & ( tableSize - 1 );
+	}
+
+	StateDictEl *el = new StateDictEl( stateSet );
+	el->hash = hash;
+	table[pos] = el;
+	numEls += 1;
+
+	*lastFound = el;
+	return true;
+}
+
 /* Graph constructor. */
 FsmAp::FsmAp()
 :
@@ -74,6 +200,13 @@ FsmAp::FsmAp( const FsmAp &graph )
 	/* Misfit accounting is only on during merging. */
 	misfitAccounting(false)
 {
+	/* Get all the states and transitions from as few chunks as possible. */
+	long numTrans = 0;
+	for ( StateList::Iter st = graph.stateList; st.lte(); st++ )
+		numTrans += st->outList.length();
+	SlabAlloc<StateAp>::reserve( graph.stateList.length() );
+	SlabAlloc<TransAp>::reserve( numTrans );
+
 	/* Create the states and record their map in the original state. */
 	StateList::Iter origState = graph.stateList;
 	for ( ; origState.lte(); origState++ ) {
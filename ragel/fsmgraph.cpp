@@ -113,6 +113,154 @@ void FsmAp::concatFsm( Key chr )
 	attachNewTrans( startState, end, chr, chr );
 }
 
+/* Orders strings of keys for building a literal union. */
+struct CmpKeyString
+{
+	static int compare( const Vector<Key> *s1, const Vector<Key> *s2 )
+	{
+		long len = s1->length() < s2->length() ? s1->length() : s2->length();
+		for ( long i = 0; i < len; i++ ) {
+			if ( s1->data[i] < s2->data[i] )
+				return -1;
+			else if ( s2->data[i] < s1->data[i] )
+				return 1;
+		}
+		if ( s1->length() < s2->length() )
+			return -1;
+		else if ( s1->length() > s2->length() )
+			return 1;
+		return 0;
+	}
+};
+
+/* Transition of a literal union state. Targets are always finished. */
+struct LitUnionTrans
+{
+	Key key;
+	StateAp *toState;
+};
+
+/* A state of a literal union that is still taking transitions. */
+struct LitUnionState
+{
+	LitUnionState() : final(false) {}
+
+	bool final;
+	Vector<LitUnionTrans> outList;
+};
+
+struct CmpLitUnionState
+{
+	static int compare( const LitUnionState &s1, const LitUnionState &s2 )
+	{
+		if ( s1.final != s2.final )
+			return s1.final ? 1 : -1;
+		if ( s1.outList.length() != s2.outList.length() )
+			return s1.outList.length() < s2.outList.length() ? -1 : 1;
+		for ( long i = 0; i < s1.outList.length(); i++ ) {
+			const LitUnionTrans &t1 = s1.outList.data[i];
+			const LitUnionTrans &t2 = s2.outList.data[i];
+			if ( t1.key < t2.key )
+				return -1;
+			else if ( t2.key < t1.key )
+				return 1;
+			else if ( t1.toState < t2.toState )
+				return -1;
+			else if ( t1.toState > t2.toState )
+				return 1;
+		}
+		return 0;
+	}
+};
+
+typedef AvlMap<LitUnionState, StateAp*, CmpLitUnionState> LitUnionDict;
+typedef AvlMapEl<LitUnionState, StateAp*> LitUnionDictEl;
+
+/* Make the state for a literal union state whose transitions are all known.
+ * A state with the same finality and transitions as one already made is the
+ * same state. */
+static StateAp *finishLitUnionState( FsmAp *fsm, LitUnionDict &dict,
+		const LitUnionState &litState )
+{
+	LitUnionDictEl *dictEl = dict.find( litState );
+	if ( dictEl != 0 )
+		return dictEl->value;
+
+	StateAp *state = fsm->addState();
+	for ( long i = 0; i < litState.outList.length(); i++ ) {
+		const LitUnionTrans &trans = litState.outList.data[i];
+		fsm->attachNewTrans( state, trans.toState, trans.key, trans.key );
+	}
+	if ( litState.final )
+		fsm->setFinState( state );
+
+	dict.insert( litState, state );
+	return state;
+}
+
+/* Construct an FSM that accepts any of a set of strings. The strings are
+ * added in sorted order to a trie. Only the path of the last string added
+ * can still change. Everything left behind that path is merged with any
+ * equal state, so the machine is minimal as it is made and never
+ * holds more than the minimal states plus one path. */
+void FsmAp::literalUnionFsm( Vector<Key> *strings, long numStrings )
+{
+	Vector<Key> **sorted = new Vector<Key>*[numStrings];
+	for ( long s = 0; s < numStrings; s++ )
+		sorted[s] = &strings[s];
+
+	MergeSort<Vector<Key>*, CmpKeyString> mergeSort;
+	mergeSort.sort( sorted, numStrings );
+
+	LitUnionDict dict;
+	Vector<LitUnionState> path;
+	path.append( LitUnionState() );
+
+	Vector<Key> *last = 0;
+	for ( long s = 0; s <= numStrings; s++ ) {
+		Vector<Key> *str = s < numStrings ? sorted[s] : 0;
+
+		/* The length of the prefix shared with the last string. At the end
+		 * nothing is shared and the whole path is finished. */
+		long common = 0;
+		if ( last != 0 && str != 0 ) {
+			while ( common < last->length() && common < str->length() &&
+					last->data[common] == str->data[common] )
+				common += 1;
+		}
+
+		/* Finish the states of the last string past the shared prefix. */
+		for ( long depth = path.length() - 1; depth > common; depth-- ) {
+			StateAp *state = finishLitUnionState( this, dict, path[depth] );
+			LitUnionTrans trans = { last->data[depth-1], state };
+			path[depth-1].outList.append( trans );
+			path.remove( depth );
+		}
+
+		if ( str != 0 ) {
+			/* Repeats add nothing. */
+			if ( last == 0 || common < last->length() || common < str->length() ) {
+				for ( long i = common; i < str->length(); i++ )
+					path.append( LitUnionState() );
+				path[str->length()].final = true;
+			}
+			last = str;
+		}
+	}
+
+	/* No other state can be the same as the start state. */
+	StateAp *startState = addState();
+	for ( long i = 0; i < path[0].outList.length(); i++ ) {
+		LitUnionTrans &trans = path[0].outList[i];
+		attachNewTrans( startState, trans.toState, trans.key, trans.key );
+	}
+	if ( path[0].final )
+		setFinState( startState );
+	setStartState( startState );
+
+	delete[] sorted;
+}
+
 /* Construct a machine that matches any character in set.  A new machine will
  * be made that has two states and len transitions between the them. The set
  * should be ordered correctly accroding to KeyOps and should not contain
@@ -202,6 +350,8 @@ void FsmAp::transferOutData( StateAp *destState, StateAp *srcState )
  * callback invoked. */
 void FsmAp::starOp( )
 {
+	FsmStatTimer statTimer( this, FsmStatStar );
+
 	/* For the merging process. */
 	MergeData md;
 
@@ -256,14 +406,52 @@ void FsmAp::repeatOp( int times )
 	/* Make a machine to make copies from. */
 	FsmAp *copyFrom = new FsmAp( *this );
 
-	/* Concatentate duplicates onto the end up until before the last. */
-	for ( int i = 1; i < times-1; i++ ) {
-		FsmAp *dup = new FsmAp( *copyFrom );
-		doConcat( dup, 0, false );
+	doubleRepeat( copyFrom, times, false );
+	delete copyFrom;
+}
+
+/* Raise this machine, which must currently equal copyFrom, to the power of
+ * times. Works down from the high bit of times, squaring the machine at each
+ * step and tacking on another copy when the bit is set. This needs only
+ * O(log times) concatenations instead of times of them. */
+void FsmAp::doubleRepeat( FsmAp *copyFrom, int times, bool optional )
+{
+	int bit = 1;
+	while ( bit <= times / 2 )
+		bit *= 2;
+
+	for ( bit /= 2; bit > 0; bit /= 2 ) {
+		repeatStep( new FsmAp( *this ), optional );
+		if ( times & bit )
+			repeatStep( new FsmAp( *copyFrom ), optional );
 	}
+}
 
-	/* Now use the copyFrom on the end. */
-	doConcat( copyFrom, 0, false );
+/* One concatenation of doubleRepeat. */
+void FsmAp::repeatStep( FsmAp *other, bool optional )
+{
+	if ( !optional ) {
+		/* Minimizing here keeps the machine that gets duplicated in the next
+		 * step small. */
+		doConcat( other, 0, false );
+		afterRepeatMinimize( this );
+	}
+	else {
+		/* The copies attach only to the final states that came from the last
+		 * copy. These carry STB_GRAPH2, and so do the corresponding states of
+		 * other, since it was copied with the bits set. Minimization does not
+		 * respect the bits so it is left until the end. */
+		StateSet lastFinSet;
+		for ( int i = 0; i < finStateSet.length(); i++ ) {
+			StateAp *fs = finStateSet[i];
+			if ( fs->stateBits & STB_GRAPH2 ) {
+				lastFinSet.insert( fs );
+				fs->stateBits &= ~STB_GRAPH2;
+			}
+		}
+
+		doConcat( other, &lastFinSet, true );
+	}
 }
 
 void FsmAp::optionalRepeatOp( int times )
@@ -277,6 +465,24 @@ void FsmAp::optionalRepeatOp( int times )
 		return;
 	}
 
+	/* If nothing leads back into the start state then it can be made final
+	 * after the copies are joined without changing any of the states they
+	 * produce. In that case the copies can be joined by doubling. */
+	if ( isStartStateIsolated() && !startState->isFinState() ) {
+		setFinBits( STB_GRAPH2 );
+
+		FsmAp *copyFrom = new FsmAp( *this );
+		doubleRepeat( copyFrom, times, true );
+		delete copyFrom;
+
+		for ( int i = 0; i < finStateSet.length(); i++ )
+			finStateSet[i]->stateBits &= ~STB_GRAPH2;
+
+		/* Set the initial state to zero to allow zero copies. */
+		setFinState( startState );
+		return;
+	}
+
 	/* Make a machine to make copies from. */
 	FsmAp *copyFrom = new FsmAp( *this );
 
@@ -386,6 +592,8 @@ void FsmAp::doConcat( FsmAp *other, StateSet *fromStates, bool optional )
  * invoked. */
 void FsmAp::concatOp( FsmAp *other )
 {
+	FsmStatTimer statTimer( this, FsmStatConcat );
+
 	/* Assert same signedness and return graph concatenation op. */
 	doConcat( other, 0, false );
 }
@@ -435,6 +643,8 @@ void FsmAp::doOr( FsmAp *other )
 /* Unions other with this machine. Other is deleted. */
 void FsmAp::unionOp( FsmAp *other )
 {
+	FsmStatTimer statTimer( this, FsmStatUnion );
+
 	/* Turn on misfit accounting for both graphs. */
 	setMisfitAccounting( true );
 	other->setMisfitAccounting( true );
@@ -450,6 +660,8 @@ void FsmAp::unionOp( FsmAp *other )
 /* Intersects other with this machine. Other is deleted. */
 void FsmAp::intersectOp( FsmAp *other )
 {
+	FsmStatTimer statTimer( this, FsmStatIntersect );
+
 	/* Turn on misfit accounting for both graphs. */
 	setMisfitAccounting( true );
 	other->setMisfitAccounting( true );
@@ -476,6 +688,8 @@ void FsmAp::intersectOp( FsmAp *other )
 /* Set subtracts other machine from this machine. Other is deleted. */
 void FsmAp::subtractOp( FsmAp *other )
 {
+	FsmStatTimer statTimer( this, FsmStatSubtract );
+
 	/* Turn on misfit accounting for both graphs. */
 	setMisfitAccounting( true );
 	other->setMisfitAccounting( true );
@@ -635,6 +849,8 @@ void FsmAp::epsilonOp()
  * final id. */
 void FsmAp::joinOp( int startId, int finalId, FsmAp **others, int numOthers )
 {
+	FsmStatTimer statTimer( this, FsmStatJoin );
+
 	/* For the merging process. */
 	MergeData md;
 
@@ -881,7 +1097,7 @@ void FsmAp::isolateStartState( )
 
 	/* Stfil and stateDict will be empty because the merging of the old start
 	 * state into the new one will not have any conflicting transitions. */
-	assert( md.stateDict.treeSize == 0 );
+	assert( md.stateDict.length() == 0 );
 	assert( md.stfillHead == 0 );
 
 	/* The old start state may be unreachable. Remove the misfits and turn off
@@ -1087,49 +1303,324 @@ void FsmAp::doExpand( MergeData &md, StateAp *destState, ExpansionList &expList1
 void FsmAp::doRemove( MergeData &md, StateAp *destState, ExpansionList &expList1 )
 {
 	for ( ExpansionList::Iter exp = expList1; exp.lte(); exp++ ) {
-		Removal removal;
-		if ( exp->fromCondSpace == 0 ) {
-			removal.lowKey = exp->lowKey;
-			removal.highKey = exp->highKey;
-		}
+		if ( exp->fromCondSpace == 0 )
+			removeTransRange( destState, exp->lowKey, exp->highKey );
 		else {
-			removal.lowKey = exp->fromCondSpace->baseKey + 
-				exp->fromVals * keyOps->alphSize() + (exp->lowKey - keyOps->minKey);
-			removal.highKey = exp->fromCondSpace->baseKey + 
-				exp->fromVals * keyOps->alphSize() + (exp->highKey - keyOps->minKey);
+			removeTransRange( destState, 
+				exp->fromCondSpace->baseKey + exp->fromVals * keyOps->alphSize() +
+						(exp->lowKey - keyOps->minKey),
+				exp->fromCondSpace->baseKey + exp->fromVals * keyOps->alphSize() +
+						(exp->highKey - keyOps->minKey) );
 		}
-		removal.next = 0;
+	}
+}
 
-		TransList destList;
-		PairIter<TransAp, Removal> pairIter( destState->outList.head, &removal );
-		for ( ; !pairIter.end(); pairIter++ ) {
-			switch ( pairIter.userState ) {
-			case RangeInS1: {
-				TransAp *destTrans = pairIter.s1Tel.trans;
-				destTrans->lowKey = pairIter.s1Tel.lowKey;
-				destTrans->highKey = pairIter.s1Tel.highKey;
-				destList.append( destTrans );
-				break;
+/* Remove the out transitions of a state on a key range. Transitions that
+ * reach over the ends of the range are split. */
+void FsmAp::removeTransRange( StateAp *state, Key lowKey, Key highKey )
+{
+	Removal removal;
+	removal.lowKey = lowKey;
+	removal.highKey = highKey;
+	removal.next = 0;
+
+	TransList destList;
+	PairIter<TransAp, Removal> pairIter( state->outList.head, &removal );
+	for ( ; !pairIter.end(); pairIter++ ) {
+		switch ( pairIter.userState ) {
+		case RangeInS1: {
+			TransAp *destTrans = pairIter.s1Tel.trans;
+			destTrans->lowKey = pairIter.s1Tel.lowKey;
+			destTrans->highKey = pairIter.s1Tel.highKey;
+			destList.append( destTrans );
+			break;
+		}
+		case RangeInS2:
+			break;
+		case RangeOverlap: {
+			TransAp *trans = pairIter.s1Tel.trans;
+			detachTrans( trans->fromState, trans->toState, trans );
+			delete trans;
+			break;
+		}
+		case BreakS1: {
+			pairIter.s1Tel.trans = dupTrans( state, 
+					pairIter.s1Tel.trans );
+			break;
+		}
+		case BreakS2:
+			break;
+		}
+	}
+	state->outList.transfer( destList );
+}
+
+/* Compare two transitions for the condition reduction. Either pointer may be
+ * null. Unlike compareFullPtr, the data of transitions that have no target
+ * is compared too, since they can still take part in later operations. */
+static int compareCondTrans( TransAp *trans1, TransAp *trans2 )
+{
+	if ( (trans1 != 0) ^ (trans2 != 0) )
+		return trans1 != 0 ? -1 : 1;
+	else if ( trans1 != 0 ) {
+		if ( trans1->toState < trans2->toState )
+			return -1;
+		else if ( trans1->toState > trans2->toState )
+			return 1;
+		return FsmAp::compareTransData( trans1, trans2 );
+	}
+	return 0;
+}
+
+struct CmpTransLowKey
+{
+	static int compare( TransAp *trans1, TransAp *trans2 )
+	{
+		if ( trans1->lowKey < trans2->lowKey )
+			return -1;
+		else if ( trans1->lowKey > trans2->lowKey )
+			return 1;
+		return 0;
+	}
+};
+
+/* Key of a character in the given values of a condition space. */
+static inline Key condKey( CondSpace *condSpace, long vals, Key key )
+{
+	return condSpace->baseKey + vals * keyOps->alphSize() + (key - keyOps->minKey);
+}
+
+/* Reduce a condition range of a state to the conditions that change where
+ * some character goes. The range is split where the set of conditions that
+ * matter changes. New transitions are put into newTrans and the new
+ * condition ranges onto newCondList. Returns false, leaving the state alone,
+ * if every condition matters everywhere in the range. */
+bool FsmAp::reduceStateCond( StateAp *state, StateCond *stateCond,
+		StateCondList &newCondList, TransPtrVect &newTrans )
+{
+	CondSpace *condSpace = stateCond->condSpace;
+	long condLen = condSpace->condSet.length();
+	long numVals = 1 << condLen, fullMask = numVals - 1;
+
+	/* Break the character range where any of the condition values changes
+	 * transition. */
+	KeySet breaks;
+	breaks.insert( stateCond->lowKey );
+	TransAp *first = state->outList.head;
+	for ( long vals = 0; vals < numVals; vals++ ) {
+		Key lowKey = condKey( condSpace, vals, stateCond->lowKey );
+		Key highKey = condKey( condSpace, vals, stateCond->highKey );
+
+		/* The values are in key order, so is the out list. */
+		while ( first != 0 && first->highKey < lowKey )
+			first = first->next;
+
+		for ( TransAp *trans = first; trans != 0 && trans->lowKey <= highKey;
+				trans = trans->next )
+		{
+			if ( trans->lowKey > lowKey ) {
+				breaks.insert( trans->lowKey - condSpace->baseKey - 
+						vals * keyOps->alphSize() + keyOps->minKey );
 			}
-			case RangeInS2:
-				break;
-			case RangeOverlap: {
-				TransAp *trans = pairIter.s1Tel.trans;
-				detachTrans( trans->fromState, trans->toState, trans );
-				delete trans;
-				break;
+			if ( trans->highKey < highKey ) {
+				Key next = trans->highKey - condSpace->baseKey - 
+						vals * keyOps->alphSize() + keyOps->minKey;
+				next.increment();
+				breaks.insert( next );
 			}
-			case BreakS1: {
-				pairIter.s1Tel.trans = dupTrans( destState, 
-						pairIter.s1Tel.trans );
-				break;
+		}
+	}
+
+	/* The transition taken for each condition value, in each piece. */
+	long numPieces = breaks.length();
+	TransAp **pieceTrans = new TransAp*[numVals * numPieces];
+	for ( long i = 0; i < numVals * numPieces; i++ )
+		pieceTrans[i] = 0;
+	first = state->outList.head;
+	for ( long vals = 0; vals < numVals; vals++ ) {
+		Key lowKey = condKey( condSpace, vals, stateCond->lowKey );
+		Key highKey = condKey( condSpace, vals, stateCond->highKey );
+		while ( first != 0 && first->highKey < lowKey )
+			first = first->next;
+
+		/* Every transition boundary is a break, so a transition takes the
+		 * pieces whose first key it holds. */
+		long p = 0;
+		for ( TransAp *trans = first; trans != 0 && trans->lowKey <= highKey;
+				trans = trans->next )
+		{
+			while ( p < numPieces && condKey( condSpace, vals, breaks[p] ) < trans->lowKey )
+				p += 1;
+			while ( p < numPieces && condKey( condSpace, vals, breaks[p] ) <= trans->highKey ) {
+				pieceTrans[vals * numPieces + p] = trans;
+				p += 1;
 			}
-			case BreakS2:
-				break;
+		}
+	}
+
+	/* A condition matters in a piece if flipping it changes the transition
+	 * for some values of the others. */
+	long *pieceMask = new long[numPieces];
+	bool anyReduced = false;
+	for ( long p = 0; p < numPieces; p++ ) {
+		pieceMask[p] = 0;
+		for ( long c = 0; c < condLen; c++ ) {
+			for ( long vals = 0; vals < numVals; vals++ ) {
+				if ( !(vals & (1 << c)) && compareCondTrans(
+						pieceTrans[vals * numPieces + p],
+						pieceTrans[(vals | (1 << c)) * numPieces + p] ) != 0 )
+				{
+					pieceMask[p] |= 1 << c;
+					break;
+				}
+			}
+		}
+		if ( pieceMask[p] != fullMask )
+			anyReduced = true;
+	}
+
+	if ( anyReduced ) {
+		for ( long p = 0; p < numPieces; ) {
+			/* Take the run of pieces that need the same conditions. */
+			long mask = pieceMask[p], end = p + 1;
+			while ( end < numPieces && pieceMask[end] == mask )
+				end += 1;
+
+			Key lowKey = breaks[p];
+			Key highKey = stateCond->highKey;
+			if ( end < numPieces ) {
+				highKey = breaks[end];
+				highKey.decrement();
+			}
+
+			CondSpace *toCondSpace = 0;
+			if ( mask != 0 ) {
+				CondSet condSet;
+				for ( long c = 0; c < condLen; c++ ) {
+					if ( mask & (1 << c) )
+						condSet.insert( condSpace->condSet[c] );
+				}
+
+				try {
+					toCondSpace = addCondSpace( condSet );
+				}
+				catch ( FsmConstructFail ) {
+					/* Out of key space for the smaller space. Keep the
+					 * conditions there are. */
+					toCondSpace = condSpace;
+					mask = fullMask;
+				}
+
+				StateCond *newCond = new StateCond( lowKey, highKey );
+				newCond->condSpace = toCondSpace;
+				newCondList.append( newCond );
+			}
+
+			/* Loop the values of the conditions that are kept, with the
+			 * others held false. */
+			long toLen = toCondSpace != 0 ? toCondSpace->condSet.length() : 0;
+			for ( long toVals = 0; toVals < (1 << toLen); toVals++ ) {
+				long vals = 0;
+				for ( long c = 0, t = 0; c < condLen; c++ ) {
+					if ( mask & (1 << c) ) {
+						if ( toVals & (1 << t) )
+							vals |= 1 << c;
+						t += 1;
+					}
+				}
+
+				/* Copy the transitions, joining pieces that were one. */
+				for ( long q = p; q < end; ) {
+					TransAp *srcTrans = pieceTrans[vals * numPieces + q];
+					long qEnd = q + 1;
+					while ( qEnd < end && pieceTrans[vals * numPieces + qEnd] == srcTrans )
+						qEnd += 1;
+
+					if ( srcTrans != 0 ) {
+						Key transLow = breaks[q], transHigh = highKey;
+						if ( qEnd < end ) {
+							transHigh = breaks[qEnd];
+							transHigh.decrement();
+						}
+
+						TransAp *trans = dupTrans( state, srcTrans );
+						if ( toCondSpace == 0 ) {
+							trans->lowKey = transLow;
+							trans->highKey = transHigh;
+						}
+						else {
+							trans->lowKey = condKey( toCondSpace, toVals, transLow );
+							trans->highKey = condKey( toCondSpace, toVals, transHigh );
+						}
+						newTrans.append( trans );
+					}
+					q = qEnd;
+				}
+			}
+
+			p = end;
+		}
+
+		/* The copies are made, drop the expanded transitions. */
+		for ( long vals = 0; vals < numVals; vals++ ) {
+			removeTransRange( state, condKey( condSpace, vals, stateCond->lowKey ),
+					condKey( condSpace, vals, stateCond->highKey ) );
+		}
+	}
+
+	delete[] pieceTrans;
+	delete[] pieceMask;
+	return anyReduced;
+}
+
+/* Conditions are implemented by expanding the characters of a range into a
+ * key for every combination of condition values. With --reduce-conds this
+ * pass goes over the already expanded machine and drops the conditions that
+ * do not change where a character goes, only splitting the ranges where they
+ * do. That saves transitions and condition evaluations in the generated code.
+ * The expansion itself still happens during the operations. Returns true if
+ * any condition range changed. */
+bool FsmAp::reduceCondSpaces()
+{
+	bool anyReduced = false;
+	for ( StateList::Iter state = stateList; state.lte(); state++ ) {
+		if ( state->stateCondList.length() == 0 )
+			continue;
+
+		StateCondList newCondList;
+		TransPtrVect newTrans;
+		bool stateReduced = false;
+		while ( state->stateCondList.length() > 0 ) {
+			StateCond *stateCond = state->stateCondList.detachFirst();
+			if ( reduceStateCond( state, stateCond, newCondList, newTrans ) ) {
+				stateReduced = true;
+				delete stateCond;
+			}
+			else
+				newCondList.append( stateCond );
+		}
+		state->stateCondList.transfer( newCondList );
+
+		if ( stateReduced ) {
+			/* Put the new transitions in with the others. Their keys are
+			 * free since the expansions they replace are gone. */
+			MergeSort<TransAp*, CmpTransLowKey> mergeSort;
+			mergeSort.sort( newTrans.data, newTrans.length() );
+
+			TransList outList;
+			TransAp **nt = newTrans.data, **ntEnd = newTrans.data + newTrans.length();
+			while ( state->outList.length() > 0 || nt < ntEnd ) {
+				if ( nt == ntEnd || ( state->outList.length() > 0 &&
+						state->outList.head->lowKey < (*nt)->lowKey ) )
+					outList.append( state->outList.detachFirst() );
+				else
+					outList.append( *nt++ );
 			}
+			state->outList.transfer( outList );
+			anyReduced = true;
 		}
-		destState->outList.transfer( destList );
 	}
+	return anyReduced;
 }
 
 void FsmAp::mergeStateConds( StateAp *destState, StateAp *srcState )
@@ -56,6 +56,76 @@ struct TransAp;
 struct StateAp;
 struct FsmAp;
 struct Action;
+
+/* Allocator for the numerous small objects of the graph: states, transitions
+ * and state dictionary elements. Objects are carved out of large chunks and
+ * freed objects go on a free list for reuse, so building and discarding
+ * graphs does not go to the heap for every object. Chunks are kept until
+ * exit. */
+template <class T> class SlabAlloc
+{
+public:
+	static void *allocate()
+	{
+		if ( freeList != 0 ) {
+			FreeEl *el = freeList;
+			freeList = el->next;
+			return el;
+		}
+
+		if ( nextSlot == endSlot )
+			newChunk( ChunkLength );
+
+		void *el = nextSlot;
+		nextSlot += slotSize();
+		return el;
+	}
+
+	static void release( void *el )
+	{
+		if ( el != 0 ) {
+			FreeEl *fe = (FreeEl*)el;
+			fe->next = freeList;
+			freeList = fe;
+		}
+	}
+
+	/* Make sure the next len objects can come from a single chunk. */
+	static void reserve( long len )
+	{
+		if ( endSlot - nextSlot < len * slotSize() )
+			newChunk( len > ChunkLength ? len : ChunkLength );
+	}
+
+private:
+	struct FreeEl { FreeEl *next; };
+	enum { ChunkLength = 512 };
+
+	/* Slots hold either an object or a free list link, aligned for both. */
+	static long slotSize()
+	{
+		long size = sizeof(T) > sizeof(FreeEl) ? sizeof(T) : sizeof(FreeEl);
+		return ( size + sizeof(void*) - 1 ) / sizeof(void*) * sizeof(void*);
+	}
+
+	static void newChunk( long len )
+	{
+		/* Whatever is left of the current chunk goes onto the free list. */
+		for ( ; nextSlot != endSlot; nextSlot += slotSize() )
+			release( nextSlot );
+
+		nextSlot = new char[len * slotSize()];
+		endSlot = nextSlot + len * slotSize();
+	}
+
+	static THREAD_LOCAL FreeEl *freeList;
+	static THREAD_LOCAL char *nextSlot, *endSlot;
+};
+
+template <class T> THREAD_LOCAL typename SlabAlloc<T>::FreeEl 
+		*SlabAlloc<T>::freeList = 0;
+template <class T> THREAD_LOCAL char *SlabAlloc<T>::nextSlot = 0;
+template <class T> THREAD_LOCAL char *SlabAlloc<T>::endSlot = 0;
 struct LongestMatchPart;
 struct LengthDef;
 
@@ -66,7 +136,8 @@ struct FsmListEl
 };
 
 /* This is the marked index for a state pair. Used in minimization. It keeps
- * track of whether or not the state pair is marked. */
+ * track of whether or not the state pair is marked. Only unordered pairs of
+ * distinct states are stored, one bit per pair. */
 struct MarkIndex
 {
 	MarkIndex(int states);
@@ -75,12 +146,68 @@ struct MarkIndex
 	void markPair(int state1, int state2);
 	bool isPairMarked(int state1, int state2);
 
+	/* Largest table allocated since the last reset. For statistics. */
+	static THREAD_LOCAL long peakBytes;
+
 private:
+	long pairPos( int state1, int state2 );
+
 	int numStates;
-	bool *array;
+	unsigned char *bits;
+};
+
+/* Machine operations timed for the statistics. */
+enum FsmStatOp
+{
+	FsmStatUnion,
+	FsmStatConcat,
+	FsmStatStar,
+	FsmStatIntersect,
+	FsmStatSubtract,
+	FsmStatJoin,
+	FsmStatMinimize,
+	FsmStatNumOps
+};
+
+/* Time spent in one kind of operation and the largest machine it left. */
+struct FsmOpStats
+{
+	long count;
+	double seconds;
+	long peakStates;
+	long peakTrans;
+};
+
+/* Statistics on building the machines of a section. */
+struct FsmStats
+{
+	FsmStats();
+
+	static const char *opName( int op );
+
+	FsmOpStats ops[FsmStatNumOps];
+	long minimizeRounds;
+	long peakStates;
+	long peakTrans;
 };
 
-extern KeyOps *keyOps;
+/* Where the operations of this thread record their statistics. Null when
+ * they are not wanted. */
+extern THREAD_LOCAL FsmStats *fsmStats;
+
+/* Times an operation from construction to destruction, then records the
+ * size of the machine it left. */
+struct FsmStatTimer
+{
+	FsmStatTimer( FsmAp *fsm, FsmStatOp op );
+	~FsmStatTimer();
+
+	FsmAp *fsm;
+	FsmStatOp op;
+	double start;
+};
+
+extern THREAD_LOCAL KeyOps *keyOps;
 
 /* Transistion Action Element. */
 typedef SBstMapEl< int, Action* > ActionTableEl;
@@ -384,6 +511,12 @@ struct TransAp
 		priorTable(other.priorTable),
 		lmActionTable(other.lmActionTable) {}
 
+	/* Transitions come from a slab. */
+	static void *operator new( size_t ) 
+		{ return SlabAlloc<TransAp>::allocate(); }
+	static void operator delete( void *el ) 
+		{ SlabAlloc<TransAp>::release( el ); }
+
 	Key lowKey, highKey;
 	StateAp *fromState;
 	StateAp *toState;
@@ -442,6 +575,7 @@ struct TransInList
 };
 
 typedef DList<TransAp> TransList;
+typedef Vector<TransAp*> TransPtrVect;
 
 /* Set of states, list of states. */
 typedef BstSet<StateAp*> StateSet;
@@ -449,19 +583,48 @@ typedef DList<StateAp> StateList;
 
 /* A element in a state dict. */
 struct StateDictEl 
-:
-	public AvlTreeEl<StateDictEl>
 {
 	StateDictEl(const StateSet &stateSet) 
 		: stateSet(stateSet) { }
 
-	const StateSet &getKey() { return stateSet; }
+	/* Elements come from a slab. */
+	static void *operator new( size_t ) 
+		{ return SlabAlloc<StateDictEl>::allocate(); }
+	static void operator delete( void *el ) 
+		{ SlabAlloc<StateDictEl>::release( el ); }
+
 	StateSet stateSet;
 	StateAp *targState;
+
+	/* Hash of the state set, kept for probing and growing the dict. */
+	unsigned long long hash;
 };
 
-/* Dictionary mapping a set of states to a target state. */
-typedef AvlTree< StateDictEl, StateSet, CmpTable<StateAp*> > StateDict;
+/* Dictionary mapping a set of states to a target state. A hash table using
+ * open addressing with linear probing. The elements are owned by the states
+ * they are linked to, not by the dict. */
+struct StateDict
+{
+	StateDict() : table(0), tableSize(0), numEls(0) { }
+	~StateDict() { delete[] table; }
+
+	/* Find the state set, or make an element for it. Returns true if the
+	 * element is new. Either way lastFound is set to the element. */
+	bool insert( const StateSet &stateSet, StateDictEl **lastFound );
+
+	long length() const { return numEls; }
+
+	/* Lookups that found an existing element and probes that landed on an
+	 * element for a different set, since the last reset. For statistics. */
+	static THREAD_LOCAL long hits, collisions;
+
+private:
+	static unsigned long long hashSet( const StateSet &stateSet );
+	void grow();
+
+	StateDictEl **table;
+	long tableSize, numEls;
+};
 
 /* Data needed for a merge operation. */
 struct MergeData
@@ -649,7 +812,7 @@ struct CondData
 	CondSpaceMap condSpaceMap;
 };
 
-extern CondData *condData;
+extern THREAD_LOCAL CondData *condData;
 
 struct FsmConstructFail
 {
@@ -670,6 +833,12 @@ struct StateAp
 	StateAp(const StateAp &other);
 	~StateAp();
 
+	/* States come from a slab. */
+	static void *operator new( size_t ) 
+		{ return SlabAlloc<StateAp>::allocate(); }
+	static void operator delete( void *el ) 
+		{ SlabAlloc<StateAp>::release( el ); }
+
 	/* Is the state final? */
 	bool isFinState() { return stateBits & STB_ISFINAL; }
 
@@ -1084,6 +1253,46 @@ public:
 /* List of partitions. */
 typedef DList< MinPartition > PartitionList;
 
+/* A transition into a splitter partition, used by Hopcroft minimization. When
+ * eof is set the entry stands for an eof target rather than a key range. */
+struct SplitterTrans
+{
+	StateAp *fromState;
+	bool eof;
+	Key lowKey, highKey;
+};
+
+typedef Vector<SplitterTrans> SplitterTransVect;
+
+/* Orders splitter transitions by source partition, then source state, then
+ * keys. Groups the transitions of a partition's states together. */
+class CmpSplitterTrans
+{
+public:
+	static int compare( const SplitterTrans &t1, const SplitterTrans &t2 );
+};
+
+/* The coalesced transitions of a single state into a splitter. Offset and
+ * length index a vector of coalesced SplitterTrans ranges. */
+struct SplitterSig
+{
+	StateAp *state;
+	int offset, length;
+};
+
+typedef Vector<SplitterSig> SplitterSigVect;
+
+/* Orders signatures by the sets of keys they move on into the splitter. */
+class CmpSplitterSig
+{
+public:
+	CmpSplitterSig() : ranges(0) { }
+	int compare( const SplitterSig &sig1, const SplitterSig &sig2 );
+
+	/* The coalesced ranges the signatures index into. */
+	const SplitterTrans *ranges;
+};
+
 /* List of transtions out of a state. */
 typedef Vector<TransEl> TransListVect;
 
@@ -1164,6 +1373,11 @@ struct FsmAp
 	void allTransCondition( Action *condAction, bool sense );
 	void leaveFsmCondition( Action *condAction, bool sense );
 
+	/* Drop conditions that do not change where a character goes. */
+	bool reduceStateCond( StateAp *state, StateCond *stateCond,
+			StateCondList &newCondList, TransPtrVect &newTrans );
+	bool reduceCondSpaces();
+
 	/* Set error actions to execute. */
 	void startErrorAction( int ordering, Action *action, int transferPoint );
 	void allErrorAction( int ordering, Action *action, int transferPoint );
@@ -1283,6 +1497,7 @@ struct FsmAp
 	void outTransCopy( MergeData &md, StateAp *dest, TransAp *srcList );
 
 	void doRemove( MergeData &md, StateAp *destState, ExpansionList &expList1 );
+	void removeTransRange( StateAp *state, Key lowKey, Key highKey );
 	void doExpand( MergeData &md, StateAp *destState, ExpansionList &expList1 );
 	void findCondExpInTrans( ExpansionList &expansionList, StateAp *state, 
 			Key lowKey, Key highKey, CondSpace *fromCondSpace, CondSpace *toCondSpace,
@@ -1353,6 +1568,7 @@ struct FsmAp
 	void concatFsm( Key c );
 	void concatFsm( Key *str, int len );
 	void concatFsmCI( Key *str, int len );
+	void literalUnionFsm( Vector<Key> *strings, long numStrings );
 	void orFsm( Key *set, int len );
 	void rangeFsm( Key low, Key high );
 	void rangeStarFsm( Key low, Key high );
@@ -1394,6 +1610,8 @@ struct FsmAp
 
 	/* Workers for concatenation and union. */
 	void doConcat( FsmAp *other, StateSet *fromStates, bool optional );
+	void doubleRepeat( FsmAp *copyFrom, int times, bool optional );
+	void repeatStep( FsmAp *other, bool optional );
 	void doOr( FsmAp *other );
 
 	/*
@@ -1470,7 +1688,7 @@ struct FsmAp
 	void minimizePartition2();
 
 	/* Minimize the final state Machine. The result is the minimal fsm. Slow
-	 * but stable, correct minimization. Uses n^2 space (lookout) and average
+	 * but stable, correct minimization. Uses n^2/2 bits of space and average
 	 * n^2 time. Worst case n^3 time, but a that is a very rare case. */
 	void minimizeStable();
 
@@ -1491,6 +1709,16 @@ struct FsmAp
 	 * there are no more partitions to split. */
 	int splitCandidates( StateAp **statePtrs, MinPartition *parts, int numParts );
 
+	/* Minimization by Hopcroft's partition refinement. Gives the same
+	 * partitions as minimizePartition2, in O(n log n) time. */
+	void minimizeHopcroft();
+
+	/* Split every partition that has states moving into the splitter by
+	 * differing sets of keys. Returns the new number of partitions. */
+	int splitOnSplitter( MinPartition *splitter, MinPartition *parts, 
+			int numParts, PartitionList &splitters, StateAp **eofFrom,
+			int numEofFrom );
+
 	/* Fuse together states in the same partition. */
 	void fusePartitions( MinPartition *parts, int numParts );
 
@@ -1499,9 +1727,12 @@ struct FsmAp
 	 * alot of pairs. */
 	void initialMarkRound( MarkIndex &markIndex );
 
-	/* One marking round on all state pairs. Considers if trans pairs go
-	 * to a marked state only. Returns whether or not a pair was marked. */
-	bool markRound( MarkIndex &markIndex );
+	/* One marking round on the state pairs that may have become
+	 * distinguishable, those with transitions into a state flagged in
+	 * changed. Considers if trans pairs go to a marked state only. On return
+	 * changed flags the states of newly marked pairs. Returns whether or not
+	 * a pair was marked. */
+	bool markRound( MarkIndex &markIndex, bool *changed );
 
 	/* Move the in trans into src into dest. */
 	void inTransMove(StateAp *dest, StateAp *src);
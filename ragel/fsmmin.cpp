@@ -19,11 +19,15 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
  */
 
+#include <string.h>
 #include "fsmgraph.h"
 #include "mergesort.h"
 
 int FsmAp::partitionRound( StateAp **statePtrs, MinPartition *parts, int numParts )
 {
+	if ( fsmStats != 0 )
+		fsmStats->minimizeRounds += 1;
+
 	/* Need a mergesort object and a single partition compare. */
 	MergeSort<StateAp*, PartitionCompare> mergeSort;
 	PartitionCompare partCompare;
@@ -78,6 +82,8 @@ int FsmAp::partitionRound( StateAp **statePtrs, MinPartition *parts, int numPart
  */
 void FsmAp::minimizePartition1()
 {
+	FsmStatTimer statTimer( this, FsmStatMinimize );
+
 	/* Need one mergesort object and partition compares. */
 	MergeSort<StateAp*, InitPartitionCompare> mergeSort;
 	InitPartitionCompare initPartCompare;
@@ -191,6 +197,8 @@ int FsmAp::splitCandidates( StateAp **statePtrs, MinPartition *parts, int numPar
 	 * as a result of the newly split partition. */
 	while ( splittable.length() > 0 ) {
 		MinPartition *partition = splittable.detachFirst();
+		if ( fsmStats != 0 )
+			fsmStats->minimizeRounds += 1;
 
 		/* Fill the pointer array with the states in the partition. */
 		StateList::Iter state = partition->list;
@@ -281,6 +289,8 @@ int FsmAp::splitCandidates( StateAp **statePtrs, MinPartition *parts, int numPar
  */
 void FsmAp::minimizePartition2()
 {
+	FsmStatTimer statTimer( this, FsmStatMinimize );
+
 	/* Need a mergesort and an initial partition compare. */
 	MergeSort<StateAp*, InitPartitionCompare> mergeSort;
 	InitPartitionCompare initPartCompare;
@@ -340,6 +350,325 @@ void FsmAp::minimizePartition2()
 	delete[] parts;
 }
 
+/* Orders states by the address of their eof target, so that the states
+ * having an eof target in some state can be found by binary search. */
+struct CmpEofTarget
+{
+	static int compare( const StateAp *state1, const StateAp *state2 )
+	{
+		if ( state1->eofTarget < state2->eofTarget )
+			return -1;
+		else if ( state1->eofTarget > state2->eofTarget )
+			return 1;
+		return 0;
+	}
+};
+
+int CmpSplitterTrans::compare( const SplitterTrans &t1, const SplitterTrans &t2 )
+{
+	/* Group by partition of the source state first. */
+	if ( t1.fromState->alg.partition < t2.fromState->alg.partition )
+		return -1;
+	else if ( t1.fromState->alg.partition > t2.fromState->alg.partition )
+		return 1;
+
+	/* Then by source state. */
+	if ( t1.fromState < t2.fromState )
+		return -1;
+	else if ( t1.fromState > t2.fromState )
+		return 1;
+
+	/* The eof entry goes before any key range. */
+	if ( t1.eof && !t2.eof )
+		return -1;
+	else if ( !t1.eof && t2.eof )
+		return 1;
+
+	/* Ranges out of one state never overlap, the low key is enough. */
+	if ( t1.lowKey < t2.lowKey )
+		return -1;
+	else if ( t1.lowKey > t2.lowKey )
+		return 1;
+	return 0;
+}
+
+int CmpSplitterSig::compare( const SplitterSig &sig1, const SplitterSig &sig2 )
+{
+	const SplitterTrans *r1 = ranges + sig1.offset;
+	const SplitterTrans *r2 = ranges + sig2.offset;
+
+	/* Walk the ranges in parallel. */
+	for ( int i = 0; i < sig1.length && i < sig2.length; i++, r1++, r2++ ) {
+		if ( r1->eof && !r2->eof )
+			return -1;
+		else if ( !r1->eof && r2->eof )
+			return 1;
+
+		if ( r1->lowKey < r2->lowKey )
+			return -1;
+		else if ( r1->lowKey > r2->lowKey )
+			return 1;
+		else if ( r1->highKey < r2->highKey )
+			return -1;
+		else if ( r1->highKey > r2->highKey )
+			return 1;
+	}
+
+	/* A shorter signature that is a prefix of the other goes first. */
+	if ( sig1.length < sig2.length )
+		return -1;
+	else if ( sig1.length > sig2.length )
+		return 1;
+	return 0;
+}
+
+int FsmAp::splitOnSplitter( MinPartition *splitter, MinPartition *parts, 
+		int numParts, PartitionList &splitters, StateAp **eofFrom, int numEofFrom )
+{
+	/* Collect the transitions and eof targets that lead into the splitter. */
+	SplitterTransVect trans;
+	for ( StateList::Iter state = splitter->list; state.lte(); state++ ) {
+		for ( TransInList::Iter t = state->inList; t.lte(); t++ ) {
+			SplitterTrans st;
+			st.fromState = t->fromState;
+			st.eof = false;
+			st.lowKey = t->lowKey;
+			st.highKey = t->highKey;
+			trans.append( st );
+		}
+
+		if ( numEofFrom > 0 ) {
+			/* Find the first state with this eof target. */
+			int low = 0, high = numEofFrom;
+			while ( low < high ) {
+				int mid = (low + high) >> 1;
+				if ( eofFrom[mid]->eofTarget < state )
+					low = mid + 1;
+				else
+					high = mid;
+			}
+
+			for ( ; low < numEofFrom && eofFrom[low]->eofTarget == state; low++ ) {
+				SplitterTrans st;
+				st.fromState = eofFrom[low];
+				st.eof = true;
+				trans.append( st );
+			}
+		}
+	}
+
+	if ( trans.length() == 0 )
+		return numParts;
+
+	/* Bring the entries of each source partition and state together. */
+	MergeSort<SplitterTrans, CmpSplitterTrans> transSort;
+	transSort.sort( trans.data, trans.length() );
+
+	/* Coalesce neighbouring ranges of a state and make a signature for each
+	 * source state. */
+	SplitterTransVect ranges;
+	SplitterSigVect sigs;
+	for ( int t = 0; t < trans.length(); t++ ) {
+		SplitterTrans &st = trans[t];
+		if ( t == 0 || st.fromState != trans[t-1].fromState ) {
+			SplitterSig sig;
+			sig.state = st.fromState;
+			sig.offset = ranges.length();
+			sig.length = 0;
+			sigs.append( sig );
+		}
+
+		SplitterSig &sig = sigs[sigs.length()-1];
+		if ( sig.length > 0 && !st.eof ) {
+			SplitterTrans &last = ranges[ranges.length()-1];
+			Key next = last.highKey;
+			next.increment();
+			if ( !last.eof && next == st.lowKey ) {
+				last.highKey = st.highKey;
+				continue;
+			}
+		}
+
+		ranges.append( st );
+		sig.length += 1;
+	}
+
+	MergeSort<SplitterSig, CmpSplitterSig> sigSort;
+	sigSort.ranges = ranges.data;
+
+	/* Work on each source partition. Signatures of the same partition are
+	 * contiguous. */
+	int sigStart = 0;
+	while ( sigStart < sigs.length() ) {
+		MinPartition *part = sigs[sigStart].state->alg.partition;
+		int sigEnd = sigStart + 1;
+		while ( sigEnd < sigs.length() && sigs[sigEnd].state->alg.partition == part )
+			sigEnd += 1;
+
+		/* Order the touched states by their sets of keys into the splitter. */
+		SplitterSig *first = sigs.data + sigStart;
+		int numSigs = sigEnd - sigStart;
+		sigSort.sort( first, numSigs );
+
+		int numGroups = 1;
+		for ( int s = 1; s < numSigs; s++ ) {
+			if ( sigSort.compare( first[s-1], first[s] ) != 0 )
+				numGroups += 1;
+		}
+
+		/* Untouched states stay behind, otherwise the first group does. A
+		 * partition with a single group and no untouched states is not
+		 * split. */
+		int untouched = part->list.length() - numSigs;
+		if ( untouched > 0 || numGroups > 1 ) {
+			int firstNewPart = numParts;
+			int s = 0;
+			if ( untouched == 0 ) {
+				s = 1;
+				while ( s < numSigs && sigSort.compare( first[s-1], first[s] ) == 0 )
+					s += 1;
+			}
+
+			/* Move each remaining group into a new partition. */
+			int moveStart = s;
+			for ( ; s < numSigs; s++ ) {
+				if ( s == moveStart || sigSort.compare( first[s-1], first[s] ) != 0 )
+					numParts += 1;
+
+				MinPartition *dest = &parts[numParts-1];
+				part->list.detach( first[s].state );
+				dest->list.append( first[s].state );
+				first[s].state->alg.partition = dest;
+			}
+
+			/* If the partition is waiting to be a splitter then all the
+			 * pieces must be. Otherwise all but the largest piece must be. */
+			if ( part->active ) {
+				for ( int p = firstNewPart; p < numParts; p++ ) {
+					parts[p].active = true;
+					splitters.append( &parts[p] );
+				}
+			}
+			else {
+				MinPartition *largest = part;
+				for ( int p = firstNewPart; p < numParts; p++ ) {
+					if ( parts[p].list.length() > largest->list.length() )
+						largest = &parts[p];
+				}
+
+				if ( largest != part ) {
+					part->active = true;
+					splitters.append( part );
+				}
+				for ( int p = firstNewPart; p < numParts; p++ ) {
+					if ( &parts[p] != largest ) {
+						parts[p].active = true;
+						splitters.append( &parts[p] );
+					}
+				}
+			}
+		}
+
+		sigStart = sigEnd;
+	}
+
+	return numParts;
+}
+
+void FsmAp::minimizeHopcroft()
+{
+	FsmStatTimer statTimer( this, FsmStatMinimize );
+
+	/* Need a mergesort and an initial partition compare. */
+	MergeSort<StateAp*, InitPartitionCompare> mergeSort;
+	InitPartitionCompare initPartCompare;
+
+	/* Nothing to do if there are no states. */
+	if ( stateList.length() == 0 )
+		return;
+
+	/* The initial partitioning is the same as that of minimizePartition2. */
+	int numStates = stateList.length();
+	StateAp** statePtrs = new StateAp*[numStates];
+
+	/* Fill up an array of pointers to the states for easy sorting. Also
+	 * count the states with eof targets. */
+	int numEofFrom = 0;
+	StateList::Iter state = stateList;
+	for ( int s = 0; state.lte(); state++, s++ ) {
+		statePtrs[s] = state;
+		if ( state->eofTarget != 0 )
+			numEofFrom += 1;
+	}
+
+	/* Eof targets are not kept in in lists. Keep the states having them
+	 * ordered by target so the eof predecessors of a state can be found. */
+	StateAp **eofFrom = 0;
+	if ( numEofFrom > 0 ) {
+		eofFrom = new StateAp*[numEofFrom];
+		int e = 0;
+		for ( int s = 0; s < numStates; s++ ) {
+			if ( statePtrs[s]->eofTarget != 0 )
+				eofFrom[e++] = statePtrs[s];
+		}
+
+		MergeSort<StateAp*, CmpEofTarget> eofSort;
+		eofSort.sort( eofFrom, numEofFrom );
+	}
+		
+	/* Sort the states using the array of states. */
+	mergeSort.sort( statePtrs, numStates );
+
+	/* An array of lists of states is used to partition the states. */
+	MinPartition *parts = new MinPartition[numStates];
+
+	/* Assign the states into partitions. */
+	int destPart = 0;
+	for ( int s = 0; s < numStates; s++ ) {
+		/* If this state differs from the last then move to the next partition. */
+		if ( s > 0 && initPartCompare.compare( statePtrs[s-1], statePtrs[s] ) < 0 ) {
+			/* Move to the next partition. */
+			destPart += 1;
+		}
+
+		/* Put the state into its partition. */
+		statePtrs[s]->alg.partition = &parts[destPart];
+		parts[destPart].list.append( statePtrs[s] );
+	}
+
+	/* We just moved all the states from the main list into partitions without
+	 * taking them off the main list. So clean up the main list now. */
+	stateList.abandon();
+
+	/* The initial partitioning does not look at the presence of transitions
+	 * or at eof targets, so every initial partition starts as a splitter. */
+	int numParts = destPart + 1;
+	PartitionList splitters;
+	for ( int p = 0; p < numParts; p++ ) {
+		parts[p].active = true;
+		splitters.append( &parts[p] );
+	}
+
+	/* Split on splitters until there are none left. */
+	while ( splitters.length() > 0 ) {
+		MinPartition *splitter = splitters.detachFirst();
+		splitter->active = false;
+		if ( fsmStats != 0 )
+			fsmStats->minimizeRounds += 1;
+		numParts = splitOnSplitter( splitter, parts, numParts, 
+				splitters, eofFrom, numEofFrom );
+	}
+
+	/* Fuse states in the same partition. The states will end up back on the
+	 * main list. */
+	fusePartitions( parts, numParts );
+
+	/* Cleanup. */
+	delete[] statePtrs;
+	delete[] eofFrom;
+	delete[] parts;
+}
+
 void FsmAp::initialMarkRound( MarkIndex &markIndex )
 {
 	/* P and q for walking pairs. */
@@ -366,33 +695,59 @@ void FsmAp::initialMarkRound( MarkIndex &markIndex )
 	}
 }
 
-bool FsmAp::markRound( MarkIndex &markIndex )
+bool FsmAp::markRound( MarkIndex &markIndex, bool *changed )
 {
-	/* P an q for walking pairs. Take note if any pair gets marked. */
-	StateAp *p = stateList.head, *q;
+	if ( fsmStats != 0 )
+		fsmStats->minimizeRounds += 1;
+
+	int numStates = stateList.length();
 	bool pairWasMarked = false;
 
 	/* Need a mark comparison. */
 	MarkCompare markCompare;
 
-	/* Walk all unordered pairs of (p, q) where p != q.
-	 * The second depth of the walk stops before reaching p. This
-	 * gives us all unordered pairs of states (p, q) where p != q. */
-	while ( p != 0 ) {
-		q = stateList.head;
-		while ( q != p ) {
+	/* A pair can only become marked if it has a transition pair into a pair
+	 * that was marked in the last round. Collect the states with transitions
+	 * into the states of those pairs. */
+	StateAp **cands = new StateAp*[numStates];
+	bool *isCand = new bool[numStates];
+	memset( isCand, 0, sizeof(bool) * numStates );
+	int numCands = 0;
+	for ( StateList::Iter state = stateList; state.lte(); state++ ) {
+		if ( changed[state->alg.stateNum] ) {
+			for ( TransInList::Iter trans = state->inList; trans.lte(); trans++ ) {
+				StateAp *from = trans->fromState;
+				if ( !isCand[from->alg.stateNum] ) {
+					isCand[from->alg.stateNum] = true;
+					cands[numCands++] = from;
+				}
+			}
+		}
+	}
+
+	/* The next round works from the pairs marked in this one. */
+	memset( changed, 0, sizeof(bool) * numStates );
+
+	/* Walk all unordered pairs of candidates (p, q) where p != q. */
+	for ( int c1 = 1; c1 < numCands; c1++ ) {
+		StateAp *p = cands[c1];
+		for ( int c2 = 0; c2 < c1; c2++ ) {
+			StateAp *q = cands[c2];
+
 			/* Should we mark the pair? */
 			if ( !markIndex.isPairMarked( p->alg.stateNum, q->alg.stateNum ) ) {
 				if ( markCompare.shouldMark( markIndex, p, q ) ) {
 					markIndex.markPair( p->alg.stateNum, q->alg.stateNum );
+					changed[p->alg.stateNum] = true;
+					changed[q->alg.stateNum] = true;
 					pairWasMarked = true;
 				}
 			}
-			q = q->next;
 		}
-		p = p->next;
 	}
 
+	delete[] cands;
+	delete[] isCand;
 	return pairWasMarked;
 }
 
@@ -400,12 +755,14 @@ bool FsmAp::markRound( MarkIndex &markIndex )
 /**
  * \brief Minimize by pair marking.
  *
- * Decides if each pair of states is distinct or not. Uses O(n^2) memory and
- * should only be used on small graphs. Produces the most minmimal FSM
- * possible.
+ * Decides if each pair of states is distinct or not. Uses O(n^2) memory, one
+ * bit per pair, and should only be used on small graphs. Produces the most
+ * minmimal FSM possible.
  */
 void FsmAp::minimizeStable()
 {
+	FsmStatTimer statTimer( this, FsmStatMinimize );
+
 	/* Set the state numbers. */
 	setStateNumbers( 0 );
 
@@ -415,11 +772,20 @@ void FsmAp::minimizeStable()
 	/* Mark pairs where final stateness, out trans, or trans data differ. */
 	initialMarkRound( markIndex );
 
+	/* Any pair may have been marked in the initial round, so the first
+	 * round considers every state. */
+	int numStates = stateList.length();
+	bool *changed = new bool[numStates];
+	for ( int s = 0; s < numStates; s++ )
+		changed[s] = true;
+
 	/* While the last round of marking succeeded in marking a state
 	 * continue to do another round. */
-	int modified = markRound( markIndex );
+	int modified = markRound( markIndex, changed );
 	while (modified)
-		modified = markRound( markIndex );
+		modified = markRound( markIndex, changed );
+
+	delete[] changed;
 
 	/* Merge pairs that are unmarked. */
 	fuseUnmarkedPairs( markIndex );
@@ -431,6 +797,9 @@ bool FsmAp::minimizeRound()
 	if ( stateList.length() == 0 )
 		return false;
 
+	if ( fsmStats != 0 )
+		fsmStats->minimizeRounds += 1;
+
 	/* Need a mergesort on approx compare and an approx compare. */
 	MergeSort<StateAp*, ApproxCompare> mergeSort;
 	ApproxCompare approxCompare;
@@ -478,6 +847,8 @@ bool FsmAp::minimizeRound()
  */
 void FsmAp::minimizeApproximate()
 {
+	FsmStatTimer statTimer( this, FsmStatMinimize );
+
 	/* While the last minimization round succeeded in compacting states,
 	 * continue to try to compact states. */
 	while ( true ) {
@@ -26,46 +26,57 @@
 #include <iostream>
 using namespace std;
 
-/* Construct a mark index for a specified number of states. Must new up
- * an array that is states^2 in size. */
+THREAD_LOCAL long MarkIndex::peakBytes = 0;
+
+/* Construct a mark index for a specified number of states. Allocates one bit
+ * for each unordered pair of distinct states. */
 MarkIndex::MarkIndex( int states ) : numStates(states)
 {
-	/* Total pairs is states^2. Actually only use half of these, but we allocate
-	 * them all to make indexing into the array easier. */
-	int total = states * states;
-
-	/* New up chars so that individual DListEl constructors are
-	 * not called. Zero out the mem manually. */
-	array = new bool[total];
-	memset( array, 0, sizeof(bool) * total );
+	/* The pairs form a triangle below the diagonal of the states^2 square. */
+	long total = (long)states * (states - 1) / 2;
+	long bytes = ( total + 7 ) / 8;
+	if ( bytes == 0 )
+		bytes = 1;
+
+	bits = new unsigned char[bytes];
+	memset( bits, 0, bytes );
+
+	if ( bytes > peakBytes )
+		peakBytes = bytes;
 }
 
 /* Free the array used to store state pairs. */
 MarkIndex::~MarkIndex()
 {
-	delete[] array;
+	delete[] bits;
 }
 
-/* Mark a pair of states. States are specified by their number. The
- * marked states are moved from the unmarked list to the marked list. */
-void MarkIndex::markPair(int state1, int state2)
+/* Bit position of a pair of distinct states. Row i of the triangle holds the
+ * pairs (i, 0) .. (i, i-1). */
+long MarkIndex::pairPos( int state1, int state2 )
 {
-	int pos = ( state1 >= state2 ) ?
-		( state1 * numStates ) + state2 :
-		( state2 * numStates ) + state1;
+	long high = state1 >= state2 ? state1 : state2;
+	long low = state1 >= state2 ? state2 : state1;
+	return high * (high - 1) / 2 + low;
+}
 
-	array[pos] = true;
+/* Mark a pair of states. States are specified by their number. */
+void MarkIndex::markPair(int state1, int state2)
+{
+	long pos = pairPos( state1, state2 );
+	bits[pos >> 3] |= 1 << ( pos & 7 );
 }
 
 /* Returns true if the pair of states are marked. Returns false otherwise.
- * Ordering of states given does not matter. */
+ * Ordering of states given does not matter. A state paired with itself is
+ * never marked. */
 bool MarkIndex::isPairMarked(int state1, int state2)
 {
-	int pos = ( state1 >= state2 ) ?
-		( state1 * numStates ) + state2 :
-		( state2 * numStates ) + state1;
+	if ( state1 == state2 )
+		return false;
 
-	return array[pos];
+	long pos = pairPos( state1, state2 );
+	return ( bits[pos >> 3] & ( 1 << ( pos & 7 ) ) ) != 0;
 }
 
 /* Create a new fsm state. State has not out transitions or in transitions, not
@@ -48,6 +48,9 @@
 #include "dotcodegen.h"
 
 #include "javacodegen.h"
+#include "javaflat.h"
+#include "javafflat.h"
+#include "javagoto.h"
 
 #include "gocodegen.h"
 #include "gotable.h"
@@ -57,6 +60,7 @@
 #include "gogoto.h"
 #include "gofgoto.h"
 #include "goipgoto.h"
+#include "gosplit.h"
 
 #include "mltable.h"
 #include "mlftable.h"
@@ -71,6 +75,8 @@
 #include "rbxgoto.h"
 
 #include "rustcodegen.h"
+#include "rustfflat.h"
+#include "rustfgoto.h"
 
 string itoa( int i )
 {
@@ -99,6 +105,13 @@ CodeGenData *dotMakeCodeGen( const char *sourceFileName, const char *fsmName, os
 	return codeGen;
 }
 
+/* SIMD lookup and skipping is implemented for the C table and flat styles. */
+static bool simdStyle()
+{
+	return codeStyle == GenTables || codeStyle == GenFTables ||
+			codeStyle == GenFlat || codeStyle == GenFFlat;
+}
+
 /* Invoked by the parser when a ragel definition is opened. */
 CodeGenData *cdMakeCodeGen( const char *sourceFileName, const char *fsmName, ostream &out )
 {
@@ -112,12 +125,24 @@ CodeGenData *cdMakeCodeGen( const char *sourceFileName, const char *fsmName, ost
 		case GenFTables:
 			codeGen = new CFTabCodeGen(out);
 			break;
+		case GenCombTable: {
+			CTabCodeGen *tabCodeGen = new CTabCodeGen(out);
+			tabCodeGen->combVector = true;
+			codeGen = tabCodeGen;
+			break;
+		}
 		case GenFlat:
 			codeGen = new CFlatCodeGen(out);
 			break;
 		case GenFFlat:
 			codeGen = new CFFlatCodeGen(out);
 			break;
+		case GenClassFlat: {
+			CFlatCodeGen *flatCodeGen = new CFlatCodeGen(out);
+			flatCodeGen->charClasses = true;
+			codeGen = flatCodeGen;
+			break;
+		}
 		case GenGoto:
 			codeGen = new CGotoCodeGen(out);
 			break;
@@ -131,6 +156,14 @@ CodeGenData *cdMakeCodeGen( const char *sourceFileName, const char *fsmName, ost
 			codeGen = new CSplitCodeGen(out);
 			break;
 		}
+
+		if ( simdStyle() )
+			static_cast<FsmCodeGen*>(codeGen)->simd = simdCode;
+
+		/* Instrumentation is implemented for the goto styles, except the
+		 * split style, which writes its states to other files. */
+		if ( codeStyle == GenGoto || codeStyle == GenFGoto || codeStyle == GenIpGoto )
+			static_cast<FsmCodeGen*>(codeGen)->instrument = instrumentCode;
 		break;
 
 	case HostLang::D:
@@ -141,12 +174,24 @@ CodeGenData *cdMakeCodeGen( const char *sourceFileName, const char *fsmName, ost
 		case GenFTables:
 			codeGen = new DFTabCodeGen(out);
 			break;
+		case GenCombTable: {
+			DTabCodeGen *tabCodeGen = new DTabCodeGen(out);
+			tabCodeGen->combVector = true;
+			codeGen = tabCodeGen;
+			break;
+		}
 		case GenFlat:
 			codeGen = new DFlatCodeGen(out);
 			break;
 		case GenFFlat:
 			codeGen = new DFFlatCodeGen(out);
 			break;
+		case GenClassFlat: {
+			DFlatCodeGen *flatCodeGen = new DFlatCodeGen(out);
+			flatCodeGen->charClasses = true;
+			codeGen = flatCodeGen;
+			break;
+		}
 		case GenGoto:
 			codeGen = new DGotoCodeGen(out);
 			break;
@@ -170,12 +215,24 @@ CodeGenData *cdMakeCodeGen( const char *sourceFileName, const char *fsmName, ost
 		case GenFTables:
 			codeGen = new D2FTabCodeGen(out);
 			break;
+		case GenCombTable: {
+			D2TabCodeGen *tabCodeGen = new D2TabCodeGen(out);
+			tabCodeGen->combVector = true;
+			codeGen = tabCodeGen;
+			break;
+		}
 		case GenFlat:
 			codeGen = new D2FlatCodeGen(out);
 			break;
 		case GenFFlat:
 			codeGen = new D2FFlatCodeGen(out);
 			break;
+		case GenClassFlat: {
+			D2FlatCodeGen *flatCodeGen = new D2FlatCodeGen(out);
+			flatCodeGen->charClasses = true;
+			codeGen = flatCodeGen;
+			break;
+		}
 		case GenGoto:
 			codeGen = new D2GotoCodeGen(out);
 			break;
@@ -203,9 +260,32 @@ CodeGenData *cdMakeCodeGen( const char *sourceFileName, const char *fsmName, ost
 /* Invoked by the parser when a ragel definition is opened. */
 CodeGenData *javaMakeCodeGen( const char *sourceFileName, const char *fsmName, ostream &out )
 {
-	CodeGenData *codeGen = new JavaTabCodeGen(out);
+	JavaTabCodeGen *codeGen = 0;
+
+	switch ( codeStyle ) {
+	case GenTables:
+		codeGen = new JavaTabCodeGen(out);
+		break;
+	case GenFlat:
+		codeGen = new JavaFlatCodeGen(out);
+		break;
+	case GenFFlat:
+		codeGen = new JavaFFlatCodeGen(out);
+		break;
+	case GenGoto:
+		codeGen = new JavaGotoCodeGen(out);
+		break;
+	default:
+		/* Other styles used to be ignored for Java. Keep writing tables so
+		 * existing builds still work. */
+		cerr << sourceFileName << ": warning: only -T0, -F0, -F1 and -G0 "
+				"are supported for Java, writing -T0\n";
+		codeGen = new JavaTabCodeGen(out);
+		break;
+	}
 
 	codeGen->sourceFileName = sourceFileName;
+	codeGen->stringTables = stringTables;
 	codeGen->fsmName = fsmName;
 
 	return codeGen;
@@ -238,8 +318,11 @@ CodeGenData *goMakeCodeGen( const char *sourceFileName, const char *fsmName, ost
 	case GenIpGoto:
 		codeGen = new GoIpGotoCodeGen(out);
 		break;
+	case GenSplit:
+		codeGen = new GoSplitCodeGen(out);
+		break;
 	default:
-		cerr << "Invalid output style, only -T0, -T1, -F0, -F1, -G0, -G1 and -G2 are supported for Go.\n";
+		cerr << "Invalid output style, only -T0, -T1, -F0, -F1, -G0, -G1, -G2 and -P<N> are supported for Go.\n";
 		exit(1);
 	}
 
@@ -318,6 +401,9 @@ CodeGenData *csharpMakeCodeGen( const char *sourceFileName, const char *fsmName,
 	case GenSplit:
 		codeGen = new CSharpSplitCodeGen(out);
 		break;
+	default:
+		cerr << "Invalid output style, -T2 and -F2 are not supported for C#.\n";
+		exit(1);
 	}
 
 	codeGen->sourceFileName = sourceFileName;
@@ -361,12 +447,46 @@ CodeGenData *ocamlMakeCodeGen( const char *sourceFileName, const char *fsmName,
 /* Invoked by the parser when a ragel definition is opened. */
 CodeGenData *rustMakeCodeGen( const char *sourceFileName, const char *fsmName, ostream &out )
 {
-	CodeGenData *codeGen = new RustTabCodeGen(out);
+	RustTabCodeGen *codeGen = 0;
+
+	switch ( codeStyle ) {
+	case GenTables:
+		codeGen = new RustTabCodeGen(out);
+		break;
+	case GenFFlat:
+		codeGen = new RustFFlatCodeGen(out);
+		break;
+	case GenFGoto:
+		codeGen = new RustFGotoCodeGen(out);
+		break;
+	default:
+		/* Other styles used to be ignored for Rust. */
+		cerr << sourceFileName << ": warning: only -T0, -F1 and -G1 "
+				"are supported for Rust, writing -T0\n";
+		codeGen = new RustTabCodeGen(out);
+		break;
+	}
+
+	codeGen->sourceFileName = sourceFileName;
+	codeGen->unchecked = uncheckedAccess;
+	codeGen->fsmName = fsmName;
+
+	return codeGen;
+}
+
+/* Invoked by the parser when a ragel definition is opened. */
+CodeGenData *imageMakeCodeGen( const char *sourceFileName, const char *fsmName, ostream &out )
+{
+	CodeGenData *codeGen = new CodeGenData(out);
 
 	codeGen->sourceFileName = sourceFileName;
 	codeGen->fsmName = fsmName;
 
-  return codeGen;
+	/* The image keeps the transitions as the frontend gives them. The
+	 * backend that loads it fills in the error transitions it wants. */
+	codeGen->wantComplete = false;
+
+	return codeGen;
 }
 
 CodeGenData *makeCodeGen( const char *sourceFileName, const char *fsmName, ostream &out )
@@ -374,6 +494,8 @@ CodeGenData *makeCodeGen( const char *sourceFileName, const char *fsmName, ostre
 	CodeGenData *cgd = 0;
 	if ( generateDot )
 		cgd = dotMakeCodeGen( sourceFileName, fsmName, out );
+	else if ( generateImage )
+		cgd = imageMakeCodeGen( sourceFileName, fsmName, out );
 	else if ( hostLang == &hostLangC )
 		cgd = cdMakeCodeGen( sourceFileName, fsmName, out );
 	else if ( hostLang == &hostLangD )
@@ -395,6 +517,13 @@ CodeGenData *makeCodeGen( const char *sourceFileName, const char *fsmName, ostre
 	return cgd;
 }
 
+/* Written before the first line of the output file. */
+void writeFilePrelude( ostream &out )
+{
+	if ( hostLang == &hostLangC && simdCode && simdStyle() )
+		cdSimdIncludes( out );
+}
+
 void lineDirective( ostream &out, const char *fileName, int line )
 {
 	if ( !generateDot ) {
@@ -438,6 +567,7 @@ CodeGenData::CodeGenData( ostream &out )
 	redFsm(0), 
 	allActions(0),
 	allActionTables(0),
+	numActionTables(0),
 	allConditions(0),
 	allCondSpaces(0),
 	allStates(0),
@@ -492,6 +622,7 @@ void CodeGenData::newAction( int anum, const char *name,
 void CodeGenData::initActionTableList( unsigned long length )
 { 
 	allActionTables = new RedAction[length];
+	numActionTables = length;
 }
 
 void CodeGenData::initStateList( unsigned long length )
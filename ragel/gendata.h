@@ -36,7 +36,7 @@ typedef DList<GenAction> GenActionList;
 
 typedef unsigned long ulong;
 
-extern int gblErrorCount;
+extern THREAD_LOCAL int gblErrorCount;
 
 struct CodeGenData;
 
@@ -51,10 +51,24 @@ void csharpLineDirective( ostream &out, const char *fileName, int line );
 void ocamlLineDirective( ostream &out, const char *fileName, int line );
 void rustLineDirective( ostream &out, const char *fileName, int line );
 void genLineDirective( ostream &out );
+void cdSimdIncludes( ostream &out );
+void writeFilePrelude( ostream &out );
 void lineDirective( ostream &out, const char *fileName, int line );
 
 string itoa( int i );
 
+/* Size of an array written by the code generator, for the statistics. */
+struct TableSize
+{
+	TableSize( const string &name, long bytes )
+		: name(name), bytes(bytes) {}
+
+	string name;
+	long bytes;
+};
+
+typedef Vector<TableSize> TableSizeVect;
+
 /*********************************/
 
 struct CodeGenData
@@ -92,6 +106,7 @@ struct CodeGenData
 	RedFsmAp *redFsm;
 	GenAction *allActions;
 	RedAction *allActionTables;
+	long numActionTables;
 	Condition *allConditions;
 	GenCondSpace *allCondSpaces;
 	RedStateAp *allStates;
@@ -132,6 +147,9 @@ struct CodeGenData
 	bool noError;
 	bool noCS;
 
+	/* Sizes of the arrays written, for the statistics. */
+	TableSizeVect tableSizes;
+
 	void createMachine();
 	void initActionList( unsigned long length );
 	void newAction( int anum, const char *name, const InputLoc &loc, GenInlineList *inlineList );
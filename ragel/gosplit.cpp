@@ -0,0 +1,504 @@
+/*
+ *  Copyright 2006 Adrian Thurston <thurston@complang.org>
+ *            2026 Ragel contributors
+ */
+
+/*  This file is part of Ragel.
+ *
+ *  Ragel is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Ragel is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Ragel; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ragel.h"
+#include "gosplit.h"
+#include "redfsm.h"
+#include "gendata.h"
+#include "bstmap.h"
+
+using std::endl;
+
+bool GoSplitCodeGen::anyInPartition( int partition )
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st->partition == partition )
+			return true;
+	}
+	return false;
+}
+
+string GoSplitCodeGen::STATE_JUMP( int targ )
+{
+	/* Labels in the partition are only written when some transition of the
+	 * partition uses them. Anything else leaves through the boundary. */
+	RedStateAp *state = stateById[targ];
+	if ( state->partition == currentPartition && state->labelNeeded )
+		return "goto st" + itoa( targ );
+
+	state->partitionBoundary = true;
+	return "goto pst" + itoa( targ );
+}
+
+void GoSplitCodeGen::GOTO( ostream &ret, int gotoDest, bool inFinish )
+{
+	ret << "{" << STATE_JUMP( gotoDest ) << " }";
+}
+
+void GoSplitCodeGen::CALL( ostream &ret, int callDest, int targState, bool inFinish )
+{
+	if ( prePushExpr != 0 ) {
+		ret << "{";
+		INLINE_LIST( ret, prePushExpr, 0, false, false );
+	}
+
+	ret << "{" << STACK() << "[" << TOP() << "] = " << targState <<
+			"; " << TOP() << "++; " << STATE_JUMP( callDest ) << " }";
+
+	if ( prePushExpr != 0 )
+		ret << "}";
+}
+
+/* Emit the goto to take for a given transition. */
+std::ostream &GoSplitCodeGen::TRANS_GOTO( RedTransAp *trans, int level )
+{
+	if ( trans->targ->partition == currentPartition ) {
+		if ( trans->action != 0 ) {
+			/* Go to the transition which will go to the state. */
+			out << TABS(level) << "goto tr" << trans->id;
+		}
+		else {
+			/* Go directly to the target state. */
+			out << TABS(level) << "goto st" << trans->targ->id;
+		}
+	}
+	else {
+		if ( trans->action != 0 ) {
+			/* Go to the transition which will go to the state. */
+			out << TABS(level) << "goto ptr" << trans->id;
+			trans->partitionBoundary = true;
+		}
+		else {
+			/* Go directly to the target state. */
+			out << TABS(level) << "goto pst" << trans->targ->id;
+			trans->targ->partitionBoundary = true;
+		}
+	}
+	return out;
+}
+
+std::ostream &GoSplitCodeGen::STATE_GOTOS( int partition, int level )
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st->partition == partition ) {
+			if ( st == redFsm->errState )
+				STATE_GOTO_ERROR(level);
+			else {
+				/* Writing code above state gotos. */
+				GOTO_HEADER( st, level );
+
+				if ( st->stateCondVect.length() > 0 ) {
+					out << TABS(level + 1) << "_widec = " << CAST(WIDE_ALPH_TYPE(), GET_KEY()) << endl;
+					emitCondBSearch( st, level + 1, 0, st->stateCondVect.length() - 1 );
+				}
+
+				/* Try singles. */
+				if ( st->outSingle.length() > 0 )
+					emitSingleSwitch( st, level + 1 );
+
+				/* Default case is to binary search for the ranges, if that fails then */
+				if ( st->outRange.length() > 0 )
+					emitRangeBSearch( st, level + 1, 0, st->outRange.length() - 1 );
+
+				/* Write the default transition. */
+				TRANS_GOTO( st->defTrans, level + 1 ) << endl;
+			}
+		}
+	}
+	return out;
+}
+
+/* Transitions and states of other partitions that the partition jumps to.
+ * The actions of a boundary transition run here, then the current state is
+ * set and the partition returns to the dispatch loop, which advances p. Writing
+ * actions can put more transitions and states on the boundary, so go until
+ * nothing new turns up. */
+std::ostream &GoSplitCodeGen::PART_TRANS( int partition )
+{
+	IntSet transWritten, statesWritten;
+	bool anyNew = true;
+	while ( anyNew ) {
+		anyNew = false;
+
+		for ( TransApSet::Iter trans = redFsm->transSet; trans.lte(); trans++ ) {
+			if ( trans->partitionBoundary && transWritten.insert( trans->id ) ) {
+				anyNew = true;
+				out << "	ptr" << trans->id << ":" << endl;
+
+				/* If the action contains a next, then we must preload the
+				 * current state since the action may or may not set it. */
+				if ( trans->action->anyNextStmt() )
+					out << "		" << vCS() << " = " << trans->targ->id << endl;
+
+				/* Write each action in the list. */
+				for ( GenActionTable::Iter item = trans->action->key; item.lte(); item++ ) {
+					ACTION( out, item->value, trans->targ->id, false,
+							trans->action->anyNextStmt() );
+				}
+				genLineDirective( out );
+
+				if ( trans->action->anyNextStmt() )
+					out << "		goto _again" << endl;
+				else {
+					out << "		goto pst" << trans->targ->id << endl;
+					trans->targ->partitionBoundary = true;
+				}
+			}
+		}
+
+		for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+			if ( st->partitionBoundary && statesWritten.insert( st->id ) ) {
+				anyNew = true;
+				out <<
+					"	pst" << st->id << ":" << endl <<
+					"		" << vCS() << " = " << st->id << endl;
+
+				if ( st->toStateAction != 0 ) {
+					/* Write every action in the list. */
+					for ( GenActionTable::Iter item = st->toStateAction->key; item.lte(); item++ ) {
+						ACTION( out, item->value, st->id, false,
+								st->toStateAction->anyNextStmt() );
+					}
+					genLineDirective( out );
+				}
+
+				ptOutLabelUsed = true;
+				out << "		goto _pt_out" << endl;
+			}
+		}
+	}
+	return out;
+}
+
+std::ostream &GoSplitCodeGen::EXIT_STATES( int partition )
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st->partition == partition && st->outNeeded ) {
+			testEofUsed = true;
+			out << "	_test_eof" << st->id << ": " << vCS() << " = " <<
+					st->id << "; goto _test_eof" << endl;
+		}
+	}
+	return out;
+}
+
+std::ostream &GoSplitCodeGen::FINISH_CASES( int partition, int level )
+{
+	bool anyWritten = false;
+
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st->partition == partition && st->eofTrans != 0 ) {
+			out << TABS(level) << "case " << st->id << ":" << endl;
+			TRANS_GOTO( st->eofTrans, level + 1 ) << endl;
+		}
+	}
+
+	for ( GenActionTableMap::Iter act = redFsm->actionMap; act.lte(); act++ ) {
+		bool anyCase = false;
+		for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+			if ( st->partition == partition && st->eofAction == act ) {
+				out << ( anyCase ? ", " : TABS(level) + "case " ) << st->id;
+				anyCase = true;
+			}
+		}
+
+		if ( anyCase ) {
+			out << ":" << endl;
+
+			/* Remember that we wrote a trans so we know to write the
+			 * line directive for going back to the output. */
+			anyWritten = true;
+
+			/* Write each action in the eof action list. */
+			for ( GenActionTable::Iter item = act->key; item.lte(); item++ )
+				ACTION( out, item->value, STATE_ERR_STATE, true, false );
+		}
+	}
+
+	if ( anyWritten )
+		genLineDirective( out );
+	return out;
+}
+
+std::ostream &GoSplitCodeGen::PARTITION( int partition )
+{
+	/* Set the current partition rather than coding parameter passing
+	 * through the goto code generator. */
+	currentPartition = partition;
+	testEofUsed = false;
+	ptOutLabelUsed = false;
+
+	/* Initialize the partition boundaries, which get set during the writing
+	 * of states. */
+	for ( TransApSet::Iter trans = redFsm->transSet; trans.lte(); trans++ )
+		trans->partitionBoundary = false;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ )
+		st->partitionBoundary = false;
+
+	/* Go rejects variables that are never read, so declare only what the
+	 * states of this partition use. */
+	bool anyCurStateRef = false, anyConditions = false;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st->partition == partition ) {
+			if ( st->anyRegCurStateRef() )
+				anyCurStateRef = true;
+			if ( st->stateCondVect.length() > 0 )
+				anyConditions = true;
+		}
+	}
+
+	if ( pExpr == 0 )
+		out << "		" << P() << " := *_pp" << endl;
+
+	if ( anyCurStateRef )
+		out << "		var _ps " << INT() << " = 0" << endl;
+
+	if ( anyConditions )
+		out << "		var _widec " << WIDE_ALPH_TYPE() << endl;
+
+	if ( useAgainLabel() ) {
+		out <<
+			"		if _ag {" << endl <<
+			"			goto _again" << endl <<
+			"		}" << endl;
+	}
+
+	if ( !noEnd ) {
+		testEofUsed = true;
+		out <<
+			"		if " << P() << " == " << PE() << " {" << endl <<
+			"			goto _test_eof" << endl <<
+			"		}" << endl;
+	}
+
+	if ( useAgainLabel() ) {
+		/* States of other partitions are reached through the dispatch
+		 * loop, which comes back in at _again. */
+		out <<
+			"		goto _resume" << endl <<
+			endl <<
+			"	_again:" << endl <<
+			"		switch " << vCS() << " {" << endl;
+		for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+			if ( st->partition == partition ) {
+				out <<
+					"		case " << st->id << ":" << endl <<
+					"			goto st" << st->id << endl;
+			}
+		}
+		out <<
+			"		default:" << endl <<
+			"			goto _pt_again" << endl <<
+			"		}" << endl <<
+			endl <<
+			"	_resume:" << endl;
+	}
+
+	out <<
+		"		switch " << vCS() << " {" << endl;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st->partition == partition ) {
+			out <<
+				"		case " << st->id << ":" << endl <<
+				"			goto st_case_" << st->id << endl;
+		}
+	}
+	out <<
+		"		}" << endl <<
+		"		goto st_out" << endl;
+		STATE_GOTOS( partition, 1 );
+		out << "	st_out:" << endl;
+		EXIT_STATES( partition ) <<
+		endl;
+
+	if ( testEofUsed )
+		out << "	_test_eof: {}" << endl;
+
+	if ( redFsm->anyEofTrans() || redFsm->anyEofActions() ) {
+		out <<
+			"		if " << P() << " == " << vEOF() << " {" << endl <<
+			"			switch " << vCS() << " {" << endl;
+			FINISH_CASES( partition, 3 );
+			out <<
+			"			}" << endl <<
+			"		}" << endl <<
+			endl;
+	}
+
+	out << "		goto _out" << endl;
+	PART_TRANS( partition );
+
+	string store = pExpr == 0 ? "		*_pp = " + P() + "\n" : "";
+
+	out <<
+		endl <<
+		"	_out:" << endl <<
+		store <<
+		"		return 0" << endl;
+
+	if ( ptOutLabelUsed ) {
+		out <<
+			"	_pt_out:" << endl <<
+			store <<
+			"		return 1" << endl;
+	}
+
+	if ( useAgainLabel() ) {
+		out <<
+			"	_pt_again:" << endl <<
+			store <<
+			"		return 2" << endl;
+	}
+
+	return out;
+}
+
+std::ostream &GoSplitCodeGen::PART_MAP()
+{
+	int *partMap = new int[redFsm->stateList.length()];
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ )
+		partMap[st->id] = st->partition;
+
+	out << "	";
+	for ( int i = 0; i < redFsm->stateList.length(); i++ ) {
+		out << partMap[i] << ", ";
+		if ( i < redFsm->stateList.length() - 1 && (i + 1) % IALL == 0 )
+			out << endl << "	";
+	}
+	out << endl;
+
+	delete[] partMap;
+	return out;
+}
+
+void GoSplitCodeGen::setLabelsNeeded( RedStateAp *fromState, RedTransAp *trans )
+{
+	/* Jumps across partitions go through the boundary labels, which are
+	 * written on demand. */
+	if ( fromState->partition == trans->targ->partition ) {
+		/* If there is no action with a next statement, then the label will be
+		 * needed. */
+		trans->labelNeeded = true;
+		if ( trans->action == 0 || !trans->action->anyNextStmt() )
+			trans->targ->labelNeeded = true;
+	}
+}
+
+/* Set up labelNeeded flag for each state and transition. Go rejects labels
+ * that are never jumped to, so only those used in the partition are set.
+ * Action code jumping to a state without a label goes through the partition
+ * boundary. */
+void GoSplitCodeGen::setLabelsNeeded()
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ )
+		st->labelNeeded = useAgainLabel();
+	for ( TransApSet::Iter trans = redFsm->transSet; trans.lte(); trans++ )
+		trans->labelNeeded = false;
+
+	/* Walk all transitions and set only those that have targs. */
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		for ( RedTransList::Iter tel = st->outRange; tel.lte(); tel++ )
+			setLabelsNeeded( st, tel->value );
+
+		for ( RedTransList::Iter tel = st->outSingle; tel.lte(); tel++ )
+			setLabelsNeeded( st, tel->value );
+
+		if ( st->defTrans != 0 )
+			setLabelsNeeded( st, st->defTrans );
+
+		if ( st->eofTrans != 0 )
+			setLabelsNeeded( st, st->eofTrans );
+	}
+
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		st->outNeeded = !noEnd && st != redFsm->errState &&
+				st->labelNeeded;
+	}
+}
+
+void GoSplitCodeGen::writeData()
+{
+	STATE_IDS();
+
+	OPEN_ARRAY( ARRAY_TYPE(redFsm->nParts), PM() );
+	PART_MAP();
+	CLOSE_ARRAY() <<
+	endl;
+}
+
+void GoSplitCodeGen::writeExec()
+{
+	/* Must set labels immediately before writing because we may depend on the
+	 * noend write option. */
+	setLabelsNeeded();
+
+	/* Action code names its targets by id. */
+	if ( stateById == 0 ) {
+		stateById = new RedStateAp*[redFsm->stateList.length()];
+		for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ )
+			stateById[st->id] = st;
+	}
+
+	out << "	{" << endl;
+
+	for ( int p = 0; p < redFsm->nParts; p++ ) {
+		if ( !anyInPartition( p ) )
+			continue;
+
+		out << "	_part" << p << " := func(";
+		if ( pExpr == 0 )
+			out << "_pp *" << INT() << ( useAgainLabel() ? ", " : "" );
+		if ( useAgainLabel() )
+			out << "_ag bool";
+		out << ") " << INT() << " {" << endl;
+		PARTITION( p );
+		out << "	}" << endl << endl;
+	}
+
+	out <<
+		"	var _stat " << INT() << " = 0" << endl <<
+		"	for {" << endl <<
+		"		switch " << PM() << "[" << vCS() << "] {" << endl;
+	for ( int p = 0; p < redFsm->nParts; p++ ) {
+		if ( !anyInPartition( p ) )
+			continue;
+
+		out <<
+			"		case " << p << ":" << endl <<
+			"			_stat = _part" << p << "(";
+		if ( pExpr == 0 )
+			out << "&" << P() << ( useAgainLabel() ? ", " : "" );
+		if ( useAgainLabel() )
+			out << "_stat == 2";
+		out << ")" << endl;
+	}
+	out <<
+		"		}" << endl <<
+		"		if _stat == 0 {" << endl <<
+		"			break" << endl <<
+		"		}" << endl <<
+		"		if _stat == 1 {" << endl <<
+		"			" << P() << "++" << endl <<
+		"		}" << endl <<
+		"	}" << endl <<
+		"	}" << endl;
+}
@@ -0,0 +1,72 @@
+/*
+ *  Copyright 2006 Adrian Thurston <thurston@complang.org>
+ *            2026 Ragel contributors
+ */
+
+/*  This file is part of Ragel.
+ *
+ *  Ragel is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Ragel is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Ragel; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _GOSPLIT_H
+#define _GOSPLIT_H
+
+#include <iostream>
+#include "goipgoto.h"
+
+/*
+ * N-way split really fast goto-driven fsm. Each partition is a func literal
+ * in the exec block, so the Go compiler sees a number of smaller functions
+ * instead of one. A partition returns to the dispatch loop when control
+ * passes to a state in another partition.
+ */
+class GoSplitCodeGen
+	: public GoIpGotoCodeGen
+{
+public:
+	GoSplitCodeGen( ostream &out )
+		: GoIpGotoCodeGen(out), stateById(0) {}
+
+	bool ptOutLabelUsed;
+
+	std::ostream &PART_MAP();
+	std::ostream &EXIT_STATES( int partition );
+	std::ostream &PART_TRANS( int partition );
+	std::ostream &TRANS_GOTO( RedTransAp *trans, int level );
+	std::ostream &STATE_GOTOS( int partition, int level );
+	std::ostream &FINISH_CASES( int partition, int level );
+	std::ostream &PARTITION( int partition );
+
+	void GOTO( ostream &ret, int gotoDest, bool inFinish );
+	void CALL( ostream &ret, int callDest, int targState, bool inFinish );
+
+	virtual void writeData();
+	virtual void writeExec();
+
+protected:
+	/* A jump to a state from action code. Goes through the partition
+	 * boundary if the state has no label in the current partition. */
+	string STATE_JUMP( int targ );
+
+	bool anyInPartition( int partition );
+
+	void setLabelsNeeded( RedStateAp *fromState, RedTransAp *trans );
+	void setLabelsNeeded();
+
+	int currentPartition;
+	RedStateAp **stateById;
+};
+
+#endif
@@ -24,14 +24,113 @@
 #include "inputdata.h"
 #include "parsedata.h"
 #include "rlparse.h"
+#include "version.h"
 #include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include "dotcodegen.h"
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+/* Stands in for the output file name in line directives that point back into
+ * the output, while the output of a write statement is collected. */
+#define CACHE_LINE_MARKER "\001ragel-output\001"
+
 using std::cout;
 using std::cerr;
 using std::endl;
 using std::ios;
 
+/* Gets the contents of an input file, which are kept for the rest of the
+ * run. Regular files are mapped. Each file is read once however many times it
+ * is included. Returns null if the file cannot be opened. */
+InputFile *InputData::openInputFile( const char *fileName )
+{
+	/* Key on the resolved path so different names for a file share it. */
+#ifdef _WIN32
+	char *resolved = _fullpath( 0, fileName, 0 );
+#else
+	char *resolved = realpath( fileName, 0 );
+#endif
+	const char *key = resolved != 0 ? resolved : fileName;
+
+	InputFileMapEl *inputFileEl = inputFiles.find( key );
+	if ( inputFileEl != 0 ) {
+		free( resolved );
+		return inputFileEl->value;
+	}
+
+	char *data = 0;
+	long length = 0;
+
+#ifndef _WIN32
+	int fd = open( fileName, O_RDONLY );
+	if ( fd < 0 ) {
+		free( resolved );
+		return 0;
+	}
+
+	struct stat st;
+	if ( fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) && st.st_size > 0 ) {
+		void *mapped = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( mapped != MAP_FAILED ) {
+			data = (char*)mapped;
+			length = st.st_size;
+		}
+	}
+	close( fd );
+#endif
+
+	/* Anything that could not be mapped is read in whole. */
+	if ( data == 0 ) {
+		FILE *file = fopen( fileName, "rb" );
+		if ( file == 0 ) {
+			free( resolved );
+			return 0;
+		}
+
+		long allocated = 4096;
+		data = new char[allocated];
+		while ( true ) {
+			if ( length == allocated ) {
+				char *newData = new char[allocated * 2];
+				memcpy( newData, data, length );
+				delete[] data;
+				data = newData;
+				allocated *= 2;
+			}
+
+			size_t got = fread( data + length, 1, allocated - length, file );
+			if ( got == 0 )
+				break;
+			length += got;
+		}
+		fclose( file );
+	}
+
+	InputFile *inputFile = new InputFile( data, length );
+	inputFiles.insert( key, inputFile );
+	return inputFile;
+}
+
 /* Invoked by the parser when the root element is opened. */
 void InputData::cdDefaultFileName( const char *inputFile )
 {
@@ -115,7 +214,7 @@ void InputData::rustDefaultFileName( const char *inputFile )
 
 void InputData::makeOutputStream()
 {
-	if ( ! generateDot && ! generateXML ) {
+	if ( ! generateDot && ! generateXML && ! generateImage ) {
 		switch ( hostLang->lang ) {
 			case HostLang::C:
 			case HostLang::D:
@@ -210,16 +309,130 @@ void InputData::prepareMachineGen()
 
 		dotGenParser->pd->prepareMachineGen( gdEl );
 	}
+	else if ( numJobs > 1 ) {
+		/* Sections are independent, build them at once. */
+		prepareMachineGenParallel();
+	}
 	else {
 		/* No machine spec or machine name given. Generate everything. */
 		for ( ParserDict::Iter parser = parserDict; parser.lte(); parser++ ) {
 			ParseData *pd = parser->value->pd;
-			if ( pd->instanceList.length() > 0 )
+			if ( pd->instanceList.length() > 0 && !pd->fromCache )
 				pd->prepareMachineGen( 0 );
 		}
 	}
 }
 
+/* A section built by a worker thread. Its errors are held back and reported
+ * in section order once all sections are done. */
+struct SectionJob
+{
+	ParseData *pd;
+	std::ostringstream errors;
+	int errorCount;
+};
+
+#ifdef HAVE_PTHREAD_H
+
+/* Sections not yet taken by a worker. */
+struct SectionQueue
+{
+	SectionJob *jobs;
+	int numJobs;
+	int next;
+	pthread_mutex_t mutex;
+};
+
+static void *sectionWorker( void *arg )
+{
+	SectionQueue *queue = (SectionQueue*)arg;
+	while ( true ) {
+		pthread_mutex_lock( &queue->mutex );
+		int j = queue->next++;
+		pthread_mutex_unlock( &queue->mutex );
+
+		if ( j >= queue->numJobs )
+			break;
+
+		/* The error count and stream of this thread are its own. */
+		SectionJob &job = queue->jobs[j];
+		errorStream = &job.errors;
+		gblErrorCount = 0;
+		job.pd->prepareMachineGen( 0 );
+		job.errorCount = gblErrorCount;
+	}
+
+	errorStream = 0;
+	return 0;
+}
+
+#endif
+
+void InputData::prepareMachineGenParallel()
+{
+	int numSections = 0;
+	for ( ParserDict::Iter parser = parserDict; parser.lte(); parser++ ) {
+		ParseData *pd = parser->value->pd;
+		if ( pd->instanceList.length() > 0 && !pd->fromCache )
+			numSections += 1;
+	}
+
+	SectionJob *jobs = new SectionJob[numSections];
+	int j = 0;
+	for ( ParserDict::Iter parser = parserDict; parser.lte(); parser++ ) {
+		ParseData *pd = parser->value->pd;
+		if ( pd->instanceList.length() > 0 && !pd->fromCache ) {
+			jobs[j].pd = pd;
+			jobs[j].errorCount = 0;
+			j += 1;
+		}
+	}
+
+#ifdef HAVE_PTHREAD_H
+	SectionQueue queue;
+	queue.jobs = jobs;
+	queue.numJobs = numSections;
+	queue.next = 0;
+	pthread_mutex_init( &queue.mutex, 0 );
+
+	/* Machine construction recurses deeply, give workers a big stack. */
+	pthread_attr_t attr;
+	pthread_attr_init( &attr );
+	pthread_attr_setstacksize( &attr, 64 * 1024 * 1024 );
+
+	int numThreads = numJobs < numSections ? numJobs : numSections;
+	pthread_t *threads = new pthread_t[numThreads];
+	int started = 0;
+	while ( started < numThreads && 
+			pthread_create( &threads[started], &attr, sectionWorker, &queue ) == 0 )
+		started += 1;
+
+	/* If no thread could be started, do the work here. */
+	if ( started == 0 )
+		sectionWorker( &queue );
+
+	for ( int t = 0; t < started; t++ )
+		pthread_join( threads[t], 0 );
+
+	delete[] threads;
+	pthread_attr_destroy( &attr );
+	pthread_mutex_destroy( &queue.mutex );
+#else
+	/* No threads, build the sections one after another. Errors go straight
+	 * out and are counted as usual. */
+	for ( j = 0; j < numSections; j++ )
+		jobs[j].pd->prepareMachineGen( 0 );
+#endif
+
+	/* Report errors as the serial build would. */
+	for ( j = 0; j < numSections; j++ ) {
+		cerr << jobs[j].errors.str();
+		gblErrorCount += jobs[j].errorCount;
+	}
+
+	delete[] jobs;
+}
+
 void InputData::generateReduced()
 {
 	if ( generateDot )
@@ -227,7 +440,7 @@ void InputData::generateReduced()
 	else {
 		for ( ParserDict::Iter parser = parserDict; parser.lte(); parser++ ) {
 			ParseData *pd = parser->value->pd;
-			if ( pd->instanceList.length() > 0 )
+			if ( pd->instanceList.length() > 0 && !pd->fromCache )
 				pd->generateReduced( *this );
 		}
 	}
@@ -251,7 +464,7 @@ void InputData::verifyWritesHaveData()
 	if ( !generateXML && !generateDot ) {
 		for ( InputItemList::Iter ii = inputItems; ii.lte(); ii++ ) {
 			if ( ii->type == InputItem::Write ) {
-				if ( ii->pd->cgd == 0 )
+				if ( ii->pd->cgd == 0 && !ii->pd->fromCache )
 					error( ii->loc ) << "no machine instantiations to write" << endl;
 			}
 		}
@@ -262,15 +475,37 @@ void InputData::writeOutput()
 {
 	if ( generateXML )
 		writeXML( *outStream );
+	else if ( generateImage )
+		writeImage( *outStream );
 	else if ( generateDot )
 		static_cast<GraphvizDotGen*>(dotGenParser->pd->cgd)->writeDotFile();
 	else {
+		bool caching = cacheEnabled();
+		writeFilePrelude( *outStream );
 		for ( InputItemList::Iter ii = inputItems; ii.lte(); ii++ ) {
-			if ( ii->type == InputItem::Write ) {
+			if ( ii->type == InputItem::Write && ii->pd->fromCache )
+				writeCached( ii->cached, ii->cachedLines );
+			else if ( ii->type == InputItem::Write ) {
 				CodeGenData *cgd = ii->pd->cgd;
 				::keyOps = &cgd->thisKeyOps;
 
-				cgd->writeStatement( ii->loc, ii->writeArgs.length()-1, ii->writeArgs.data );
+				double start = wallClock();
+				if ( caching ) {
+					/* Collect the output so it can be stored, then copy it
+					 * out the same way it would come from the cache. */
+					cache_filter capture( CACHE_LINE_MARKER );
+					std::streambuf *prev = outStream->rdbuf( &capture );
+					cgd->writeStatement( ii->loc, ii->writeArgs.length()-1, ii->writeArgs.data );
+					outStream->rdbuf( prev );
+
+					ii->cached = capture.data;
+					ii->cachedLines = capture.line;
+					writeCached( ii->cached, ii->cachedLines );
+				}
+				else {
+					cgd->writeStatement( ii->loc, ii->writeArgs.length()-1, ii->writeArgs.data );
+				}
+				ii->pd->writeTime += wallClock() - start;
 			}
 			else {
 				*outStream << '\n';
@@ -278,6 +513,226 @@ void InputData::writeOutput()
 				*outStream << ii->data.str();
 			}
 		}
+
+		if ( caching )
+			storeCache();
 	}
 }
 
+/* The cache file of a section is named by a hash of the options, the tokens
+ * of the section and its write statements. */
+std::string InputData::cacheFileName( ParseData *pd )
+{
+	unsigned long long h = fnvHash( optionsHash, pd->sectionName );
+	h = fnvHash( h, &pd->sourceHash, sizeof(pd->sourceHash) );
+	for ( InputItemList::Iter ii = inputItems; ii.lte(); ii++ ) {
+		if ( ii->type == InputItem::Write && ii->pd == pd ) {
+			h = fnvHash( h, ii->loc.fileName );
+			h = fnvHash( h, &ii->loc.line, sizeof(ii->loc.line) );
+			for ( int a = 0; a < ii->writeArgs.length()-1; a++ )
+				h = fnvHash( h, ii->writeArgs[a] );
+		}
+	}
+
+	char name[32];
+	sprintf( name, "/%016llx.rlc", h );
+	return std::string( cacheDir ) + name;
+}
+
+void InputData::hashCacheOptions( int argc, const char **argv )
+{
+	optionsHash = fnvHash( FNV_OFFSET, VERSION );
+	for ( int i = 1; i < argc; i++ ) {
+		if ( argv[i] != inputFileName && strncmp( argv[i], "--cache-dir", 11 ) != 0 )
+			optionsHash = fnvHash( optionsHash, argv[i] );
+	}
+
+	/* The profile can change without the options changing. */
+	if ( profileFileName != 0 ) {
+		InputFile *profile = openInputFile( profileFileName );
+		if ( profile != 0 )
+			optionsHash = fnvHash( optionsHash, profile->data, profile->length );
+	}
+}
+
+/* The cache holds the output of write statements only. Graphviz, XML and
+ * image output, a subset of the machines, and the split style, which writes
+ * files of its own, are always generated. Sections loaded from an image have
+ * no tokens to key on. */
+bool InputData::cacheEnabled()
+{
+	return cacheDir != 0 && !generateDot && !generateXML && !generateImage &&
+			!imageInput && machineSpec == 0 && machineName == 0 && codeStyle != GenSplit;
+}
+
+/* Look for the output of each section in the cache. Sections found there
+ * are not built. */
+void InputData::loadCache()
+{
+	if ( !cacheEnabled() )
+		return;
+
+	for ( ParserDict::Iter parser = parserDict; parser.lte(); parser++ ) {
+		ParseData *pd = parser->value->pd;
+		if ( pd->instanceList.length() == 0 )
+			continue;
+
+		std::ifstream in( cacheFileName( pd ).c_str(), ios::in|ios::binary );
+		if ( !in.is_open() )
+			continue;
+
+		/* A header, the number of write statements, then for each one the
+		 * length and line count of its output followed by the output. */
+		std::string header;
+		long count = -1;
+		std::getline( in, header );
+		in >> count;
+
+		bool ok = header == "ragel-cache" && in.good();
+		InputItemList::Iter ii = inputItems;
+		for ( ; ok && ii.lte(); ii++ ) {
+			if ( ii->type == InputItem::Write && ii->pd == pd ) {
+				long len = -1;
+				in >> len >> ii->cachedLines;
+				in.get();
+				if ( count-- <= 0 || len < 0 || !in.good() )
+					ok = false;
+				else {
+					ii->cached.resize( len );
+					if ( len > 0 ) {
+						in.read( &ii->cached[0], len );
+						ok = in.gcount() == len;
+					}
+				}
+			}
+		}
+
+		pd->fromCache = ok && count == 0;
+	}
+}
+
+/* Store the output of the sections just built. The file is written under a
+ * temporary name and moved into place so a reader never sees part of it. */
+void InputData::storeCache()
+{
+#ifdef _WIN32
+	_mkdir( cacheDir );
+#else
+	mkdir( cacheDir, 0777 );
+#endif
+
+	for ( ParserDict::Iter parser = parserDict; parser.lte(); parser++ ) {
+		ParseData *pd = parser->value->pd;
+		if ( pd->instanceList.length() == 0 || pd->fromCache )
+			continue;
+
+		long count = 0;
+		for ( InputItemList::Iter ii = inputItems; ii.lte(); ii++ ) {
+			if ( ii->type == InputItem::Write && ii->pd == pd )
+				count += 1;
+		}
+
+		std::string fileName = cacheFileName( pd );
+		std::string tmpName = fileName + ".tmp";
+		std::ofstream out( tmpName.c_str(), ios::out|ios::trunc|ios::binary );
+		if ( !out.is_open() )
+			continue;
+
+		out << "ragel-cache\n" << count << '\n';
+		for ( InputItemList::Iter ii = inputItems; ii.lte(); ii++ ) {
+			if ( ii->type == InputItem::Write && ii->pd == pd ) {
+				out << ii->cached.size() << ' ' << ii->cachedLines << '\n';
+				out.write( ii->cached.data(), ii->cached.size() );
+			}
+		}
+		out.close();
+
+		if ( out.fail() || rename( tmpName.c_str(), fileName.c_str() ) != 0 )
+			remove( tmpName.c_str() );
+	}
+}
+
+/* Copy the output of a write statement into the output file, redoing the
+ * line directives that point back into the output. The output filter does not
+ * count every newline, so its count is advanced by what was counted when the
+ * output was collected, rather than by what is copied here. */
+void InputData::writeCached( const std::string &data, int lines )
+{
+	int startLine = outFilter->line;
+	std::string::size_type pos = 0;
+	while ( true ) {
+		std::string::size_type mark = data.find( CACHE_LINE_MARKER, pos );
+		if ( mark == std::string::npos )
+			break;
+
+		/* The directive takes up the whole line. */
+		std::string::size_type start = data.rfind( '\n', mark );
+		start = start == std::string::npos || start < pos ? pos : start + 1;
+		std::string::size_type end = data.find( '\n', mark );
+		end = end == std::string::npos ? data.size() : end + 1;
+
+		/* The first number on the line is the relative line. */
+		std::string::size_type digit = data.find_first_of( "0123456789", start );
+		int relLine = atoi( data.c_str() + digit );
+
+		outStream->write( data.data() + pos, start - pos );
+		lineDirective( *outStream, outFilter->fileName, startLine + relLine );
+		pos = end;
+	}
+
+	outStream->write( data.data() + pos, data.size() - pos );
+	outFilter->line = startLine + lines;
+}
+
+/* Writes a string as a JSON string literal. */
+void jsonString( std::ostream &out, const char *str )
+{
+	out << '"';
+	for ( const char *c = str; *c != 0; c++ ) {
+		if ( *c == '"' || *c == '\\' )
+			out << '\\' << *c;
+		else if ( (unsigned char)*c < 0x20 )
+			out << "\\u00" << std::hex << std::setw(2) << std::setfill('0') << 
+					(int)*c << std::dec << std::setfill(' ');
+		else
+			out << *c;
+	}
+	out << '"';
+}
+
+/* The -s report goes to stderr, with one entry for each section that was
+ * built. */
+void InputData::writeStatistics()
+{
+	bool json = statsFormat == StatsJSON;
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(6);
+
+	if ( json ) {
+		out << "{\n\t\"file\": ";
+		jsonString( out, inputFileName );
+		out << ",\n"
+			"\t\"parse_seconds\": " << parseTime << ",\n"
+			"\t\"machines\": [";
+	}
+	else {
+		out << "input file: " << inputFileName << endl;
+		out << "parse time: " << parseTime << endl << endl;
+	}
+
+	bool first = true;
+	for ( ParserDict::Iter parser = parserDict; parser.lte(); parser++ ) {
+		ParseData *pd = parser->value->pd;
+		if ( pd->sectionGraph != 0 ) {
+			if ( json )
+				out << ( first ? "\n" : ",\n" );
+			pd->writeStatistics( out, json );
+			first = false;
+		}
+	}
+
+	if ( json )
+		out << "\n\t]\n}\n";
+
+	cerr << out.str();
+}
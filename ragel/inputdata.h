@@ -42,6 +42,11 @@ struct InputItem
 	ParseData *pd;
 	Vector<char *> writeArgs;
 
+	/* Output of a write statement when the output cache is in use, and the
+	 * number of lines the output filter counts for it. */
+	std::string cached;
+	int cachedLines;
+
 	InputLoc loc;
 
 	InputItem *prev, *next;
@@ -55,6 +60,20 @@ typedef DList<Parser> ParserList;
 typedef DList<InputItem> InputItemList;
 typedef Vector<const char *> ArgsVector;
 
+/* The contents of an input file, mapped into memory or read in whole. Every
+ * include of a file shares the one copy. */
+struct InputFile
+{
+	InputFile( char *data, long length )
+		: data(data), length(length) {}
+
+	char *data;
+	long length;
+};
+
+typedef AvlMap<const char*, InputFile*, CmpStr> InputFileMap;
+typedef AvlMapEl<const char*, InputFile*> InputFileMapEl;
+
 struct InputData
 {
 	InputData() : 
@@ -63,7 +82,9 @@ struct InputData
 		inStream(0),
 		outStream(0),
 		outFilter(0),
-		dotGenParser(0)
+		dotGenParser(0),
+		parseTime(0),
+		optionsHash(FNV_OFFSET)
 	{}
 
 	/* The name of the root section, this does not change during an include. */
@@ -83,6 +104,17 @@ struct InputData
 
 	ArgsVector includePaths;
 
+	/* Input files by resolved path. */
+	InputFileMap inputFiles;
+
+	/* Time spent scanning and parsing, for the statistics. */
+	double parseTime;
+
+	/* Hash of the version and the options, the part of the cache key shared
+	 * by all sections. */
+	unsigned long long optionsHash;
+
+	InputFile *openInputFile( const char *fileName );
 	void verifyWritesHaveData();
 
 	void writeOutput();
@@ -90,6 +122,7 @@ struct InputData
 	void openOutput();
 	void generateReduced();
 	void prepareMachineGen();
+	void prepareMachineGenParallel();
 	void terminateAllParsers();
 
 	void cdDefaultFileName( const char *inputFile );
@@ -102,6 +135,16 @@ struct InputData
 
 	void writeLanguage( std::ostream &out );
 	void writeXML( std::ostream &out );
+	void writeImage( std::ostream &out );
+	void loadImage();
+	void writeStatistics();
+
+	void hashCacheOptions( int argc, const char **argv );
+	bool cacheEnabled();
+	std::string cacheFileName( ParseData *pd );
+	void loadCache();
+	void storeCache();
+	void writeCached( const std::string &data, int lines );
 };
 
 #endif
@@ -34,6 +34,13 @@
  * (should be multiple of IALL). */
 #define SAIIC 8184
 
+/* Characters in each packed string. Every character takes at most three
+ * bytes in the class file, which allows 65535 for a string constant. */
+#define PACK_STRING_LEN 20000
+
+/* Characters written on each line of a packed string. */
+#define PACK_LINE_LEN 64
+
 #define _resume    1
 #define _again     2
 #define _eof_trans 3
@@ -857,6 +864,9 @@ void JavaTabCodeGen::writeError()
 
 void JavaTabCodeGen::writeData()
 {
+	if ( stringTables )
+		UNPACK_FUNC();
+
 	/* If there are any transtion functions then output the array. If there
 	 * are none, don't bother emitting an empty array that won't be used. */
 	if ( redFsm->anyActions() ) {
@@ -1175,6 +1185,11 @@ std::ostream &JavaTabCodeGen::OPEN_ARRAY( string type, string name )
 	item_count = 0;
 	div_count = 1;
 
+	if ( stringTables ) {
+		packed_items.empty();
+		return out;
+	}
+
 	out <<  "private static " << type << "[] init_" << name << "_0()\n"
 		"{\n\t"
 		"return new " << type << " [] {\n\t";
@@ -1185,6 +1200,11 @@ std::ostream &JavaTabCodeGen::ARRAY_ITEM( string item, bool last )
 {
 	item_count++;
 
+	if ( stringTables ) {
+		packed_items.append( strtol( item.c_str(), 0, 10 ) );
+		return out;
+	}
+
 	out << setw(5) << setiosflags(ios::right) << item;
 	
 	if ( !last ) {
@@ -1206,6 +1226,11 @@ std::ostream &JavaTabCodeGen::ARRAY_ITEM( string item, bool last )
 
 std::ostream &JavaTabCodeGen::CLOSE_ARRAY()
 {
+	if ( stringTables ) {
+		PACKED_ARRAY();
+		return out;
+	}
+
 	out << "\n\t};\n}\n\n";
 
 	if (item_count < SAIIC) {
@@ -1235,6 +1260,130 @@ std::ostream &JavaTabCodeGen::CLOSE_ARRAY()
 }
 
 
+/* Appends a number to a packed string in 15 bit pieces, lowest first. The top
+ * bit of a character is set when more pieces follow. */
+static void packNumber( Vector<unsigned int> &chars, unsigned long value )
+{
+	while ( value >= 0x8000 ) {
+		chars.append( 0x8000 | ( value & 0x7fff ) );
+		value >>= 15;
+	}
+	chars.append( value );
+}
+
+/* Writes a character of a Java string literal. Unicode escapes are replaced
+ * before the source is tokenized, so line ends, quotes and backslashes must
+ * use octal escapes. */
+static void writeJavaChar( ostream &out, unsigned int c )
+{
+	char buf[16];
+	if ( c >= 0x20 && c < 0x7f && c != '"' && c != '\\' )
+		out << (char)c;
+	else if ( c < 0x100 ) {
+		sprintf( buf, "\\%03o", c );
+		out << buf;
+	}
+	else {
+		sprintf( buf, "\\u%04x", c );
+		out << buf;
+	}
+}
+
+/* Writes the array as runs of equal items packed into strings, and a method
+ * that unpacks them when the class is initialized. A run is its length
+ * followed by the item, zigzag encoded so small negative numbers stay
+ * small. */
+void JavaTabCodeGen::PACKED_ARRAY()
+{
+	Vector<unsigned int> chars;
+	Vector<long> stringEnds;
+	for ( long i = 0; i < packed_items.length(); ) {
+		long run = 1;
+		while ( i + run < packed_items.length() && 
+				packed_items[i + run] == packed_items[i] )
+			run += 1;
+
+		/* Runs are not split across strings. */
+		if ( chars.length() - ( stringEnds.length() > 0 ? 
+				stringEnds[stringEnds.length()-1] : 0 ) > PACK_STRING_LEN )
+			stringEnds.append( chars.length() );
+
+		int item = (int) packed_items[i];
+		packNumber( chars, run );
+		packNumber( chars, ( (unsigned int) item << 1 ) ^ (unsigned int) ( item >> 31 ) );
+		i += run;
+	}
+	stringEnds.append( chars.length() );
+
+	out << "private static " << array_type << "[] init_" << array_name << "_0()\n"
+		"{\n"
+		"\tString[] packed = {\n";
+
+	long start = 0;
+	for ( Vector<long>::Iter end = stringEnds; end.lte(); end++ ) {
+		out << "\t\t\"";
+		for ( long c = start; c < *end; c++ ) {
+			if ( c > start && ( c - start ) % PACK_LINE_LEN == 0 )
+				out << "\" +\n\t\t\"";
+			writeJavaChar( out, chars[c] );
+		}
+		out << "\"" << ( end.last() ? "" : "," ) << "\n";
+		start = *end;
+	}
+
+	out << "\t};\n";
+
+	if ( array_type == "int" )
+		out << "\treturn " << UNPACK() << "( packed, " << item_count << " );\n";
+	else {
+		out <<
+			"\tint[] unpacked = " << UNPACK() << "( packed, " << item_count << " );\n"
+			"\t" << array_type << "[] data = new " << array_type << "[" << item_count << "];\n"
+			"\tfor ( int i = 0; i < " << item_count << "; i++ )\n"
+			"\t\tdata[i] = (" << array_type << ") unpacked[i];\n"
+			"\treturn data;\n";
+	}
+
+	out << "}\n"
+		"\n"
+		"private static final " << array_type << " " << array_name << 
+			"[] = init_" << array_name << "_0();\n"
+		"\n";
+}
+
+void JavaTabCodeGen::UNPACK_FUNC()
+{
+	out <<
+		"private static int[] " << UNPACK() << "( String[] packed, int length )\n"
+		"{\n"
+		"\tint[] data = new int[length];\n"
+		"\tint pos = 0;\n"
+		"\tfor ( int s = 0; s < packed.length; s++ ) {\n"
+		"\t\tString str = packed[s];\n"
+		"\t\tint i = 0;\n"
+		"\t\twhile ( i < str.length() ) {\n"
+		"\t\t\tint run = 0, item = 0, shift = 0, c;\n"
+		"\t\t\tdo {\n"
+		"\t\t\t\tc = str.charAt( i++ );\n"
+		"\t\t\t\trun |= ( c & 0x7fff ) << shift;\n"
+		"\t\t\t\tshift += 15;\n"
+		"\t\t\t} while ( ( c & 0x8000 ) != 0 );\n"
+		"\t\t\tshift = 0;\n"
+		"\t\t\tdo {\n"
+		"\t\t\t\tc = str.charAt( i++ );\n"
+		"\t\t\t\titem |= ( c & 0x7fff ) << shift;\n"
+		"\t\t\t\tshift += 15;\n"
+		"\t\t\t} while ( ( c & 0x8000 ) != 0 );\n"
+		"\t\t\titem = ( item >>> 1 ) ^ -( item & 1 );\n"
+		"\t\t\twhile ( run-- > 0 )\n"
+		"\t\t\t\tdata[pos++] = item;\n"
+		"\t\t}\n"
+		"\t}\n"
+		"\treturn data;\n"
+		"}\n"
+		"\n";
+}
+
 std::ostream &JavaTabCodeGen::STATIC_VAR( string type, string name )
 {
 	out << "static final " << type << " " << name;
@@ -1652,7 +1801,10 @@ void JavaTabCodeGen::finishRagelDef()
 	redFsm->chooseDefaultSpan();
 		
 	/* Maybe do flat expand, otherwise choose single. */
-	redFsm->chooseSingle();
+	if ( codeStyle == GenFlat || codeStyle == GenFFlat )
+		redFsm->makeFlat();
+	else
+		redFsm->chooseSingle();
 
 	/* If any errors have occured in the input file then don't write anything. */
 	if ( gblErrorCount > 0 )
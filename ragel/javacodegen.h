@@ -38,7 +38,10 @@ using std::ostream;
 struct JavaTabCodeGen : public CodeGenData
 {
 	JavaTabCodeGen( ostream &out ) : 
-		CodeGenData(out) {}
+		CodeGenData(out), stringTables(false) {}
+
+	/* Write the tables as packed String constants. */
+	bool stringTables;
 
 	std::ostream &TO_STATE_ACTION_SWITCH();
 	std::ostream &FROM_STATE_ACTION_SWITCH();
@@ -86,10 +89,10 @@ struct JavaTabCodeGen : public CodeGenData
 	void NEXT( ostream &ret, int nextDest, bool inFinish );
 	void NEXT_EXPR( ostream &ret, GenInlineItem *ilItem, bool inFinish );
 
-	int TO_STATE_ACTION( RedStateAp *state );
-	int FROM_STATE_ACTION( RedStateAp *state );
-	int EOF_ACTION( RedStateAp *state );
-	int TRANS_ACTION( RedTransAp *trans );
+	virtual int TO_STATE_ACTION( RedStateAp *state );
+	virtual int FROM_STATE_ACTION( RedStateAp *state );
+	virtual int EOF_ACTION( RedStateAp *state );
+	virtual int TRANS_ACTION( RedTransAp *trans );
 
 	/* Determine if we should use indicies. */
 	void calcIndexSize();
@@ -100,7 +103,12 @@ private:
 	int item_count;
 	int div_count;
 
+	/* Items of the array being written, for packing into strings. */
+	Vector<long> packed_items;
+	void PACKED_ARRAY();
+
 public:
+	void UNPACK_FUNC();
 
 	virtual string NULL_ITEM();
 	virtual ostream &OPEN_ARRAY( string type, string name );
@@ -161,6 +169,7 @@ public:
 	string ET() { return "_" + DATA_PREFIX() + "eof_trans"; }
 	string SP() { return "_" + DATA_PREFIX() + "key_spans"; }
 	string CSP() { return "_" + DATA_PREFIX() + "cond_key_spans"; }
+	string UNPACK() { return "_" + DATA_PREFIX() + "unpack"; }
 	string START() { return DATA_PREFIX() + "start"; }
 	string ERROR() { return DATA_PREFIX() + "error"; }
 	string FIRST_FINAL() { return DATA_PREFIX() + "first_final"; }
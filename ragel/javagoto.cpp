@@ -0,0 +1,513 @@
+/*
+ *  Copyright 2006-2007 Adrian Thurston <thurston@complang.org>
+ *            2007 Colin Fleming <colin.fleming@caverock.com>
+ *            2026 Ragel contributors
+ */
+
+/*  This file is part of Ragel.
+ *
+ *  Ragel is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Ragel is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Ragel; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ragel.h"
+#include "javagoto.h"
+#include "redfsm.h"
+#include "gendata.h"
+#include <sstream>
+
+using std::ostringstream;
+
+#define _resume    1
+#define _again     2
+#define _eof_trans 3
+#define _test_eof  4
+#define _out       5
+
+/* Estimated bytecode size of each method locating transitions. HotSpot does
+ * not compile methods of more than 8000 bytes. */
+#define TRANS_METHOD_SIZE 6000
+
+string JavaGotoCodeGen::TM( int method )
+{
+	ostringstream ret;
+	ret << "_" << DATA_PREFIX() << "trans_" << method;
+	return ret.str();
+}
+
+/* Rough bytecode size of a state's case, for splitting the methods. */
+int JavaGotoCodeGen::stateCost( RedStateAp *state )
+{
+	if ( state == redFsm->errState )
+		return 0;
+	return 24 + 12 * state->outSingle.length() + 20 * state->outRange.length();
+}
+
+/* Places runs of consecutive states in the same method. */
+void JavaGotoCodeGen::assignTransMethods()
+{
+	transMethod.empty();
+	numTransMethods = 0;
+
+	int size = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		int cost = stateCost( st );
+		if ( size > 0 && size + cost > TRANS_METHOD_SIZE ) {
+			numTransMethods += 1;
+			size = 0;
+		}
+		transMethod.append( numTransMethods );
+		size += cost;
+	}
+	numTransMethods += 1;
+}
+
+/* Binary search of the ranges, returning the transition found. Returns true
+ * if every path through the code returns. */
+bool JavaGotoCodeGen::emitRangeBSearch( RedStateAp *state, int level, int low, int high )
+{
+	/* Get the mid position, staying on the lower end of the range. */
+	int mid = (low + high) >> 1;
+	RedTransEl *data = state->outRange.data;
+
+	/* Determine if we need to look higher or lower. */
+	bool anyLower = mid > low;
+	bool anyHigher = mid < high;
+
+	/* Determine if the keys at mid are the limits of the alphabet. */
+	bool limitLow = data[mid].lowKey == keyOps->minKey;
+	bool limitHigh = data[mid].highKey == keyOps->maxKey;
+
+	if ( anyLower && anyHigher ) {
+		/* Can go lower and higher than mid. */
+		out << TABS(level) << "if ( _key < " << KEY(data[mid].lowKey) << " ) {\n";
+		bool lower = emitRangeBSearch( state, level+1, low, mid-1 );
+		out << TABS(level) << "} else if ( _key > " << KEY(data[mid].highKey) << " ) {\n";
+		bool higher = emitRangeBSearch( state, level+1, mid+1, high );
+		out << TABS(level) << "} else\n";
+		out << TABS(level+1) << "return " << data[mid].value->id << ";\n";
+		return lower && higher;
+	}
+	else if ( anyLower && !anyHigher ) {
+		/* Can go lower than mid but not higher. */
+		out << TABS(level) << "if ( _key < " << KEY(data[mid].lowKey) << " ) {\n";
+		bool lower = emitRangeBSearch( state, level+1, low, mid-1 );
+
+		/* if the higher is the highest in the alphabet then there is no
+		 * sense testing it. */
+		if ( limitHigh ) {
+			out << TABS(level) << "} else\n";
+			out << TABS(level+1) << "return " << data[mid].value->id << ";\n";
+			return lower;
+		}
+
+		out << TABS(level) << "} else if ( _key <= " << KEY(data[mid].highKey) << " )\n";
+		out << TABS(level+1) << "return " << data[mid].value->id << ";\n";
+		return false;
+	}
+	else if ( !anyLower && anyHigher ) {
+		/* Can go higher than mid but not lower. */
+		out << TABS(level) << "if ( _key > " << KEY(data[mid].highKey) << " ) {\n";
+		bool higher = emitRangeBSearch( state, level+1, mid+1, high );
+
+		/* If the lower end is the lowest in the alphabet then there is no
+		 * sense testing it. */
+		if ( limitLow ) {
+			out << TABS(level) << "} else\n";
+			out << TABS(level+1) << "return " << data[mid].value->id << ";\n";
+			return higher;
+		}
+
+		out << TABS(level) << "} else if ( _key >= " << KEY(data[mid].lowKey) << " )\n";
+		out << TABS(level+1) << "return " << data[mid].value->id << ";\n";
+		return false;
+	}
+
+	/* Cannot go higher or lower than mid. It's mid or bust. What tests to do
+	 * depends on limits of alphabet. */
+	if ( limitLow && limitHigh ) {
+		out << TABS(level) << "return " << data[mid].value->id << ";\n";
+		return true;
+	}
+
+	out << TABS(level) << "if ( ";
+	if ( !limitLow )
+		out << KEY(data[mid].lowKey) << " <= _key";
+	if ( !limitLow && !limitHigh )
+		out << " && ";
+	if ( !limitHigh )
+		out << "_key <= " << KEY(data[mid].highKey);
+	out << " )\n";
+	out << TABS(level+1) << "return " << data[mid].value->id << ";\n";
+	return false;
+}
+
+/* The case of a state in its transition method. Singles are left to a
+ * switch, which the JVM turns into a table or a search, and ranges to a
+ * binary search. */
+void JavaGotoCodeGen::STATE_TRANS( RedStateAp *state )
+{
+	out << "	case " << state->id << ":\n";
+
+	if ( state->outSingle.length() > 0 ) {
+		out << "		switch ( _key ) {\n";
+		for ( RedTransList::Iter stel = state->outSingle; stel.lte(); stel++ ) {
+			out << "		case " << KEY(stel->lowKey) << ": return " <<
+					stel->value->id << ";\n";
+		}
+		out << "		}\n";
+	}
+
+	bool returns = false;
+	if ( state->outRange.length() > 0 )
+		returns = emitRangeBSearch( state, 2, 0, state->outRange.length() - 1 );
+
+	if ( !returns ) {
+		if ( state->defTrans != 0 )
+			out << "		return " << state->defTrans->id << ";\n";
+		else
+			out << "		break;\n";
+	}
+}
+
+void JavaGotoCodeGen::TRANS_METHODS()
+{
+	RedStateList::Iter st = redFsm->stateList;
+	for ( int method = 0; method < numTransMethods; method++ ) {
+		out <<
+			"private static int " << TM(method) << "( int _cs, int _key )\n"
+			"{\n"
+			"	switch ( _cs ) {\n";
+
+		for ( ; st.lte() && transMethod[st->id] == method; st++ ) {
+			if ( st != redFsm->errState )
+				STATE_TRANS( st );
+		}
+
+		/* Not reached, every state takes some transition. */
+		out <<
+			"	}\n"
+			"	return -1;\n"
+			"}\n"
+			"\n";
+	}
+}
+
+std::ostream &JavaGotoCodeGen::TRANS_METHOD_MAP()
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ )
+		ARRAY_ITEM( INT(transMethod[st->id]), st.last() );
+	return out;
+}
+
+void JavaGotoCodeGen::LOCATE_TRANS()
+{
+	if ( numTransMethods == 1 ) {
+		out << "	_trans = " << TM(0) << "( " << vCS() << ", " <<
+				GET_WIDE_KEY() << " );\n";
+	}
+	else {
+		out << "	switch ( " << PM() << "[" << vCS() << "] ) {\n";
+		for ( int method = 0; method < numTransMethods; method++ ) {
+			out << "	case " << method << ": _trans = " << TM(method) << "( " <<
+					vCS() << ", " << GET_WIDE_KEY() << " ); break;\n";
+		}
+		out << "	}\n";
+	}
+	out << "\n";
+}
+
+void JavaGotoCodeGen::finishRagelDef()
+{
+	JavaTabCodeGen::finishRagelDef();
+
+	if ( gblErrorCount == 0 )
+		assignTransMethods();
+}
+
+void JavaGotoCodeGen::writeData()
+{
+	if ( stringTables )
+		UNPACK_FUNC();
+
+	/* If there are any transtion functions then output the array. If there
+	 * are none, don't bother emitting an empty array that won't be used. */
+	if ( redFsm->anyActions() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxActArrItem), A() );
+		ACTIONS_ARRAY();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( redFsm->anyConditions() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxCondOffset), CO() );
+		COND_OFFSETS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxCondLen), CL() );
+		COND_LENS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( WIDE_ALPH_TYPE(), CK() );
+		COND_KEYS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxCondSpaceId), C() );
+		COND_SPACES();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( numTransMethods > 1 ) {
+		OPEN_ARRAY( ARRAY_TYPE(numTransMethods), PM() );
+		TRANS_METHOD_MAP();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	TRANS_METHODS();
+
+	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxState), TT() );
+	TRANS_TARGS_WI();
+	CLOSE_ARRAY() <<
+	"\n";
+
+	if ( redFsm->anyActions() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxActionLoc), TA() );
+		TRANS_ACTIONS_WI();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( redFsm->anyToStateActions() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxActionLoc), TSA() );
+		TO_STATE_ACTIONS();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( redFsm->anyFromStateActions() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxActionLoc), FSA() );
+		FROM_STATE_ACTIONS();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( redFsm->anyEofActions() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxActionLoc), EA() );
+		EOF_ACTIONS();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( redFsm->anyEofTrans() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxIndex), ET() );
+		EOF_TRANS();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( redFsm->startState != 0 )
+		STATIC_VAR( "int", START() ) << " = " << START_STATE_ID() << ";\n";
+
+	if ( !noFinal )
+		STATIC_VAR( "int" , FIRST_FINAL() ) << " = " << FIRST_FINAL_STATE() << ";\n";
+
+	if ( !noError )
+		STATIC_VAR( "int", ERROR() ) << " = " << ERROR_STATE() << ";\n";
+
+	out << "\n";
+
+	if ( entryPointNames.length() > 0 ) {
+		for ( EntryNameVect::Iter en = entryPointNames; en.lte(); en++ ) {
+			STATIC_VAR( "int", DATA_PREFIX() + "en_" + *en ) <<
+					" = " << entryPointIds[en.pos()] << ";\n";
+		}
+		out << "\n";
+	}
+}
+
+void JavaGotoCodeGen::writeExec()
+{
+	out <<
+		"	{\n"
+		"	int _trans = 0;\n";
+
+	if ( redFsm->anyRegCurStateRef() )
+		out << "	int _ps;\n";
+
+	if ( redFsm->anyConditions() ) {
+		out <<
+			"	int _widec;\n"
+			"	int _klen;\n"
+			"	int _keys;\n";
+	}
+
+	if ( redFsm->anyToStateActions() || redFsm->anyRegActions() ||
+			redFsm->anyFromStateActions() )
+	{
+		out <<
+			"	int _acts;\n"
+			"	int _nacts;\n";
+	}
+
+	out <<
+		"	int _goto_targ = 0;\n"
+		"\n";
+
+	out <<
+		"	_goto: while (true) {\n"
+		"	switch ( _goto_targ ) {\n"
+		"	case 0:\n";
+
+	if ( !noEnd ) {
+		out <<
+			"	if ( " << P() << " == " << PE() << " ) {\n"
+			"		_goto_targ = " << _test_eof << ";\n"
+			"		continue _goto;\n"
+			"	}\n";
+	}
+
+	if ( redFsm->errState != 0 ) {
+		out <<
+			"	if ( " << vCS() << " == " << redFsm->errState->id << " ) {\n"
+			"		_goto_targ = " << _out << ";\n"
+			"		continue _goto;\n"
+			"	}\n";
+	}
+
+	out << "case " << _resume << ":\n";
+
+	if ( redFsm->anyFromStateActions() ) {
+		out <<
+			"	_acts = " << FSA() << "[" << vCS() << "]" << ";\n"
+			"	_nacts = " << CAST("int") << " " << A() << "[_acts++];\n"
+			"	while ( _nacts-- > 0 ) {\n"
+			"		switch ( " << A() << "[_acts++] ) {\n";
+			FROM_STATE_ACTION_SWITCH() <<
+			"		}\n"
+			"	}\n"
+			"\n";
+	}
+
+	if ( redFsm->anyConditions() )
+		COND_TRANSLATE();
+
+	LOCATE_TRANS();
+
+	if ( redFsm->anyEofTrans() )
+		out << "case " << _eof_trans << ":\n";
+
+	if ( redFsm->anyRegCurStateRef() )
+		out << "	_ps = " << vCS() << ";\n";
+
+	out <<
+		"	" << vCS() << " = " << TT() << "[_trans];\n"
+		"\n";
+
+	if ( redFsm->anyRegActions() ) {
+		out <<
+			"	if ( " << TA() << "[_trans] != 0 ) {\n"
+			"		_acts = " <<  TA() << "[_trans]" << ";\n"
+			"		_nacts = " << CAST("int") << " " <<  A() << "[_acts++];\n"
+			"		while ( _nacts-- > 0 )\n	{\n"
+			"			switch ( " << A() << "[_acts++] )\n"
+			"			{\n";
+			ACTION_SWITCH() <<
+			"			}\n"
+			"		}\n"
+			"	}\n"
+			"\n";
+	}
+
+	out << "case " << _again << ":\n";
+
+	if ( redFsm->anyToStateActions() ) {
+		out <<
+			"	_acts = " << TSA() << "[" << vCS() << "]" << ";\n"
+			"	_nacts = " << CAST("int") << " " << A() << "[_acts++];\n"
+			"	while ( _nacts-- > 0 ) {\n"
+			"		switch ( " << A() << "[_acts++] ) {\n";
+			TO_STATE_ACTION_SWITCH() <<
+			"		}\n"
+			"	}\n"
+			"\n";
+	}
+
+	if ( redFsm->errState != 0 ) {
+		out <<
+			"	if ( " << vCS() << " == " << redFsm->errState->id << " ) {\n"
+			"		_goto_targ = " << _out << ";\n"
+			"		continue _goto;\n"
+			"	}\n";
+	}
+
+	if ( !noEnd ) {
+		out <<
+			"	if ( ++" << P() << " != " << PE() << " ) {\n"
+			"		_goto_targ = " << _resume << ";\n"
+			"		continue _goto;\n"
+			"	}\n";
+	}
+	else {
+		out <<
+			"	" << P() << " += 1;\n"
+			"	_goto_targ = " << _resume << ";\n"
+			"	continue _goto;\n";
+	}
+
+	out << "case " << _test_eof << ":\n";
+
+	if ( redFsm->anyEofTrans() || redFsm->anyEofActions() ) {
+		out <<
+			"	if ( " << P() << " == " << vEOF() << " )\n"
+			"	{\n";
+
+		if ( redFsm->anyEofTrans() ) {
+			out <<
+				"	if ( " << ET() << "[" << vCS() << "] > 0 ) {\n"
+				"		_trans = " << ET() << "[" << vCS() << "] - 1;\n"
+				"		_goto_targ = " << _eof_trans << ";\n"
+				"		continue _goto;\n"
+				"	}\n";
+		}
+
+		if ( redFsm->anyEofActions() ) {
+			out <<
+				"	int __acts = " << EA() << "[" << vCS() << "]" << ";\n"
+				"	int __nacts = " << CAST("int") << " " << A() << "[__acts++];\n"
+				"	while ( __nacts-- > 0 ) {\n"
+				"		switch ( " << A() << "[__acts++] ) {\n";
+				EOF_ACTION_SWITCH() <<
+				"		}\n"
+				"	}\n";
+		}
+
+		out <<
+			"	}\n"
+			"\n";
+	}
+
+	out << "case " << _out << ":\n";
+
+	/* The switch and goto loop. */
+	out << "	}\n";
+	out << "	break; }\n";
+
+	/* The execute block. */
+	out << "	}\n";
+}
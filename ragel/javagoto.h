@@ -0,0 +1,64 @@
+/*
+ *  Copyright 2006-2007 Adrian Thurston <thurston@complang.org>
+ *            2007 Colin Fleming <colin.fleming@caverock.com>
+ *            2026 Ragel contributors
+ */
+
+/*  This file is part of Ragel.
+ *
+ *  Ragel is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Ragel is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Ragel; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _JAVAGOTO_H
+#define _JAVAGOTO_H
+
+#include <iostream>
+#include "javacodegen.h"
+
+/*
+ * JavaGotoCodeGen
+ *
+ * Java has no goto, so the transition of each state is located by a switch
+ * on the key in a static method instead of by searching the key tables. The
+ * states are spread over as many methods as needed to keep each one small
+ * enough for the JIT to compile. Actions stay in the execute loop since
+ * they refer to its locals.
+ */
+struct JavaGotoCodeGen : public JavaTabCodeGen
+{
+	JavaGotoCodeGen( ostream &out ) :
+		JavaTabCodeGen(out), numTransMethods(0) {}
+
+	/* Method holding the transitions of each state, by state id. */
+	Vector<int> transMethod;
+	int numTransMethods;
+
+	string TM( int method );
+
+	int stateCost( RedStateAp *state );
+	void assignTransMethods();
+
+	bool emitRangeBSearch( RedStateAp *state, int level, int low, int high );
+	void STATE_TRANS( RedStateAp *state );
+	void TRANS_METHODS();
+	std::ostream &TRANS_METHOD_MAP();
+	void LOCATE_TRANS();
+
+	virtual void writeData();
+	virtual void writeExec();
+	virtual void finishRagelDef();
+};
+
+#endif
@@ -71,20 +71,47 @@ using std::streamsize;
 MinimizeLevel minimizeLevel = MinimizePartition2;
 MinimizeOpt minimizeOpt = MinimizeMostOps;
 
+/* Drop the conditions that do not change where a character goes. */
+bool reduceConds = false;
+
 /* Graphviz dot file generation. */
 const char *machineSpec = 0, *machineName = 0;
 bool machineSpecFound = false;
 bool wantDupsRemoved = true;
 
 bool printStatistics = false;
+StatsFormat statsFormat = StatsText;
 bool generateXML = false;
 bool generateDot = false;
 
+/* Reduced machine image output and input, for running the frontend and the
+ * backend separately. */
+bool generateImage = false;
+bool imageInput = false;
+
 /* Target language and output style. */
 CodeStyle codeStyle = GenTables;
 
 int numSplitPartitions = 0;
 bool noLineDirectives = false;
+bool simdCode = false;
+
+/* Java tables are written as packed strings. */
+bool stringTables = false;
+
+/* Rust input and tables are read without bounds checks. */
+bool uncheckedAccess = false;
+
+/* Count the transitions taken by generated machines, and order states with
+ * the counts written by such a machine. */
+bool instrumentCode = false;
+const char *profileFileName = 0;
+
+/* Number of sections whose machines may be built at once. */
+int numJobs = 1;
+
+/* Directory holding the output of sections from previous runs. */
+const char *cacheDir = 0;
 
 bool displayPrintables = false;
 
@@ -101,9 +128,12 @@ void usage()
 "   -v, --version        Print version information and exit\n"
 "   -o <file>            Write output to <file>\n"
 "   -s                   Print some statistics on stderr\n"
+"   --stats=<fmt>        Print statistics as text (same as -s) or json\n"
 "   -d                   Do not remove duplicates from action lists\n"
 "   -I <dir>             Add <dir> to the list of directories to search\n"
 "                        for included an imported files\n"
+"   -j <n>               Build the machines of up to <n> sections at once\n"
+"   --cache-dir=<dir>    Reuse the output of unchanged sections from <dir>\n"
 "error reporting format:\n"
 "   --error-format=gnu   file:line:column: message (default)\n"
 "   --error-format=msvc  file(line,column): message\n"
@@ -112,8 +142,16 @@ void usage()
 "   -m                   Minimize at the end of the compilation\n"
 "   -l                   Minimize after most operations (default)\n"
 "   -e                   Minimize after every operation\n"
+"   --minimize=<alg>     Minimization algorithm: partition2 (default),\n"
+"                        hopcroft, partition1, stable or approx\n"
+"   --reduce-conds       Drop conditions that do not change where a\n"
+"                        character goes, before each minimization\n"
 "visualization:\n"
 "   -x                   Run the frontend only: emit XML intermediate format\n"
+"   --image              Run the frontend only: emit the reduced machines in\n"
+"                        binary form\n"
+"   --load-image         Run the backend only: the input is an image written\n"
+"                        with --image\n"
 "   -V                   Generate a dot file for Graphviz\n"
 "   -p                   Display printable characters on labels\n"
 "   -S <spec>            FSM specification to output (for graphviz output)\n"
@@ -127,21 +165,40 @@ void usage()
 "   -R                   The host language is Ruby\n"
 "   -A                   The host language is C#\n"
 "   -O                   The host language is OCaml\n"
+"   -U                   The host language is Rust\n"
 "   --host-lang=<lang>   The host language (C, D, D2, Go, Java, Ruby, C#, OCaml, Rust)\n"
 "line directives: (C/D/Ruby/C#)\n"
 "   -L                   Inhibit writing of #line directives\n"
-"code style: (C/D/Java/Ruby/C#)\n"
+"code style: (C/D/Java/Ruby/C#/Rust)\n"
 "   -T0                  Table driven FSM (default)\n"
 "code style: (C/D/Ruby/C#)\n"
 "   -T1                  Faster table driven FSM\n"
+"code style: (C/D/Java/Ruby/C#)\n"
 "   -F0                  Flat table driven FSM\n"
+"code style: (C/D/Java/Ruby/C#/Rust)\n"
 "   -F1                  Faster flat table-driven FSM\n"
-"code style: (C/D/C#)\n"
+"code style: (C/D)\n"
+"   -T2                  Table driven FSM packed into a comb vector\n"
+"   -F2                  Flat table driven FSM indexed by character class\n"
+"code style: (C/D/Java/C#)\n"
 "   -G0                  Goto-driven FSM\n"
+"code style: (C/D/C#/Rust)\n"
 "   -G1                  Faster goto-driven FSM\n"
-"code style: (C/D)\n"
+"code style: (C/D/Go)\n"
 "   -G2                  Really fast goto-driven FSM\n"
 "   -P<N>                N-Way Split really fast goto-driven FSM\n"
+"code style: (C with -T0/-T1/-F0/-F1)\n"
+"   --simd               Use SSE instructions for key lookup and to skip\n"
+"                        runs of self-looping input\n"
+"code style: (Java)\n"
+"   --string-tables      Write the tables as packed strings that are unpacked\n"
+"                        when the class is loaded\n"
+"code style: (Rust with -F1/-G1)\n"
+"   --unchecked          Read the input and tables without bounds checks\n"
+"code style: (C with -G0/-G1/-G2)\n"
+"   --instrument         Count the transitions taken, for use with --profile\n"
+"code style: (C/D with -G0/-G1/-G2/-P<N>)\n"
+"   --profile=<file>     Order states and tests by the counts in <file>\n"
 	;	
 
 	exit(0);
@@ -184,29 +241,35 @@ ostream &operator<<( ostream &out, const InputLoc &loc )
 	return out;
 }
 
-/* Total error count. */
-int gblErrorCount = 0;
+/* Total error count. Threads building sections count their own errors. */
+THREAD_LOCAL int gblErrorCount = 0;
+
+/* Destination of errors and warnings when not cerr. */
+THREAD_LOCAL ostream *errorStream = 0;
 
 /* Print the opening to a warning in the input, then return the error ostream. */
 ostream &warning( const InputLoc &loc )
 {
-	cerr << loc << ": warning: ";
-	return cerr;
+	ostream &out = errorStream != 0 ? *errorStream : cerr;
+	out << loc << ": warning: ";
+	return out;
 }
 
 /* Print the opening to a program error, then return the error stream. */
 ostream &error()
 {
+	ostream &out = errorStream != 0 ? *errorStream : cerr;
 	gblErrorCount += 1;
-	cerr << PROGNAME ": ";
-	return cerr;
+	out << PROGNAME ": ";
+	return out;
 }
 
 ostream &error( const InputLoc &loc )
 {
+	ostream &out = errorStream != 0 ? *errorStream : cerr;
 	gblErrorCount += 1;
-	cerr << loc << ": ";
-	return cerr;
+	out << loc << ": ";
+	return out;
 }
 
 void escapeLineDirectivePath( std::ostream &out, char *path )
@@ -221,7 +284,7 @@ void escapeLineDirectivePath( std::ostream &out, char *path )
 
 void processArgs( int argc, const char **argv, InputData &id )
 {
-	ParamCheck pc("xo:dnmleabjkS:M:I:CDEJZRAOvHh?-:sT:F:G:P:LpV", argc, argv);
+	ParamCheck pc("xo:dnmleabj:kS:M:I:CDEJZRAOUvHh?-:sT:F:G:P:LpV", argc, argv);
 
 	/* FIXME: Need to check code styles VS langauge. */
 
@@ -273,9 +336,6 @@ void processArgs( int argc, const char **argv, InputData &id )
 			case 'b':
 				minimizeLevel = MinimizeStable;
 				break;
-			case 'j':
-				minimizeLevel = MinimizePartition1;
-				break;
 			case 'k':
 				minimizeLevel = MinimizePartition2;
 				break;
@@ -304,6 +364,16 @@ void processArgs( int argc, const char **argv, InputData &id )
 				}
 				break;
 
+			/* Number of sections to build at once. */
+			case 'j':
+				numJobs = atoi( pc.paramArg );
+				if ( numJobs < 1 ) {
+					error() << "-j" << pc.paramArg << 
+							" is an invalid argument" << endl;
+					exit(1);
+				}
+				break;
+
 			case 'I':
 				if ( *pc.paramArg == 0 )
 					error() << "please specify an argument to -I" << endl;
@@ -337,6 +407,9 @@ void processArgs( int argc, const char **argv, InputData &id )
 			case 'O':
 				hostLang = &hostLangOCaml;
 				break;
+			case 'U':
+				hostLang = &hostLangRust;
+				break;
 
 			/* Version and help. */
 			case 'v':
@@ -369,8 +442,59 @@ void processArgs( int argc, const char **argv, InputData &id )
 					else
 						error() << "invalid value for error-format" << endl;
 				}
+				else if ( strcmp( arg, "stats" ) == 0 ) {
+					printStatistics = true;
+					if ( eq == 0 || strcmp( eq, "text" ) == 0 )
+						statsFormat = StatsText;
+					else if ( strcmp( eq, "json" ) == 0 )
+						statsFormat = StatsJSON;
+					else
+						error() << "invalid value for stats" << endl;
+				}
+				else if ( strcmp( arg, "minimize" ) == 0 ) {
+					if ( eq == 0 )
+						error() << "expecting '=alg' for minimize" << endl;
+					else if ( strcmp( eq, "approx" ) == 0 )
+						minimizeLevel = MinimizeApprox;
+					else if ( strcmp( eq, "stable" ) == 0 )
+						minimizeLevel = MinimizeStable;
+					else if ( strcmp( eq, "partition1" ) == 0 )
+						minimizeLevel = MinimizePartition1;
+					else if ( strcmp( eq, "partition2" ) == 0 )
+						minimizeLevel = MinimizePartition2;
+					else if ( strcmp( eq, "hopcroft" ) == 0 )
+						minimizeLevel = MinimizeHopcroft;
+					else
+						error() << "invalid value for minimize" << endl;
+				}
+				else if ( strcmp( arg, "reduce-conds" ) == 0 )
+					reduceConds = true;
 				else if ( strcmp( arg, "rbx" ) == 0 )
 					rubyImpl = Rubinius;
+				else if ( strcmp( arg, "simd" ) == 0 )
+					simdCode = true;
+				else if ( strcmp( arg, "string-tables" ) == 0 )
+					stringTables = true;
+				else if ( strcmp( arg, "unchecked" ) == 0 )
+					uncheckedAccess = true;
+				else if ( strcmp( arg, "instrument" ) == 0 )
+					instrumentCode = true;
+				else if ( strcmp( arg, "profile" ) == 0 ) {
+					if ( eq == 0 || *eq == 0 )
+						error() << "expecting '=file' for profile" << endl;
+					else
+						profileFileName = strdup( eq );
+				}
+				else if ( strcmp( arg, "image" ) == 0 )
+					generateImage = true;
+				else if ( strcmp( arg, "load-image" ) == 0 )
+					imageInput = true;
+				else if ( strcmp( arg, "cache-dir" ) == 0 ) {
+					if ( eq == 0 || *eq == 0 )
+						error() << "expecting '=dir' for cache-dir" << endl;
+					else
+						cacheDir = strdup( eq );
+				}
 				else if ( strcmp( arg, "host-lang" ) == 0 ) {
 					if ( eq == 0 )
 						error() << "expecting '=lang' for language" << endl;
@@ -412,6 +536,8 @@ void processArgs( int argc, const char **argv, InputData &id )
 					codeStyle = GenTables;
 				else if ( pc.paramArg[0] == '1' )
 					codeStyle = GenFTables;
+				else if ( pc.paramArg[0] == '2' )
+					codeStyle = GenCombTable;
 				else {
 					error() << "-T" << pc.paramArg[0] << 
 							" is an invalid argument" << endl;
@@ -423,6 +549,8 @@ void processArgs( int argc, const char **argv, InputData &id )
 					codeStyle = GenFlat;
 				else if ( pc.paramArg[0] == '1' )
 					codeStyle = GenFFlat;
+				else if ( pc.paramArg[0] == '2' )
+					codeStyle = GenClassFlat;
 				else {
 					error() << "-F" << pc.paramArg[0] << 
 							" is an invalid argument" << endl;
@@ -480,8 +608,8 @@ void process( InputData &id )
 {
 	/* Open the input file for reading. */
 	assert( id.inputFileName != 0 );
-	ifstream *inFile = new ifstream( id.inputFileName );
-	if ( ! inFile->is_open() )
+	InputFile *inputFile = id.openInputFile( id.inputFileName );
+	if ( inputFile == 0 )
 		error() << "could not open " << id.inputFileName << " for reading" << endp;
 
 	/* Used for just a few things. */
@@ -495,7 +623,8 @@ void process( InputData &id )
 	firstInputItem->loc.col = 1;
 	id.inputItems.append( firstInputItem );
 
-	Scanner scanner( id, id.inputFileName, *inFile, 0, 0, 0, false );
+	double parseStart = wallClock();
+	Scanner scanner( id, id.inputFileName, *inputFile, 0, 0, 0, false );
 	scanner.do_scan();
 
 	/* Finished, final check for errors.. */
@@ -504,11 +633,15 @@ void process( InputData &id )
 
 	/* Now send EOF to all parsers. */
 	id.terminateAllParsers();
+	id.parseTime = wallClock() - parseStart;
 
 	/* Bail on above error. */
 	if ( gblErrorCount > 0 )
 		exit(1);
 
+	/* Sections whose output is in the cache are not built. */
+	id.loadCache();
+
 	/* Locate the backend program */
 	/* Compiles machines. */
 	id.prepareMachineGen();
@@ -537,8 +670,8 @@ void process( InputData &id )
 	id.openOutput();
 	id.writeOutput();
 
-	/* Close the input and the intermediate file. */
-	delete inFile;
+	if ( printStatistics )
+		id.writeStatistics();
 
 	/* If writing to a file, delete the ostream, causing it to flush.
 	 * Standard out is flushed automatically. */
@@ -550,6 +683,26 @@ void process( InputData &id )
 	assert( gblErrorCount == 0 );
 }
 
+/* Generate code from an image of the reduced machines. The host language
+ * comes from the image, the code style from the options. */
+void processImage( InputData &id )
+{
+	id.loadImage();
+
+	if ( gblErrorCount > 0 )
+		exit(1);
+
+	id.openOutput();
+	id.writeOutput();
+
+	if ( id.outputFileName != 0 ) {
+		delete id.outStream;
+		delete id.outFilter;
+	}
+
+	assert( gblErrorCount == 0 );
+}
+
 char *makeIntermedTemplate( const char *baseFileName )
 {
 	char *result = 0;
@@ -575,6 +728,10 @@ int main( int argc, const char **argv )
 
 	processArgs( argc, argv, id );
 
+	/* Cached output is only good for the same options. */
+	if ( cacheDir != 0 )
+		id.hashCacheOptions( argc, argv );
+
 	/* Require an input file. If we use standard in then we won't have a file
 	 * name on which to base the output. */
 	if ( id.inputFileName == 0 )
@@ -592,7 +749,13 @@ int main( int argc, const char **argv )
 				"\" is the same as the input file" << endp;
 	}
 
-	process( id );
+	if ( imageInput && ( generateDot || generateXML || generateImage ) )
+		error() << "--load-image cannot be combined with -V, -x or --image" << endp;
+
+	if ( imageInput )
+		processImage( id );
+	else
+		process( id );
 
 	return 0;
 }
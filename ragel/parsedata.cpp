@@ -31,6 +31,7 @@
 #include "parsetree.h"
 #include "mergesort.h"
 #include "xmlcodegen.h"
+#include "gendata.h"
 #include "version.h"
 #include "inputdata.h"
 
@@ -38,23 +39,18 @@ using namespace std;
 
 char mainMachine[] = "main";
 
+StringArena tokenArena;
+
 void Token::set( const char *str, int len )
 {
 	length = len;
-	data = new char[len+1];
-	memcpy( data, str, len );
-	data[len] = 0;
+	data = tokenArena.copy( str, len );
 }
 
 void Token::append( const Token &other )
 {
-	int newLength = length + other.length;
-	char *newString = new char[newLength+1];
-	memcpy( newString, data, length );
-	memcpy( newString + length, other.data, other.length );
-	newString[newLength] = 0;
-	data = newString;
-	length = newLength;
+	data = tokenArena.append( data, length, other.data, other.length );
+	length += other.length;
 }
 
 /* Perform minimization after an operation according 
@@ -69,6 +65,11 @@ void afterOpMinimize( FsmAp *fsm, bool lastInSeq )
 		 * created and those operators clean them up. */
 		fsm->removeUnreachableStates();
 
+		/* Conditions that do not change where a character goes only stand
+		 * in the way of minimization. */
+		if ( reduceConds )
+			fsm->reduceCondSpaces();
+
 		switch ( minimizeLevel ) {
 			case MinimizeApprox:
 				fsm->minimizeApproximate();
@@ -79,6 +80,9 @@ void afterOpMinimize( FsmAp *fsm, bool lastInSeq )
 			case MinimizePartition2:
 				fsm->minimizePartition2();
 				break;
+			case MinimizeHopcroft:
+				fsm->minimizeHopcroft();
+				break;
 			case MinimizeStable:
 				fsm->minimizeStable();
 				break;
@@ -86,6 +90,22 @@ void afterOpMinimize( FsmAp *fsm, bool lastInSeq )
 	}
 }
 
+/* Minimization after a step of counted repetition. The copies form a long
+ * chain which the partitioning algorithms split up one state per round. When
+ * an exact minimization is asked for, use Hopcroft's algorithm, which arrives
+ * at the same machine. */
+void afterRepeatMinimize( FsmAp *fsm, bool lastInSeq )
+{
+	if ( minimizeLevel == MinimizeApprox )
+		afterOpMinimize( fsm, lastInSeq );
+	else if ( minimizeOpt == MinimizeEveryOp || ( minimizeOpt == MinimizeMostOps && lastInSeq ) ) {
+		fsm->removeUnreachableStates();
+		if ( reduceConds )
+			fsm->reduceCondSpaces();
+		fsm->minimizeHopcroft();
+	}
+}
+
 /* Count the transitions in the fsm by walking the state list. */
 int countTransitions( FsmAp *fsm )
 {
@@ -422,6 +442,14 @@ ParseData::ParseData( const char *fileName, char *sectionName,
 :	
 	sectionGraph(0),
 	generatingSectionSubset(false),
+	markTableBytes(0),
+	dictHits(0),
+	dictCollisions(0),
+	buildTime(0),
+	reduceTime(0),
+	writeTime(0),
+	sourceHash(FNV_OFFSET),
+	fromCache(false),
 	nextPriorKey(0),
 	/* 0 is reserved for global error actions. */
 	nextLocalErrKey(1),
@@ -463,6 +491,18 @@ ParseData::ParseData( const char *fileName, char *sectionName,
 	initGraphDict();
 }
 
+/* Tokens are hashed with their location since actions carry line directives
+ * back to the input. */
+void ParseData::hashToken( const InputLoc &loc, int tokId, const char *data, int len )
+{
+	sourceHash = fnvHash( sourceHash, loc.fileName );
+	sourceHash = fnvHash( sourceHash, &loc.line, sizeof(loc.line) );
+	sourceHash = fnvHash( sourceHash, &tokId, sizeof(tokId) );
+	sourceHash = fnvHash( sourceHash, &len, sizeof(len) );
+	if ( data != 0 )
+		sourceHash = fnvHash( sourceHash, data, len );
+}
+
 /* Clean up the data collected during a parse. */
 ParseData::~ParseData()
 {
@@ -1094,23 +1134,35 @@ FsmAp *ParseData::makeInstance( GraphDictEl *gdNode )
 	 * because they will just hinder minimization as well. Clear them. */
 	graph->clearAllPriorities();
 
+	/* With the priorities and ordering gone, more conditions turn out not to
+	 * change where a character goes. */
+	if ( reduceConds )
+		graph->reduceCondSpaces();
+
 	if ( minimizeOpt != MinimizeNone ) {
 		/* Minimize here even if we minimized at every op. Now that function
-		 * keys have been cleared we may get a more minimal fsm. */
-		switch ( minimizeLevel ) {
-			case MinimizeApprox:
-				graph->minimizeApproximate();
-				break;
-			case MinimizeStable:
-				graph->minimizeStable();
-				break;
-			case MinimizePartition1:
-				graph->minimizePartition1();
-				break;
-			case MinimizePartition2:
-				graph->minimizePartition2();
-				break;
-		}
+		 * keys have been cleared we may get a more minimal fsm. Merging
+		 * states can leave more conditions that do not matter, so go until
+		 * there are none. */
+		do {
+			switch ( minimizeLevel ) {
+				case MinimizeApprox:
+					graph->minimizeApproximate();
+					break;
+				case MinimizeStable:
+					graph->minimizeStable();
+					break;
+				case MinimizePartition1:
+					graph->minimizePartition1();
+					break;
+				case MinimizePartition2:
+					graph->minimizePartition2();
+					break;
+				case MinimizeHopcroft:
+					graph->minimizeHopcroft();
+					break;
+			}
+		} while ( reduceConds && graph->reduceCondSpaces() );
 	}
 
 	graph->compressTransitions();
@@ -1307,6 +1359,15 @@ void ParseData::analyzeGraph( FsmAp *graph )
 		}
 	}
 
+	/* The backend writes every space in the map, including those that
+	 * reduceCondSpaces took off all states, so their conditions need ids. */
+	for ( CondSpaceMap::Iter cs = condData->condSpaceMap; cs.lte(); cs++ ) {
+		for ( CondSet::Iter csi = cs->condSet; csi.lte(); csi++ ) {
+			if ( (*csi)->numCondRefs == 0 )
+				(*csi)->numCondRefs = 1;
+		}
+	}
+
 	/* Checks for bad usage of directives in action code. */
 	for ( ActionList::Iter act = actionList; act.lte(); act++ )
 		checkAction( act );
@@ -1392,10 +1453,19 @@ void ParseData::prepareMachineGenTBWrapped( GraphDictEl *graphDictEl )
 	initLongestMatchData();
 
 	/* Make the graph, do minimization. */
+	MarkIndex::peakBytes = 0;
+	StateDict::hits = StateDict::collisions = 0;
+	fsmStats = printStatistics ? &buildStats : 0;
+	double start = wallClock();
 	if ( graphDictEl == 0 )
 		sectionGraph = makeAll();
 	else
 		sectionGraph = makeSpecific( graphDictEl );
+	buildTime = wallClock() - start;
+	fsmStats = 0;
+	markTableBytes = MarkIndex::peakBytes;
+	dictHits = StateDict::hits;
+	dictCollisions = StateDict::collisions;
 	
 	/* Compute exports from the export definitions. */
 	makeExports();
@@ -1432,6 +1502,7 @@ void ParseData::generateReduced( InputData &inputData )
 {
 	beginProcessing();
 
+	double start = wallClock();
 	cgd = makeCodeGen( inputData.inputFileName, sectionName, *inputData.outStream );
 
 	/* Make the generator. */
@@ -1439,12 +1510,7 @@ void ParseData::generateReduced( InputData &inputData )
 
 	/* Write out with it. */
 	backendGen.makeBackend();
-
-	if ( printStatistics ) {
-		cerr << "fsm name  : " << sectionName << endl;
-		cerr << "num states: " << sectionGraph->stateList.length() << endl;
-		cerr << endl;
-	}
+	reduceTime = wallClock() - start;
 }
 
 void ParseData::generateXML( ostream &out )
@@ -1456,11 +1522,124 @@ void ParseData::generateXML( ostream &out )
 
 	/* Write out with it. */
 	codeGen.writeXML();
+}
+
+/* Writes the statistics on the section for -s, either as lines of text or
+ * as a JSON object. */
+void ParseData::writeStatistics( ostream &out, bool json )
+{
+	long numTrans = 0;
+	for ( StateList::Iter st = sectionGraph->stateList; st.lte(); st++ )
+		numTrans += st->outList.length();
+
+	RedFsmAp *redFsm = cgd != 0 ? cgd->redFsm : 0;
+	bool combStats = redFsm != 0 && redFsm->combLength > 0;
+	bool splitStats = redFsm != 0 && redFsm->partitionTrans > 0;
+
+	if ( json ) {
+		out << 
+			"\t\t{\n"
+			"\t\t\t\"name\": ";
+		jsonString( out, sectionName );
+		out << ",\n"
+			"\t\t\t\"states\": " << sectionGraph->stateList.length() << ",\n"
+			"\t\t\t\"transitions\": " << numTrans << ",\n"
+			"\t\t\t\"peak_states\": " << buildStats.peakStates << ",\n"
+			"\t\t\t\"peak_transitions\": " << buildStats.peakTrans << ",\n"
+			"\t\t\t\"dict_hits\": " << dictHits << ",\n"
+			"\t\t\t\"dict_collisions\": " << dictCollisions << ",\n"
+			"\t\t\t\"mark_bytes\": " << markTableBytes << ",\n"
+			"\t\t\t\"minimize_rounds\": " << buildStats.minimizeRounds << ",\n"
+			"\t\t\t\"build_seconds\": " << buildTime << ",\n"
+			"\t\t\t\"reduce_seconds\": " << reduceTime << ",\n"
+			"\t\t\t\"write_seconds\": " << writeTime << ",\n";
+
+		if ( combStats ) {
+			out <<
+				"\t\t\t\"comb_slots\": " << redFsm->combLength << ",\n"
+				"\t\t\t\"comb_used\": " << redFsm->combUsed << ",\n";
+		}
 
-	if ( printStatistics ) {
-		cerr << "fsm name  : " << sectionName << endl;
-		cerr << "num states: " << sectionGraph->stateList.length() << endl;
-		cerr << endl;
+		if ( splitStats ) {
+			out <<
+				"\t\t\t\"split_trans\": " << redFsm->partitionTrans << ",\n"
+				"\t\t\t\"split_cut\": " << redFsm->partitionCut << ",\n";
+		}
+
+		out << "\t\t\t\"operations\": {";
+		for ( int op = 0; op < FsmStatNumOps; op++ ) {
+			FsmOpStats &opStats = buildStats.ops[op];
+			out << ( op > 0 ? ",\n" : "\n" ) <<
+				"\t\t\t\t\"" << FsmStats::opName( op ) << "\": { "
+				"\"count\": " << opStats.count << ", "
+				"\"seconds\": " << opStats.seconds << ", "
+				"\"peak_states\": " << opStats.peakStates << ", "
+				"\"peak_transitions\": " << opStats.peakTrans << " }";
+		}
+		out << "\n\t\t\t},\n";
+
+		out << "\t\t\t\"tables\": {";
+		if ( cgd != 0 ) {
+			for ( TableSizeVect::Iter ts = cgd->tableSizes; ts.lte(); ts++ ) {
+				out << ( ts.pos() > 0 ? ",\n" : "\n" ) <<
+					"\t\t\t\t";
+				jsonString( out, ts->name.c_str() );
+				out << ": " << ts->bytes;
+			}
+		}
+		out << "\n\t\t\t}\n"
+			"\t\t}";
+		return;
 	}
+
+	out << "fsm name  : " << sectionName << endl;
+	out << "num states: " << sectionGraph->stateList.length() << endl;
+	out << "num trans : " << numTrans << endl;
+	out << "peak state: " << buildStats.peakStates << endl;
+	out << "peak trans: " << buildStats.peakTrans << endl;
+	out << "dict hits : " << dictHits << endl;
+	out << "collisions: " << dictCollisions << endl;
+	if ( minimizeLevel == MinimizeStable )
+		out << "mark bytes: " << markTableBytes << endl;
+	out << "min rounds: " << buildStats.minimizeRounds << endl;
+	out << "build time: " << buildTime << endl;
+	out << "reduce    : " << reduceTime << endl;
+	out << "write     : " << writeTime << endl;
+	if ( combStats ) {
+		out << "comb slots: " << redFsm->combLength << endl;
+		out << "comb used : " << redFsm->combUsed << " (" << 
+				redFsm->combUsed * 100 / redFsm->combLength << "%)" << endl;
+	}
+	if ( splitStats ) {
+		out << "split cut : " << redFsm->partitionCut << " of " << 
+				redFsm->partitionTrans << " trans" << endl;
+	}
+
+	out << endl << setw(12) << left << "operation" << right << setw(10) << "count" << 
+			setw(12) << "seconds" << setw(12) << "peak states" << 
+			setw(12) << "peak trans" << endl;
+	for ( int op = 0; op < FsmStatNumOps; op++ ) {
+		FsmOpStats &opStats = buildStats.ops[op];
+		if ( opStats.count > 0 ) {
+			out << setw(12) << left << FsmStats::opName( op ) << right <<
+					setw(10) << opStats.count << setw(12) << opStats.seconds <<
+					setw(12) << opStats.peakStates << 
+					setw(12) << opStats.peakTrans << endl;
+		}
+	}
+
+	if ( cgd != 0 && cgd->tableSizes.length() > 0 ) {
+		long total = 0;
+		out << endl << setw(34) << left << "table" << right << 
+				setw(12) << "bytes" << endl;
+		for ( TableSizeVect::Iter ts = cgd->tableSizes; ts.lte(); ts++ ) {
+			out << setw(34) << left << ts->name << right << 
+					setw(12) << ts->bytes << endl;
+			total += ts->bytes;
+		}
+		out << setw(34) << left << "total" << right << setw(12) << total << endl;
+	}
+
+	out << endl;
 }
 
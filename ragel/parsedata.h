@@ -234,6 +234,24 @@ struct ParseData
 	FsmAp *sectionGraph;
 	bool generatingSectionSubset;
 
+	/* Peak size of the stable minimization mark table and state dict
+	 * lookup counts, for statistics. */
+	long markTableBytes;
+	long dictHits, dictCollisions;
+
+	/* Operation statistics and the time taken by each phase. */
+	FsmStats buildStats;
+	double buildTime, reduceTime, writeTime;
+
+	void writeStatistics( ostream &out, bool json );
+
+	/* Hash of every token given to the section, for the output cache. Set
+	 * when the output of the write statements was taken from the cache and
+	 * the section is not built. */
+	unsigned long long sourceHash;
+	bool fromCache;
+	void hashToken( const InputLoc &loc, int tokId, const char *data, int len );
+
 	void initKeyOps();
 
 	/*
@@ -374,6 +392,7 @@ struct ParseData
 };
 
 void afterOpMinimize( FsmAp *fsm, bool lastInSeq = true );
+void afterRepeatMinimize( FsmAp *fsm, bool lastInSeq = true );
 Key makeFsmKeyHex( char *str, const InputLoc &loc, ParseData *pd );
 Key makeFsmKeyDec( char *str, const InputLoc &loc, ParseData *pd );
 Key makeFsmKeyNum( char *str, const InputLoc &loc, ParseData *pd );
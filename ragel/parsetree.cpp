@@ -726,12 +726,102 @@ Expression::~Expression()
 	}
 }
 
+/* If a term is a plain literal string and nothing more, returns the
+ * literal. */
+static Literal *termLiteral( Term *term )
+{
+	if ( term->type != Term::FactorWithAugType )
+		return 0;
+
+	FactorWithAug *factorWithAug = term->factorWithAug;
+	if ( factorWithAug->actions.length() > 0 ||
+			factorWithAug->priorityAugs.length() > 0 ||
+			factorWithAug->labels.length() > 0 ||
+			factorWithAug->epsilonLinks.length() > 0 ||
+			factorWithAug->conditions.length() > 0 )
+		return 0;
+
+	FactorWithRep *factorWithRep = factorWithAug->factorWithRep;
+	if ( factorWithRep->type != FactorWithRep::FactorWithNegType )
+		return 0;
+
+	FactorWithNeg *factorWithNeg = factorWithRep->factorWithNeg;
+	if ( factorWithNeg->type != FactorWithNeg::FactorType ||
+			factorWithNeg->factor->type != Factor::LiteralType )
+		return 0;
+
+	Literal *literal = factorWithNeg->factor->literal;
+	return literal->plainString() ? literal : 0;
+}
+
+/* Walk an or expression whose first terms are plain literal strings, such
+ * as a list of keywords. The literals are made into one minimal machine
+ * directly, instead of by a union and minimization for each. Any terms that
+ * follow are unioned in as usual. Returns null if there are not at least two
+ * literals to start with. */
+FsmAp *Expression::walkLiteralUnion( ParseData *pd )
+{
+	/* The chain of or expressions, last term first. */
+	Vector<Expression*> chain;
+	Expression *expr = this;
+	while ( expr->type == OrType ) {
+		chain.append( expr );
+		expr = expr->expression;
+	}
+	if ( expr->type != TermType )
+		return 0;
+	chain.append( expr );
+
+	long first = chain.length();
+	while ( first > 0 && termLiteral( chain[first-1]->term ) != 0 )
+		first -= 1;
+
+	long numStrings = chain.length() - first;
+	if ( numStrings < 2 )
+		return 0;
+
+	Vector<Key> *strings = new Vector<Key>[numStrings];
+	for ( long i = 0; i < numStrings; i++ ) {
+		Token &token = termLiteral( chain[first+i]->term )->token;
+
+		long length;
+		bool caseInsensitive;
+		char *data = prepareLitString( token.loc, token.data, token.length,
+				length, caseInsensitive );
+
+		strings[i].setAsNew( length );
+		makeFsmKeyArray( strings[i].data, data, length, pd );
+		delete[] data;
+	}
+
+	FsmAp *rtnVal = new FsmAp();
+	rtnVal->literalUnionFsm( strings, numStrings );
+	delete[] strings;
+
+	/* Union in the remaining terms, in order. */
+	for ( long i = first - 1; i >= 0; i-- ) {
+		FsmAp *rhs = chain[i]->term->walk( pd );
+		rtnVal->unionOp( rhs );
+		afterOpMinimize( rtnVal, i == 0 );
+	}
+
+	return rtnVal;
+}
+
 /* Evaluate a single expression node. */
 FsmAp *Expression::walk( ParseData *pd, bool lastInSeq )
 {
 	FsmAp *rtnVal = 0;
 	switch ( type ) {
 		case OrType: {
+			/* Walking starts at the end of a chain of ors. Those that begin
+			 * with literal strings are made quicker. */
+			if ( lastInSeq ) {
+				rtnVal = walkLiteralUnion( pd );
+				if ( rtnVal != 0 )
+					break;
+			}
+
 			/* Evaluate the expression. */
 			rtnVal = expression->walk( pd, false );
 			/* Evaluate the term. */
@@ -1491,7 +1581,7 @@ FsmAp *FactorWithRep::walk( ParseData *pd )
 
 			/* Do the repetition on the machine. Already guarded against n == 0 */
 			retFsm->repeatOp( lowerRep );
-			afterOpMinimize( retFsm );
+			afterRepeatMinimize( retFsm );
 		}
 		break;
 	}
@@ -1520,7 +1610,7 @@ FsmAp *FactorWithRep::walk( ParseData *pd )
 
 			/* Do the repetition on the machine. Already guarded against n == 0 */
 			retFsm->optionalRepeatOp( upperRep );
-			afterOpMinimize( retFsm );
+			afterRepeatMinimize( retFsm );
 		}
 		break;
 	}
@@ -1547,7 +1637,7 @@ FsmAp *FactorWithRep::walk( ParseData *pd )
 
 			/* Do repetition on the first half. */
 			retFsm->repeatOp( lowerRep );
-			afterOpMinimize( retFsm );
+			afterRepeatMinimize( retFsm );
 
 			/* Star the duplicate. */
 			dup->starOp( );
@@ -1555,7 +1645,7 @@ FsmAp *FactorWithRep::walk( ParseData *pd )
 
 			/* Tak on the kleene star. */
 			retFsm->concatOp( dup );
-			afterOpMinimize( retFsm );
+			afterRepeatMinimize( retFsm );
 		}
 		break;
 	}
@@ -1592,12 +1682,12 @@ FsmAp *FactorWithRep::walk( ParseData *pd )
 			if ( lowerRep == 0 ) {
 				/* Just doing max repetition. Already guarded against n == 0. */
 				retFsm->optionalRepeatOp( upperRep );
-				afterOpMinimize( retFsm );
+				afterRepeatMinimize( retFsm );
 			}
 			else if ( lowerRep == upperRep ) {
 				/* Just doing exact repetition. Already guarded against n == 0. */
 				retFsm->repeatOp( lowerRep );
-				afterOpMinimize( retFsm );
+				afterRepeatMinimize( retFsm );
 			}
 			else {
 				/* This is the case that 0 < lowerRep < upperRep. Take a
@@ -1606,15 +1696,15 @@ FsmAp *FactorWithRep::walk( ParseData *pd )
 
 				/* Do repetition on the first half. */
 				retFsm->repeatOp( lowerRep );
-				afterOpMinimize( retFsm );
+				afterRepeatMinimize( retFsm );
 
 				/* Do optional repetition on the second half. */
 				dup->optionalRepeatOp( upperRep - lowerRep );
-				afterOpMinimize( dup );
+				afterRepeatMinimize( dup );
 
 				/* Tak on the duplicate machine. */
 				retFsm->concatOp( dup );
-				afterOpMinimize( retFsm );
+				afterRepeatMinimize( retFsm );
 			}
 		}
 		break;
@@ -1880,6 +1970,13 @@ FsmAp *Range::walk( ParseData *pd )
 	return retFsm;
 }
 
+/* A literal string with no options after it, such as case insensitivity. */
+bool Literal::plainString()
+{
+	char last = token.data[token.length-1];
+	return type == LitString && ( last == '\'' || last == '"' );
+}
+
 /* Evaluate a literal object. */
 FsmAp *Literal::walk( ParseData *pd )
 {
@@ -27,6 +27,7 @@
 #include "bstmap.h"
 #include "vector.h"
 #include "dlist.h"
+#include "buffer.h"
 
 struct NameInst;
 
@@ -203,6 +204,9 @@ struct Token
 	void set( const char *str, int len );
 };
 
+/* Holds the text of all tokens. Token data is never freed. */
+extern StringArena tokenArena;
+
 char *prepareLitString( const InputLoc &loc, const char *src, long length, 
 			long &resLen, bool &caseInsensitive );
 
@@ -401,6 +405,7 @@ struct Expression
 
 	/* Tree traversal. */
 	FsmAp *walk( ParseData *pd, bool lastInSeq = true );
+	FsmAp *walkLiteralUnion( ParseData *pd );
 	void makeNameTree( ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
 
@@ -634,6 +639,7 @@ struct Literal
 		: token(token), type(type) { }
 
 	FsmAp *walk( ParseData *pd );
+	bool plainString();
 	
 	Token token;
 	LiteralType type;
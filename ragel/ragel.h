@@ -37,8 +37,10 @@ enum CodeStyle
 {
 	GenTables,
 	GenFTables,
+	GenCombTable,
 	GenFlat,
 	GenFFlat,
+	GenClassFlat,
 	GenGoto,
 	GenFGoto,
 	GenIpGoto,
@@ -50,7 +52,8 @@ enum MinimizeLevel {
 	MinimizeApprox,
 	MinimizeStable,
 	MinimizePartition1,
-	MinimizePartition2
+	MinimizePartition2,
+	MinimizeHopcroft
 };
 
 enum MinimizeOpt {
@@ -70,11 +73,14 @@ enum RubyImplEnum
 /* Options. */
 extern MinimizeLevel minimizeLevel;
 extern MinimizeOpt minimizeOpt;
+extern bool reduceConds;
 extern const char *machineSpec, *machineName;
 extern bool printStatistics;
 extern bool wantDupsRemoved;
 extern bool generateDot;
 extern bool generateXML;
+extern bool generateImage;
+extern bool imageInput;
 extern RubyImplEnum rubyImpl;
 
 /* Error reporting format. */
@@ -84,13 +90,23 @@ enum ErrorFormat {
 };
 
 extern ErrorFormat errorFormat;
-extern int gblErrorCount;
+
+/* Statistics report format. */
+enum StatsFormat {
+	StatsText,
+	StatsJSON
+};
+
+extern StatsFormat statsFormat;
+extern THREAD_LOCAL int gblErrorCount;
 extern char mainMachine[];
 
 InputLoc makeInputLoc( const char *fileName, int line = 0, int col = 0 );
 std::ostream &operator<<( std::ostream &out, const InputLoc &loc );
 
-/* Error reporting. */
+/* Error reporting. Messages go to errorStream when it is set, otherwise to
+ * cerr. */
+extern THREAD_LOCAL std::ostream *errorStream;
 std::ostream &error();
 std::ostream &error( const InputLoc &loc ); 
 std::ostream &warning( const InputLoc &loc ); 
@@ -98,16 +114,24 @@ std::ostream &warning( const InputLoc &loc );
 struct XmlParser;
 
 void xmlEscapeHost( std::ostream &out, char *data, long len );
+void jsonString( std::ostream &out, const char *str );
 
 extern CodeStyle codeStyle;
 
 /* IO filenames and stream. */
 extern bool displayPrintables;
-extern int gblErrorCount;
+extern THREAD_LOCAL int gblErrorCount;
 
 /* Options. */
 extern int numSplitPartitions;
 extern bool noLineDirectives;
+extern bool simdCode;
+extern bool stringTables;
+extern bool uncheckedAccess;
+extern bool instrumentCode;
+extern const char *profileFileName;
+extern int numJobs;
+extern const char *cacheDir;
 
 std::ostream &error();
 
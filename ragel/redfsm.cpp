@@ -48,6 +48,8 @@ RedFsmAp::RedFsmAp()
 	errTrans(0),
 	firstFinState(0),
 	numFinStates(0),
+	partitionTrans(0),
+	partitionCut(0),
 	bAnyToStateActions(false),
 	bAnyFromStateActions(false),
 	bAnyRegActions(false),
@@ -61,7 +63,16 @@ RedFsmAp::RedFsmAp()
 	bAnyRegNextStmt(false),
 	bAnyRegCurStateRef(false),
 	bAnyRegBreak(false),
-	bAnyConditions(false)
+	bAnyConditions(false),
+	classBounded(false),
+	numClasses(0),
+	charClass(0),
+	classRep(0),
+	combLength(0),
+	combUsed(0),
+	maxCombBase(0),
+	combNext(0),
+	combCheck(0)
 {
 }
 
@@ -195,6 +206,37 @@ void RedFsmAp::sortByStateId()
 	delete[] ptrList;
 }
 
+struct CmpStateByHits
+{
+	static int compare( RedStateAp *st1, RedStateAp *st2 )
+	{
+		if ( st1->hits > st2->hits )
+			return -1;
+		else if ( st1->hits < st2->hits )
+			return 1;
+		else
+			return 0;
+	}
+};
+
+void RedFsmAp::sortStatesByHits()
+{
+	/* Make the array. */
+	int pos = 0;
+	RedStateAp **ptrList = new RedStateAp*[stateList.length()];
+	for ( RedStateList::Iter st = stateList; st.lte(); st++, pos++ )
+		ptrList[pos] = st;
+	
+	MergeSort<RedStateAp*, CmpStateByHits> mergeSort;
+	mergeSort.sort( ptrList, stateList.length() );
+
+	stateList.abandon();
+	for ( int st = 0; st < pos; st++ )
+		stateList.append( ptrList[st] );
+
+	delete[] ptrList;
+}
+
 /* Find the final state with the lowest id. */
 void RedFsmAp::findFirstFinState()
 {
@@ -336,6 +378,236 @@ void RedFsmAp::makeFlat()
 	}
 }
 
+/* The transition taken on key, after makeFlat. */
+RedTransAp *RedFsmAp::flatTrans( RedStateAp *state, Key key )
+{
+	if ( state->transList != 0 && state->lowKey <= key && key <= state->highKey )
+		return state->transList[keyOps->span( state->lowKey, key ) - 1];
+	return state->defTrans;
+}
+
+typedef BstMapEl<unsigned long long, int> ClassSplitMapEl;
+typedef BstMap<unsigned long long, int> ClassSplitMap;
+
+/* Computes the alphabet equivalence classes: keys that take the same
+ * transition in every state. The classes start out as one and are refined by
+ * each state in turn. Without wholeAlphabet only the range covered by the
+ * flat key spans is mapped and the remaining keys form a class of their own.
+ * Must be done after makeFlat. */
+void RedFsmAp::makeCharClasses( bool wholeAlphabet )
+{
+	classBounded = !wholeAlphabet;
+	if ( wholeAlphabet ) {
+		classLowKey = keyOps->minKey;
+		classHighKey = keyOps->maxKey;
+	}
+	else {
+		bool any = false;
+		for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+			if ( st->transList != 0 ) {
+				if ( !any || st->lowKey < classLowKey )
+					classLowKey = st->lowKey;
+				if ( !any || st->highKey > classHighKey )
+					classHighKey = st->highKey;
+				any = true;
+			}
+		}
+
+		if ( !any )
+			classLowKey = classHighKey = keyOps->minKey;
+	}
+
+	unsigned long long span = keyOps->span( classLowKey, classHighKey );
+	charClass = new int[span];
+	memset( charClass, 0, sizeof(int) * span );
+	numClasses = 1;
+
+	/* Pair each key's current class with the transition the state takes on
+	 * it. Distinct pairs become the new classes. */
+	unsigned long long numTransIds = transSet.length() + 1;
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		ClassSplitMap splits;
+		Key key = classLowKey;
+		for ( unsigned long long pos = 0; pos < span; pos++, key.increment() ) {
+			RedTransAp *trans = flatTrans( st, key );
+			unsigned long long pair = charClass[pos] * numTransIds +
+					( trans != 0 ? trans->id + 1 : 0 );
+
+			ClassSplitMapEl *inMap = splits.find( pair );
+			if ( inMap == 0 )
+				inMap = splits.insert( pair, splits.length() );
+			charClass[pos] = inMap->value;
+		}
+		numClasses = splits.length();
+	}
+
+	/* Record a key from each class for looking up the transitions. */
+	classRep = new Key[numClasses];
+	Key key = classLowKey;
+	for ( unsigned long long pos = 0; pos < span; pos++, key.increment() )
+		classRep[charClass[pos]] = key;
+
+	if ( classBounded )
+		numClasses += 1;
+}
+
+/* Rows with more slots are placed first, they are the hardest to fit. */
+struct CmpCombRow
+{
+	static int compare( const Vector<long> *r1, const Vector<long> *r2 )
+	{
+		if ( r1->length() > r2->length() )
+			return -1;
+		else if ( r1->length() < r2->length() )
+			return 1;
+		else
+			return 0;
+	}
+};
+
+/* Sets the row entries of the keys lowKey through highKey. Returns the
+ * number of entries set. */
+static long addCombCols( RedTransAp **rowTrans, Key combLowKey,
+		Key lowKey, Key highKey, RedTransAp *trans )
+{
+	long col = keyOps->span( combLowKey, lowKey ) - 1;
+	unsigned long long span = keyOps->span( lowKey, highKey );
+	for ( unsigned long long pos = 0; pos < span; pos++ )
+		rowTrans[col + pos] = trans;
+	return span;
+}
+
+bool RedFsmAp::makeCombVector( unsigned long long maxSpan )
+{
+	/* Find the keys used by transitions that are not the default. */
+	bool any = false;
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		RedTransList *lists[2] = { &st->outSingle, &st->outRange };
+		for ( int l = 0; l < 2; l++ ) {
+			for ( RedTransList::Iter rtel = *lists[l]; rtel.lte(); rtel++ ) {
+				if ( !any || rtel->lowKey < combLowKey )
+					combLowKey = rtel->lowKey;
+				if ( !any || rtel->highKey > combHighKey )
+					combHighKey = rtel->highKey;
+				any = true;
+			}
+		}
+	}
+
+	if ( !any )
+		combLowKey = combHighKey = keyOps->minKey;
+
+	unsigned long long span = keyOps->span( combLowKey, combHighKey );
+	if ( span > maxSpan )
+		return false;
+
+	/* Expand the rows. The columns of a row come out in key order. */
+	RedTransAp **rowTrans = new RedTransAp*[span];
+	Vector<long> *rows = new Vector<long>[stateList.length()];
+	Vector<long> **order = new Vector<long>*[stateList.length()];
+	RedStateAp **rowState = new RedStateAp*[stateList.length()];
+	RedTransAp ***rowTransList = new RedTransAp**[stateList.length()];
+	int r = 0;
+	for ( RedStateList::Iter st = stateList; st.lte(); st++, r++ ) {
+		memset( rowTrans, 0, sizeof(RedTransAp*) * span );
+		long numCols = 0;
+		for ( RedTransList::Iter rtel = st->outSingle; rtel.lte(); rtel++ ) {
+			numCols += addCombCols( rowTrans, combLowKey, 
+					rtel->lowKey, rtel->highKey, rtel->value );
+		}
+		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
+			numCols += addCombCols( rowTrans, combLowKey, 
+					rtel->lowKey, rtel->highKey, rtel->value );
+		}
+
+		/* Keep the transitions alongside the sorted columns. */
+		rowTransList[r] = new RedTransAp*[numCols];
+		for ( long pos = 0, col = 0; col < (long)span; col++ ) {
+			if ( rowTrans[col] != 0 ) {
+				rows[r].append( col );
+				rowTransList[r][pos++] = rowTrans[col];
+			}
+		}
+
+		rowState[r] = st;
+		order[r] = &rows[r];
+	}
+
+	MergeSort<Vector<long>*, CmpCombRow> mergeSort;
+	mergeSort.sort( order, stateList.length() );
+
+	/* First fit. Each row goes at the lowest base where none of its slots
+	 * are taken. Rows may interleave since the check array tells them
+	 * apart. */
+	Vector<RedStateAp*> check;
+	Vector<RedTransAp*> next;
+	long firstFree = 0;
+	maxCombBase = 0;
+	combUsed = 0;
+	for ( r = 0; r < stateList.length(); r++ ) {
+		Vector<long> &row = *order[r];
+		long ri = order[r] - rows;
+		if ( row.length() == 0 ) {
+			rowState[ri]->combBase = 0;
+			continue;
+		}
+
+		long base = firstFree - row[0];
+		if ( base < 0 )
+			base = 0;
+		while ( true ) {
+			bool fits = true;
+			for ( long c = 0; c < row.length(); c++ ) {
+				long slot = base + row[c];
+				if ( slot < check.length() && check[slot] != 0 ) {
+					fits = false;
+					break;
+				}
+			}
+			if ( fits )
+				break;
+			base += 1;
+		}
+
+		while ( check.length() < base + row[row.length()-1] + 1 ) {
+			check.append( 0 );
+			next.append( 0 );
+		}
+
+		for ( long c = 0; c < row.length(); c++ ) {
+			check[base + row[c]] = rowState[ri];
+			next[base + row[c]] = rowTransList[ri][c];
+		}
+
+		while ( firstFree < check.length() && check[firstFree] != 0 )
+			firstFree += 1;
+
+		rowState[ri]->combBase = base;
+		if ( base > maxCombBase )
+			maxCombBase = base;
+		combUsed += row.length();
+	}
+
+	/* Any key in range must index into the vector from any base. */
+	combLength = maxCombBase + span;
+	combCheck = new RedStateAp*[combLength];
+	combNext = new RedTransAp*[combLength];
+	memset( combCheck, 0, sizeof(RedStateAp*) * combLength );
+	memset( combNext, 0, sizeof(RedTransAp*) * combLength );
+	for ( long slot = 0; slot < check.length(); slot++ ) {
+		combCheck[slot] = check[slot];
+		combNext[slot] = next[slot];
+	}
+
+	for ( r = 0; r < stateList.length(); r++ )
+		delete[] rowTransList[r];
+	delete[] rowTransList;
+	delete[] rowState;
+	delete[] order;
+	delete[] rows;
+	delete[] rowTrans;
+	return true;
+}
 
 /* A default transition has been picked, move it from the outRange to the
  * default pointer. */
@@ -386,6 +658,75 @@ bool RedFsmAp::alphabetCovered( RedTransList &outRange )
 	return true;
 }
 
+/* Adds the keys lowKey through highKey to the state's exit keys. Fails if
+ * this would take the number of exits past maxExits. */
+static bool addExitKeys( RedStateAp *state, Key lowKey, Key highKey, long maxExits )
+{
+	if ( keyOps->span( lowKey, highKey ) >
+			(unsigned long long)(maxExits - state->exitKeys.length()) )
+		return false;
+
+	for ( Key key = lowKey; ; key.increment() ) {
+		state->exitKeys.append( key );
+		if ( key == highKey )
+			break;
+	}
+	return true;
+}
+
+bool RedFsmAp::findSelfLoop( RedStateAp *state, long maxExits )
+{
+	/* State actions would have to be executed on every key and conditions
+	 * make the key depend on more than the input. */
+	if ( state == errState || state->toStateAction != 0 ||
+			state->fromStateAction != 0 || state->stateCondList.length() > 0 )
+		return false;
+
+	/* Keys that don't loop back without actions, including the gaps in the
+	 * out range, are the exits. */
+	bool anyLoop = false;
+	Key nextKey = keyOps->minKey;
+	bool atEnd = false;
+	for ( RedTransList::Iter rtel = state->outRange; rtel.lte(); rtel++ ) {
+		if ( nextKey < rtel->lowKey ) {
+			Key gapHigh = rtel->lowKey;
+			gapHigh.decrement();
+			if ( !addExitKeys( state, nextKey, gapHigh, maxExits ) )
+				return false;
+		}
+
+		if ( rtel->value->targ == state && rtel->value->action == 0 )
+			anyLoop = true;
+		else if ( !addExitKeys( state, rtel->lowKey, rtel->highKey, maxExits ) )
+			return false;
+
+		if ( rtel->highKey == keyOps->maxKey )
+			atEnd = true;
+		else {
+			nextKey = rtel->highKey;
+			nextKey.increment();
+		}
+	}
+
+	if ( !anyLoop )
+		return false;
+
+	if ( !atEnd && !addExitKeys( state, nextKey, keyOps->maxKey, maxExits ) )
+		return false;
+
+	return state->exitKeys.length() > 0;
+}
+
+/* Find the states that spin on all but at most maxExits keys. */
+void RedFsmAp::findSelfLoops( long maxExits )
+{
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		st->selfLoop = findSelfLoop( st, maxExits );
+		if ( !st->selfLoop )
+			st->exitKeys.empty();
+	}
+}
+
 RedTransAp *RedFsmAp::chooseDefaultSpan( RedStateAp *state )
 {
 	/* Make a set of transitions from the outRange. */
@@ -540,10 +881,71 @@ RedTransAp *RedFsmAp::allocateTrans( RedStateAp *targ, RedAction *action )
 	return inDict;
 }
 
+/* Edge of the undirected state graph that the partitioner works on. The
+ * weight is the number of transitions between the two states, plus the
+ * times they were taken in a profiling run. */
+struct PartEdge
+{
+	int other;
+	unsigned long long weight;
+};
+
+struct CmpPartEdge
+{
+	static int compare( const PartEdge &e1, const PartEdge &e2 )
+	{
+		if ( e1.other < e2.other )
+			return -1;
+		else if ( e1.other > e2.other )
+			return 1;
+		else
+			return 0;
+	}
+};
+
+typedef Vector<PartEdge> PartEdgeList;
+
+static void addPartEdge( PartEdgeList *edges, int from, int to, 
+		unsigned long long weight )
+{
+	if ( from != to && to >= 0 ) {
+		PartEdge edge;
+		edge.weight = weight;
+		edge.other = to;
+		edges[from].append( edge );
+		edge.other = from;
+		edges[to].append( edge );
+	}
+}
+
+/* Weight of the edges between a state and the states of a partition. */
+static unsigned long long partConn( PartEdgeList &edges, int *part, int p )
+{
+	unsigned long long conn = 0;
+	for ( PartEdgeList::Iter edge = edges; edge.lte(); edge++ ) {
+		if ( part[edge->other] == p )
+			conn += edge->weight;
+	}
+	return conn;
+}
+
+static unsigned long long edgeWeight( PartEdgeList &edges, int other )
+{
+	for ( PartEdgeList::Iter edge = edges; edge.lte(); edge++ ) {
+		if ( edge->other == other )
+			return edge->weight;
+	}
+	return 0;
+}
+
+/* Refinement passes made at most. Each pass that moves nothing ends it. */
+static const int partMaxPasses = 16;
+
 void RedFsmAp::partitionFsm( int nparts )
 {
-	/* At this point the states are ordered by a depth-first traversal. We
-	 * will allocate to partitions based on this ordering. */
+	/* At this point the states are ordered by a depth-first traversal, or
+	 * hottest first when a profile was given, which puts the hot states
+	 * together. We will make the initial partitions from this ordering. */
 	this->nParts = nparts;
 	int partSize = stateList.length() / nparts;
 	int remainder = stateList.length() % nparts;
@@ -562,6 +964,179 @@ void RedFsmAp::partitionFsm( int nparts )
 				numInPart += 1;
 		}
 	}
+
+	if ( nparts > 1 && partSize > 1 )
+		refinePartitions();
+
+	/* Count the transitions that jump between partitions. */
+	partitionTrans = partitionCut = 0;
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		for ( RedTransList::Iter rtel = st->outSingle; rtel.lte(); rtel++ ) {
+			partitionTrans += 1;
+			if ( rtel->value->targ->partition != st->partition )
+				partitionCut += 1;
+		}
+		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
+			partitionTrans += 1;
+			if ( rtel->value->targ->partition != st->partition )
+				partitionCut += 1;
+		}
+		if ( st->defTrans != 0 ) {
+			partitionTrans += 1;
+			if ( st->defTrans->targ->partition != st->partition )
+				partitionCut += 1;
+		}
+	}
+}
+
+/* Moves states between the partitions to reduce the weight of the edges
+ * that cross them, keeping each partition within a few percent of the
+ * average size. This is a greedy Kernighan-Lin refinement. A state moves to
+ * the partition it is most connected to. When that partition is full, the
+ * state is paired with one that wants to move the other way and they are
+ * swapped if the swap reduces the cut. */
+void RedFsmAp::refinePartitions()
+{
+	int numStates = stateList.length();
+	RedStateAp **states = new RedStateAp*[numStates];
+	int *posById = new int[nextStateId];
+	int *part = new int[numStates];
+	int pos = 0;
+	for ( RedStateList::Iter st = stateList; st.lte(); st++, pos++ ) {
+		states[pos] = st;
+		posById[st->id] = pos;
+		part[pos] = st->partition;
+	}
+
+	/* Every partition but one jumps to the error state, wherever it is.
+	 * Leave its edges out so they don't drag states towards it. */
+	if ( errState != 0 )
+		posById[errState->id] = -1;
+
+	/* Make the graph, merging the edges between each pair of states. */
+	PartEdgeList *edges = new PartEdgeList[numStates];
+	for ( int s = 0; s < numStates; s++ ) {
+		RedStateAp *st = states[s];
+		unsigned long long defHits = st->hits;
+		for ( RedTransList::Iter rtel = st->outSingle; rtel.lte(); rtel++ ) {
+			addPartEdge( edges, s, posById[rtel->value->targ->id], 1 + rtel->hits );
+			defHits -= rtel->hits;
+		}
+		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
+			addPartEdge( edges, s, posById[rtel->value->targ->id], 1 + rtel->hits );
+			defHits -= rtel->hits;
+		}
+		if ( st->defTrans != 0 )
+			addPartEdge( edges, s, posById[st->defTrans->targ->id], 1 + defHits );
+	}
+
+	MergeSort<PartEdge, CmpPartEdge> mergeSort;
+	for ( int s = 0; s < numStates; s++ ) {
+		PartEdgeList &list = edges[s];
+		mergeSort.sort( list.data, list.length() );
+		int len = 0;
+		for ( int e = 0; e < list.length(); e++ ) {
+			if ( len > 0 && list[len-1].other == list[e].other )
+				list[len-1].weight += list[e].weight;
+			else
+				list[len++] = list[e];
+		}
+		list.remove( len, list.length() - len );
+	}
+
+	int *size = new int[nParts];
+	unsigned long long *conn = new unsigned long long[nParts];
+	memset( size, 0, sizeof(int) * nParts );
+	memset( conn, 0, sizeof(unsigned long long) * nParts );
+	for ( int s = 0; s < numStates; s++ )
+		size[part[s]] += 1;
+
+	int slack = numStates / nParts / 20;
+	if ( slack < 1 )
+		slack = 1;
+	int maxSize = ( numStates + nParts - 1 ) / nParts + slack;
+	int minSize = numStates / nParts - slack;
+
+	/* States that could not move because of the size limits, by source and
+	 * destination partition. */
+	Vector<int> *blocked = new Vector<int>[nParts * nParts];
+
+	for ( int pass = 0; pass < partMaxPasses; pass++ ) {
+		bool moved = false;
+
+		for ( int s = 0; s < numStates; s++ ) {
+			/* Find the partition the state is most connected to. */
+			for ( PartEdgeList::Iter edge = edges[s]; edge.lte(); edge++ )
+				conn[part[edge->other]] += edge->weight;
+
+			int from = part[s], to = from;
+			for ( PartEdgeList::Iter edge = edges[s]; edge.lte(); edge++ ) {
+				int p = part[edge->other];
+				if ( conn[p] > conn[to] )
+					to = p;
+			}
+
+			for ( PartEdgeList::Iter edge = edges[s]; edge.lte(); edge++ )
+				conn[part[edge->other]] = 0;
+			conn[from] = 0;
+
+			if ( to != from ) {
+				if ( size[to] < maxSize && size[from] > minSize ) {
+					part[s] = to;
+					size[from] -= 1;
+					size[to] += 1;
+					moved = true;
+				}
+				else {
+					blocked[from * nParts + to].append( s );
+				}
+			}
+		}
+
+		/* Swap blocked states pairwise. The gains are taken again since
+		 * other states may have moved. */
+		for ( int a = 0; a < nParts; a++ ) {
+			for ( int b = a + 1; b < nParts; b++ ) {
+				Vector<int> &ab = blocked[a * nParts + b];
+				Vector<int> &ba = blocked[b * nParts + a];
+				for ( int i = 0; i < ab.length() && i < ba.length(); i++ ) {
+					int u = ab[i], v = ba[i];
+					if ( part[u] != a || part[v] != b )
+						continue;
+
+					unsigned long long before = partConn( edges[u], part, a ) + 
+							partConn( edges[v], part, b );
+					unsigned long long after = partConn( edges[u], part, b ) + 
+							partConn( edges[v], part, a ) - 
+							2 * edgeWeight( edges[u], v );
+					if ( after > before ) {
+						part[u] = b;
+						part[v] = a;
+						moved = true;
+					}
+				}
+				ab.empty();
+				ba.empty();
+			}
+		}
+
+		for ( int p = 0; p < nParts * nParts; p++ )
+			blocked[p].empty();
+
+		if ( !moved )
+			break;
+	}
+
+	for ( int s = 0; s < numStates; s++ )
+		states[s]->partition = part[s];
+
+	delete[] blocked;
+	delete[] conn;
+	delete[] size;
+	delete[] edges;
+	delete[] part;
+	delete[] posById;
+	delete[] states;
 }
 
 void RedFsmAp::setInTrans()
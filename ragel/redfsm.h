@@ -248,14 +248,18 @@ struct RedTransEl
 {
 	/* Constructors. */
 	RedTransEl( Key lowKey, Key highKey, RedTransAp *value ) 
-		: lowKey(lowKey), highKey(highKey), value(value) { }
+		: lowKey(lowKey), highKey(highKey), value(value), hits(0) { }
 
 	Key lowKey, highKey;
 	RedTransAp *value;
+
+	/* Times the transition was taken in a profiling run. */
+	unsigned long long hits;
 };
 
 typedef Vector<RedTransEl> RedTransList;
 typedef Vector<RedStateAp*> RedStateVect;
+typedef Vector<Key> KeyVect;
 
 typedef BstMapEl<RedStateAp*, unsigned long long> RedSpanMapEl;
 typedef BstMap<RedStateAp*, unsigned long long> RedSpanMap;
@@ -318,6 +322,24 @@ struct GenStateCond
 typedef DList<GenStateCond> GenStateCondList;
 typedef Vector<GenStateCond*> StateCondVect;
 
+/* How the goto styles find the transition a key takes. */
+enum KeyDispatch
+{
+	/* A switch on the singles and a binary search of the ranges. */
+	KeySearch,
+
+	/* One switch with a case for every key. */
+	KeySwitch,
+
+	/* A bitmap of the keys that take the state's only non-default
+	 * transition. */
+	KeyBits,
+
+	/* A table indexed by the key giving a small transition number, and a
+	 * switch on that. */
+	KeyIndex
+};
+
 /* Reduced state. */
 struct RedStateAp
 {
@@ -338,7 +360,14 @@ struct RedStateAp
 		bAnyRegCurStateRef(false),
 		partitionBoundary(false),
 		inTrans(0),
-		numInTrans(0)
+		numInTrans(0),
+		selfLoop(false),
+		skipOffset(-1),
+		combBase(0),
+		hits(0),
+		profileBase(0),
+		keyDispatch(KeySearch),
+		keyTableOffset(-1)
 	{ }
 
 	/* Transitions out. */
@@ -380,6 +409,28 @@ struct RedStateAp
 
 	RedTransAp **inTrans;
 	int numInTrans;
+
+	/* Set when every key other than those in exitKeys loops back to this
+	 * state without any actions. Runs of such keys can be skipped in bulk. */
+	bool selfLoop;
+	KeyVect exitKeys;
+
+	/* Where the state's exit set is found in the generated skip table. */
+	int skipOffset;
+
+	/* Where the state's row starts in the comb vector. */
+	long combBase;
+
+	/* Transitions taken from the state in a profiling run. */
+	unsigned long long hits;
+
+	/* First of the state's counters in an instrumented machine. */
+	long profileBase;
+
+	/* How the goto styles look up keys, and where the state's bitmap or
+	 * index table is found in the generated tables. */
+	KeyDispatch keyDispatch;
+	long keyTableOffset;
 };
 
 /* List of states. */
@@ -413,6 +464,10 @@ struct RedFsmAp
 	int numFinStates;
 	int nParts;
 
+	/* Transitions in the machine and those between partitions. */
+	long partitionTrans;
+	long partitionCut;
+
 	bool bAnyToStateActions;
 	bool bAnyFromStateActions;
 	bool bAnyRegActions;
@@ -447,6 +502,25 @@ struct RedFsmAp
 	int maxCondIndexOffset;
 	int maxCond;
 
+	/* Alphabet equivalence classes for the flat tables. Keys classLowKey
+	 * through classHighKey are mapped to classes. When the classes are
+	 * bounded, the keys outside the range get the last class. */
+	Key classLowKey, classHighKey;
+	bool classBounded;
+	int numClasses;
+	int *charClass;
+	Key *classRep;
+
+	/* Row displacement packing of the table transitions. Keys combLowKey
+	 * through combHighKey index the rows. A slot belongs to the state in
+	 * combCheck, other slots are null. */
+	Key combLowKey, combHighKey;
+	long combLength;
+	long combUsed;
+	long maxCombBase;
+	RedTransAp **combNext;
+	RedStateAp **combCheck;
+
 	bool anyActions();
 	bool anyToStateActions()        { return bAnyToStateActions; }
 	bool anyFromStateActions()      { return bAnyFromStateActions; }
@@ -474,9 +548,22 @@ struct RedFsmAp
 
 	void makeFlat();
 
+	/* Group keys that take the same transition in every state. */
+	RedTransAp *flatTrans( RedStateAp *state, Key key );
+	void makeCharClasses( bool wholeAlphabet );
+
+	/* Pack the non-default transitions of every state into a comb vector.
+	 * Fails if the keys span more than maxSpan characters. */
+	bool makeCombVector( unsigned long long maxSpan );
+
 	/* Move a selected transition from ranges to default. */
 	void moveToDefault( RedTransAp *defTrans, RedStateAp *state );
 
+	/* Find states that can skip over runs of keys that loop back to the
+	 * state. Must be done before default transitions are chosen. */
+	bool findSelfLoop( RedStateAp *state, long maxExits );
+	void findSelfLoops( long maxExits );
+
 	/* Pick a default transition by largest span. */
 	RedTransAp *chooseDefaultSpan( RedStateAp *state );
 	void chooseDefaultSpan();
@@ -507,6 +594,10 @@ struct RedFsmAp
 	/* Sorting states by id. */
 	void sortByStateId();
 
+	/* Arrange states by profiled hits, hottest first. This is a stable
+	 * sort. */
+	void sortStatesByHits();
+
 	/* Locating the first final state. This is the final state with the lowest
 	 * id. */
 	void findFirstFinState();
@@ -521,7 +612,10 @@ struct RedFsmAp
 
 	RedTransAp *allocateTrans( RedStateAp *targState, RedAction *actionTable );
 
+	/* Split the states into partitions, cutting as few transitions as
+	 * possible. */
 	void partitionFsm( int nParts );
+	void refinePartitions();
 
 	void setInTrans();
 };
@@ -0,0 +1,611 @@
+/*
+ *  Copyright 2005-2007 Adrian Thurston <thurston@complang.org>
+ *            2026 Ragel contributors
+ */
+
+/*  This file is part of Ragel.
+ *
+ *  Ragel is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Ragel is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Ragel; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ragel.h"
+#include "redimage.h"
+#include "inputdata.h"
+#include "parsedata.h"
+#include "rlparse.h"
+#include <string.h>
+#include <stdio.h>
+
+using std::endl;
+
+/* Number of host expressions kept with a machine. */
+#define NUM_HOST_EXPRS 14
+
+/* The host expressions of a machine, in the order they are stored. */
+static void hostExprs( CodeGenData *cgd, GenInlineList **exprs[] )
+{
+	exprs[0] = &cgd->getKeyExpr;
+	exprs[1] = &cgd->accessExpr;
+	exprs[2] = &cgd->prePushExpr;
+	exprs[3] = &cgd->postPopExpr;
+	exprs[4] = &cgd->pExpr;
+	exprs[5] = &cgd->peExpr;
+	exprs[6] = &cgd->eofExpr;
+	exprs[7] = &cgd->csExpr;
+	exprs[8] = &cgd->topExpr;
+	exprs[9] = &cgd->stackExpr;
+	exprs[10] = &cgd->actExpr;
+	exprs[11] = &cgd->tokstartExpr;
+	exprs[12] = &cgd->tokendExpr;
+	exprs[13] = &cgd->dataExpr;
+}
+
+/* Index of an action table in the list, or -1 for none. */
+static long tableRef( CodeGenData *cgd, RedAction *action )
+{
+	return action != 0 ? action - cgd->allActionTables : -1;
+}
+
+void ImageWriter::word( long w )
+{
+	unsigned int v = (unsigned int) w;
+	body.append( (const char*)&v, sizeof(v) );
+}
+
+/* Keys take two words, low then high. */
+void ImageWriter::key( Key key )
+{
+	long long v = key.getVal();
+	word( (long)(v & 0xffffffffULL) );
+	word( (long)(v >> 32) );
+}
+
+/* The length including the null, zero for no string, then the string padded
+ * out to a word. */
+void ImageWriter::str( const char *s )
+{
+	if ( s == 0 )
+		word( 0 );
+	else {
+		long len = strlen( s ) + 1;
+		word( len );
+		body.append( s, len );
+		body.append( ( sizeof(unsigned int) - len % sizeof(unsigned int) ) %
+				sizeof(unsigned int), '\0' );
+	}
+}
+
+void ImageWriter::loc( const InputLoc &loc )
+{
+	long fileId = -1;
+	if ( loc.fileName != 0 ) {
+		FileIdMapEl *inMap = 0;
+		if ( fileIds.insert( loc.fileName, fileNames.length(), &inMap ) )
+			fileNames.append( loc.fileName );
+		fileId = inMap->value;
+	}
+
+	word( fileId );
+	word( loc.line );
+	word( loc.col );
+}
+
+void ImageWriter::inlineList( GenInlineList *genList )
+{
+	word( genList->length() );
+	for ( GenInlineList::Iter item = *genList; item.lte(); item++ ) {
+		loc( item->loc );
+		word( item->type );
+		str( item->data );
+		word( item->targId );
+		word( item->lmId );
+		word( item->offset );
+		word( item->children != 0 );
+		if ( item->children != 0 )
+			inlineList( item->children );
+	}
+}
+
+/* Stores a machine as the backend was given it, so that loading it repeats
+ * the same calls. The transitions are stored as they come from the frontend,
+ * the backend fills in the gaps. */
+void ImageWriter::machine( KeyOps &keyOps, CodeGenData *cgd )
+{
+	str( keyOps.alphType->internalName );
+	key( keyOps.minKey );
+	key( keyOps.maxKey );
+
+	GenInlineList **exprs[NUM_HOST_EXPRS];
+	hostExprs( cgd, exprs );
+	for ( int e = 0; e < NUM_HOST_EXPRS; e++ ) {
+		word( *exprs[e] != 0 );
+		if ( *exprs[e] != 0 )
+			inlineList( *exprs[e] );
+	}
+
+	word( cgd->exportList.length() );
+	for ( ExportList::Iter exp = cgd->exportList; exp.lte(); exp++ ) {
+		str( exp->name );
+		key( exp->key );
+	}
+
+	word( cgd->actionList.length() );
+	for ( GenActionList::Iter act = cgd->actionList; act.lte(); act++ ) {
+		str( act->name );
+		loc( act->loc );
+		inlineList( act->inlineList );
+	}
+
+	word( cgd->numActionTables );
+	for ( long t = 0; t < cgd->numActionTables; t++ ) {
+		RedAction *redAct = cgd->allActionTables + t;
+		word( redAct->key.length() );
+		for ( GenActionTable::Iter item = redAct->key; item.lte(); item++ )
+			word( item->value->actionId );
+	}
+
+	word( cgd->condSpaceList.length() );
+	for ( CondSpaceList::Iter cs = cgd->condSpaceList; cs.lte(); cs++ ) {
+		word( cs->condSpaceId );
+		key( cs->baseKey );
+		word( cs->condSet.length() );
+		for ( GenCondSet::Iter csi = cs->condSet; csi.lte(); csi++ )
+			word( (*csi)->actionId );
+	}
+
+	RedStateAp *allStates = cgd->allStates;
+	word( cgd->redFsm->stateList.length() );
+	word( cgd->startState );
+	word( cgd->errState );
+	word( cgd->redFsm->forcedErrorState );
+
+	word( cgd->entryPointIds.length() );
+	for ( long en = 0; en < cgd->entryPointIds.length(); en++ ) {
+		str( cgd->entryPointNames[en] );
+		word( cgd->entryPointIds[en] );
+	}
+
+	for ( RedStateList::Iter st = cgd->redFsm->stateList; st.lte(); st++ ) {
+		word( st->id );
+		word( st->isFinal );
+		word( tableRef( cgd, st->toStateAction ) );
+		word( tableRef( cgd, st->fromStateAction ) );
+		word( tableRef( cgd, st->eofAction ) );
+
+		word( st->eofTrans != 0 );
+		if ( st->eofTrans != 0 ) {
+			word( st->eofTrans->targ - allStates );
+			word( tableRef( cgd, st->eofTrans->action ) );
+		}
+
+		word( st->stateCondList.length() );
+		for ( GenStateCondList::Iter sc = st->stateCondList; sc.lte(); sc++ ) {
+			key( sc->lowKey );
+			key( sc->highKey );
+			word( sc->condSpace - cgd->allCondSpaces );
+		}
+
+		word( st->outRange.length() );
+		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
+			key( rtel->lowKey );
+			key( rtel->highKey );
+			word( rtel->value->targ != 0 ? rtel->value->targ - allStates : -1 );
+			word( tableRef( cgd, rtel->value->action ) );
+		}
+	}
+}
+
+/* The header goes in front of the body, it holds the file names the body
+ * refers to. */
+void ImageWriter::finish( const char *sourceFileName )
+{
+	std::string bodyData;
+	bodyData.swap( body );
+
+	word( IMAGE_MAGIC );
+	word( IMAGE_VERSION );
+	word( hostLang->lang );
+	str( sourceFileName );
+	word( fileNames.length() );
+	for ( long f = 0; f < fileNames.length(); f++ )
+		str( fileNames[f] );
+
+	out.write( body.data(), body.size() );
+	out.write( bodyData.data(), bodyData.size() );
+}
+
+ImageReader::ImageReader( const char *imageFileName )
+:
+	imageFileName(imageFileName),
+	data(0), pos(0), end(0),
+	lang(0),
+	sourceFileName(0)
+{
+	FILE *file = fopen( imageFileName, "rb" );
+	if ( file == 0 )
+		error() << "could not open " << imageFileName << " for reading" << endp;
+
+	fseek( file, 0, SEEK_END );
+	long size = ftell( file );
+	fseek( file, 0, SEEK_SET );
+	if ( size < 0 )
+		error() << "could not read " << imageFileName << endp;
+
+	long words = size / sizeof(unsigned int);
+	data = new unsigned int[words + 1];
+	if ( (long)fread( data, sizeof(unsigned int), words, file ) != words )
+		error() << "could not read " << imageFileName << endp;
+	fclose( file );
+
+	pos = data;
+	end = data + words;
+
+	if ( word() != IMAGE_MAGIC )
+		error() << imageFileName << " is not a ragel image" << endp;
+	if ( word() != IMAGE_VERSION )
+		error() << imageFileName << " was written by a different version of ragel" << endp;
+
+	switch ( word() ) {
+		case HostLang::C: lang = &hostLangC; break;
+		case HostLang::D: lang = &hostLangD; break;
+		case HostLang::D2: lang = &hostLangD2; break;
+		case HostLang::Go: lang = &hostLangGo; break;
+		case HostLang::Java: lang = &hostLangJava; break;
+		case HostLang::Ruby: lang = &hostLangRuby; break;
+		case HostLang::CSharp: lang = &hostLangCSharp; break;
+		case HostLang::OCaml: lang = &hostLangOCaml; break;
+		case HostLang::Rust: lang = &hostLangRust; break;
+		default: corrupt();
+	}
+
+	sourceFileName = str();
+	if ( sourceFileName == 0 )
+		corrupt();
+
+	long numFiles = count();
+	for ( long f = 0; f < numFiles; f++ )
+		fileNames.append( str() );
+}
+
+void ImageReader::corrupt()
+{
+	error() << imageFileName << " is truncated or corrupt" << endp;
+}
+
+long ImageReader::word()
+{
+	if ( pos == end )
+		corrupt();
+	return (int) *pos++;
+}
+
+/* A length. Every element takes at least a word, which bounds it. */
+long ImageReader::count()
+{
+	long c = word();
+	if ( c < 0 || c > end - pos )
+		corrupt();
+	return c;
+}
+
+/* Reference to one of length items. */
+long ImageReader::index( long length )
+{
+	long i = word();
+	if ( i < 0 || i >= length )
+		corrupt();
+	return i;
+}
+
+/* Reference to one of length items, or -1 for none. */
+long ImageReader::ref( long length )
+{
+	long i = word();
+	if ( i < -1 || i >= length )
+		corrupt();
+	return i;
+}
+
+Key ImageReader::key()
+{
+	unsigned long long low = (unsigned int) word();
+	unsigned long long high = (unsigned int) word();
+	return Key( (long)(long long)( high << 32 | low ) );
+}
+
+char *ImageReader::str()
+{
+	long len = word();
+	if ( len == 0 )
+		return 0;
+
+	long words = ( len + sizeof(unsigned int) - 1 ) / sizeof(unsigned int);
+	if ( len < 0 || words > end - pos )
+		corrupt();
+
+	char *s = (char*)pos;
+	if ( s[len-1] != 0 )
+		corrupt();
+
+	pos += words;
+	return s;
+}
+
+InputLoc ImageReader::loc()
+{
+	long fileId = ref( fileNames.length() );
+
+	InputLoc loc;
+	loc.fileName = fileId >= 0 ? fileNames[fileId] : 0;
+	loc.line = word();
+	loc.col = word();
+	return loc;
+}
+
+GenInlineList *ImageReader::inlineList()
+{
+	GenInlineList *genList = new GenInlineList;
+	long length = count();
+	for ( long i = 0; i < length; i++ ) {
+		InputLoc itemLoc = loc();
+		long type = index( GenInlineItem::Break + 1 );
+
+		GenInlineItem *item = new GenInlineItem( itemLoc, (GenInlineItem::Type)type );
+		item->data = str();
+		item->targId = word();
+		item->lmId = word();
+		item->offset = word();
+		if ( word() )
+			item->children = inlineList();
+
+		genList->append( item );
+	}
+	return genList;
+}
+
+/* Makes the same calls on the code generator that the frontend's
+ * BackendGen made on the one it stored. */
+void ImageReader::machine( CodeGenData *cgd )
+{
+	char *alphType = str();
+	if ( alphType == 0 || !cgd->setAlphType( alphType ) )
+		corrupt();
+
+	/* The machine is built with the alphabet range the frontend used. */
+	KeyOps *buildKeyOps = new KeyOps;
+	buildKeyOps->setAlphType( cgd->thisKeyOps.alphType );
+	buildKeyOps->minKey = key();
+	buildKeyOps->maxKey = key();
+	::keyOps = buildKeyOps;
+
+	GenInlineList **exprs[NUM_HOST_EXPRS];
+	hostExprs( cgd, exprs );
+	for ( int e = 0; e < NUM_HOST_EXPRS; e++ ) {
+		if ( word() )
+			*exprs[e] = inlineList();
+	}
+
+	long numExports = count();
+	for ( long e = 0; e < numExports; e++ ) {
+		char *name = str();
+		Key exportKey = key();
+		cgd->exportList.append( new Export( name, exportKey ) );
+	}
+
+	cgd->createMachine();
+
+	long numActions = count();
+	cgd->initActionList( numActions );
+	for ( long a = 0; a < numActions; a++ ) {
+		char *name = str();
+		InputLoc actionLoc = loc();
+		cgd->newAction( a, name, actionLoc, inlineList() );
+	}
+
+	long numTables = count();
+	cgd->initActionTableList( numTables );
+	for ( long t = 0; t < numTables; t++ ) {
+		RedAction *redAct = cgd->allActionTables + t;
+		redAct->actListId = t;
+
+		long length = count();
+		redAct->key.setAsNew( length );
+		for ( long i = 0; i < length; i++ ) {
+			redAct->key[i].key = 0;
+			redAct->key[i].value = cgd->allActions + index( numActions );
+		}
+
+		cgd->redFsm->actionMap.insert( redAct );
+	}
+
+	long numCondSpaces = count();
+	if ( numCondSpaces > 0 ) {
+		cgd->initCondSpaceList( numCondSpaces );
+		for ( long c = 0; c < numCondSpaces; c++ ) {
+			long condSpaceId = word();
+			Key baseKey = key();
+			cgd->newCondSpace( c, condSpaceId, baseKey );
+
+			long length = count();
+			for ( long i = 0; i < length; i++ )
+				cgd->condSpaceItem( c, index( numActions ) );
+		}
+	}
+
+	long numStates = count();
+	cgd->setStartState( index( numStates ) );
+
+	long errState = ref( numStates );
+	if ( errState >= 0 )
+		cgd->setErrorState( errState );
+
+	if ( word() )
+		cgd->setForcedErrorState();
+
+	long numEntries = count();
+	for ( long en = 0; en < numEntries; en++ ) {
+		char *name = str();
+		cgd->addEntryPoint( name, index( numStates ) );
+	}
+
+	cgd->initStateList( numStates );
+	for ( long s = 0; s < numStates; s++ ) {
+		long id = word();
+		bool isFinal = word() != 0;
+
+		long toStateAction = ref( numTables );
+		long fromStateAction = ref( numTables );
+		long eofAction = ref( numTables );
+		if ( toStateAction >= 0 || fromStateAction >= 0 || eofAction >= 0 )
+			cgd->setStateActions( s, toStateAction, fromStateAction, eofAction );
+
+		if ( word() ) {
+			long targ = index( numStates );
+			long action = ref( numTables );
+			cgd->setEofTrans( s, targ, action );
+		}
+
+		long numConds = count();
+		if ( numConds > 0 ) {
+			cgd->initStateCondList( s, numConds );
+			for ( long c = 0; c < numConds; c++ ) {
+				Key lowKey = key();
+				Key highKey = key();
+				cgd->addStateCond( s, lowKey, highKey, index( numCondSpaces ) );
+			}
+		}
+
+		long numTrans = count();
+		cgd->initTransList( s, numTrans );
+		for ( long t = 0; t < numTrans; t++ ) {
+			Key lowKey = key();
+			Key highKey = key();
+			long targ = ref( numStates );
+			long action = ref( numTables );
+			cgd->newTrans( s, t, lowKey, highKey, targ, action );
+		}
+		cgd->finishTransList( s );
+
+		cgd->setId( s, id );
+		if ( isFinal )
+			cgd->setFinal( s );
+	}
+
+	cgd->closeMachine();
+
+	cgd->redFsm->maxKey = cgd->findMaxKey();
+	cgd->redFsm->assignActionLocs();
+	cgd->redFsm->findFirstFinState();
+	cgd->finishRagelDef();
+}
+
+/* Writes the reduced machines of the sections, followed by the host data and
+ * the write statements in input order. */
+void InputData::writeImage( std::ostream &out )
+{
+	ImageWriter writer( out );
+
+	Vector<ParseData*> sections;
+	for ( ParserDict::Iter parser = parserDict; parser.lte(); parser++ ) {
+		ParseData *pd = parser->value->pd;
+		if ( pd->instanceList.length() > 0 )
+			sections.append( pd );
+	}
+
+	writer.word( sections.length() );
+	for ( long s = 0; s < sections.length(); s++ ) {
+		writer.str( sections[s]->sectionName );
+		writer.machine( sections[s]->thisKeyOps, sections[s]->cgd );
+	}
+
+	writer.word( inputItems.length() );
+	for ( InputItemList::Iter ii = inputItems; ii.lte(); ii++ ) {
+		writer.word( ii->type );
+		if ( ii->type == InputItem::HostData ) {
+			writer.word( ii->loc.line );
+			writer.str( ii->data.str().c_str() );
+		}
+		else {
+			long section = 0;
+			while ( sections[section] != ii->pd )
+				section += 1;
+
+			writer.word( section );
+			writer.loc( ii->loc );
+			writer.word( ii->writeArgs.length() - 1 );
+			for ( long a = 0; a < ii->writeArgs.length() - 1; a++ )
+				writer.str( ii->writeArgs[a] );
+		}
+	}
+
+	writer.finish( inputFileName );
+}
+
+/* Sets up the input items and generators from an image. The output is named
+ * after the image, the code is generated as if from the input the frontend
+ * read. */
+void InputData::loadImage()
+{
+	ImageReader reader( inputFileName );
+	hostLang = reader.lang;
+
+	makeOutputStream();
+	inputFileName = reader.sourceFileName;
+
+	long numSections = reader.count();
+	Vector<ParseData*> sections;
+	for ( long s = 0; s < numSections; s++ ) {
+		char *sectionName = reader.str();
+		if ( sectionName == 0 )
+			reader.corrupt();
+
+		InputLoc sectionLoc = makeInputLoc( inputFileName );
+		ParseData *pd = new ParseData( inputFileName, sectionName, sectionLoc );
+
+		double start = wallClock();
+		pd->cgd = makeCodeGen( inputFileName, sectionName, *outStream );
+		reader.machine( pd->cgd );
+		pd->reduceTime = wallClock() - start;
+
+		sections.append( pd );
+	}
+
+	long numItems = reader.count();
+	for ( long i = 0; i < numItems; i++ ) {
+		InputItem *inputItem = new InputItem;
+		inputItem->type = (InputItem::Type) reader.index( InputItem::Write + 1 );
+		if ( inputItem->type == InputItem::HostData ) {
+			inputItem->loc = makeInputLoc( inputFileName, reader.word() );
+			char *data = reader.str();
+			if ( data != 0 )
+				inputItem->data << data;
+		}
+		else {
+			inputItem->pd = sections[reader.index( numSections )];
+			inputItem->name = inputItem->pd->sectionName;
+			inputItem->loc = reader.loc();
+
+			long nargs = reader.count();
+			for ( long a = 0; a < nargs; a++ ) {
+				char *arg = reader.str();
+				if ( arg == 0 )
+					reader.corrupt();
+				inputItem->writeArgs.append( arg );
+			}
+			inputItem->writeArgs.append( 0 );
+		}
+		inputItems.append( inputItem );
+	}
+}
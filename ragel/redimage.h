@@ -0,0 +1,88 @@
+/*
+ *  Copyright 2005-2007 Adrian Thurston <thurston@complang.org>
+ *            2026 Ragel contributors
+ */
+
+/*  This file is part of Ragel.
+ *
+ *  Ragel is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Ragel is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Ragel; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _REDIMAGE_H
+#define _REDIMAGE_H
+
+#include <iostream>
+#include <string>
+#include "avlmap.h"
+#include "gendata.h"
+
+/*
+ * Binary image of the reduced machines of an input file, written by the
+ * frontend with --image and turned into code by the backend with
+ * --load-image. Everything is stored in native 32 bit words, so a loaded
+ * image is walked in place. Strings keep their null and are padded out to a
+ * word, the backend points into the image for them.
+ */
+
+#define IMAGE_MAGIC   0x6d69726c
+#define IMAGE_VERSION 1
+
+typedef AvlMap<const char*, long, CmpStr> FileIdMap;
+typedef AvlMapEl<const char*, long> FileIdMapEl;
+
+struct ImageWriter
+{
+	ImageWriter( std::ostream &out ) : out(out) {}
+
+	void word( long w );
+	void key( Key key );
+	void str( const char *s );
+	void loc( const InputLoc &loc );
+	void inlineList( GenInlineList *genList );
+	void machine( KeyOps &keyOps, CodeGenData *cgd );
+	void finish( const char *sourceFileName );
+
+	std::ostream &out;
+	std::string body;
+
+	/* File names are stored once, locations refer to them by index. */
+	FileIdMap fileIds;
+	Vector<const char*> fileNames;
+};
+
+struct ImageReader
+{
+	ImageReader( const char *imageFileName );
+
+	long word();
+	long count();
+	long index( long length );
+	long ref( long length );
+	Key key();
+	char *str();
+	InputLoc loc();
+	GenInlineList *inlineList();
+	void machine( CodeGenData *cgd );
+	void corrupt();
+
+	const char *imageFileName;
+	unsigned int *data, *pos, *end;
+
+	HostLang *lang;
+	const char *sourceFileName;
+	Vector<const char*> fileNames;
+};
+
+#endif
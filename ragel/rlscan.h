@@ -35,9 +35,11 @@ using std::ostream;
 
 extern char *Parser_lelNames[];
 
+struct InputFile;
+
 struct Scanner
 {
-	Scanner( InputData &id, const char *fileName, istream &input,
+	Scanner( InputData &id, const char *fileName, InputFile &input,
 			Parser *inclToParser, char *inclSectionTarg,
 			int includeDepth, bool importMachines )
 	: 
@@ -59,7 +61,7 @@ struct Scanner
 
 	/* Make a list of places to look for an included file. */
 	char **makeIncludePathChecks( const char *curFileName, const char *fileName, int len );
-	std::ifstream *tryOpenInclude( char **pathChecks, long &found );
+	InputFile *tryOpenInclude( char **pathChecks, long &found );
 
 	void handleMachine();
 	void handleInclude();
@@ -85,7 +87,7 @@ struct Scanner
 
 	InputData &id;
 	const char *fileName;
-	istream &input;
+	InputFile &input;
 	Parser *inclToParser;
 	char *inclSectionTarg;
 	int includeDepth;
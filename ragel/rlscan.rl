@@ -30,7 +30,6 @@
 
 //#define LOG_TOKENS
 
-using std::ifstream;
 using std::istream;
 using std::ostream;
 using std::cout;
@@ -183,9 +182,7 @@ void Scanner::importToken( int token, char *start, char *end )
 	else {
 		int toklen = end-start;
 		token_lens[cur_token] = toklen;
-		token_strings[cur_token] = new char[toklen+1];
-		memcpy( token_strings[cur_token], start, toklen );
-		token_strings[cur_token][toklen] = 0;
+		token_strings[cur_token] = tokenArena.copy( start, toklen );
 	}
 	cur_token++;
 }
@@ -326,8 +323,8 @@ void Scanner::handleInclude()
 		}
 
 		long found = 0;
-		ifstream *inFile = tryOpenInclude( includeChecks, found );
-		if ( inFile == 0 ) {
+		InputFile *inputFile = tryOpenInclude( includeChecks, found );
+		if ( inputFile == 0 ) {
 			scan_error() << "include: failed to locate file" << endl;
 			char **tried = includeChecks;
 			while ( *tried != 0 )
@@ -339,10 +336,9 @@ void Scanner::handleInclude()
 				parser->includeHistory.append( IncludeHistoryItem( 
 						includeChecks[found], inclSectionName ) );
 
-				Scanner scanner( id, includeChecks[found], *inFile, parser,
+				Scanner scanner( id, includeChecks[found], *inputFile, parser,
 						inclSectionName, includeDepth+1, false );
 				scanner.do_scan( );
-				delete inFile;
 			}
 		}
 	}
@@ -355,21 +351,21 @@ void Scanner::handleImport()
 
 		/* Open the input file for reading. */
 		long found = 0;
-		ifstream *inFile = tryOpenInclude( importChecks, found );
-		if ( inFile == 0 ) {
+		InputFile *inputFile = tryOpenInclude( importChecks, found );
+		if ( inputFile == 0 ) {
 			scan_error() << "import: could not open import file " <<
 					"for reading" << endl;
 			char **tried = importChecks;
 			while ( *tried != 0 )
 				scan_error() << "import: attempted: \"" << *tried++ << '\"' << endl;
+			return;
 		}
 
-		Scanner scanner( id, importChecks[found], *inFile, parser,
+		Scanner scanner( id, importChecks[found], *inputFile, parser,
 				0, includeDepth+1, true );
 		scanner.do_scan( );
 		scanner.importToken( 0, 0, 0 );
 		scanner.flushImport();
-		delete inFile;
 	}
 }
 
@@ -426,7 +422,7 @@ void Scanner::handleImport()
 	action write_arg
 	{
 		if ( active() && machineSpec == 0 && machineName == 0 )
-			id.inputItems.tail->writeArgs.append( strdup(tokdata) );
+			id.inputItems.tail->writeArgs.append( tokdata );
 	}
 
 	action write_close
@@ -476,9 +472,7 @@ void Scanner::token( int type, char *start, char *end )
 	int toklen = 0;
 	if ( start != 0 ) {
 		toklen = end-start;
-		tokdata = new char[toklen+1];
-		memcpy( tokdata, start, toklen );
-		tokdata[toklen] = 0;
+		tokdata = tokenArena.copy( start, toklen );
 	}
 
 	processToken( type, tokdata, toklen );
@@ -603,32 +597,20 @@ char **Scanner::makeIncludePathChecks( const char *thisFileName,
 	return checks;
 }
 
-ifstream *Scanner::tryOpenInclude( char **pathChecks, long &found )
+InputFile *Scanner::tryOpenInclude( char **pathChecks, long &found )
 {
 	char **check = pathChecks;
-	ifstream *inFile = new ifstream;
-	
 	while ( *check != 0 ) {
-		inFile->open( *check );
-		if ( inFile->is_open() ) {
+		InputFile *inputFile = id.openInputFile( *check );
+		if ( inputFile != 0 ) {
 			found = check - pathChecks;
-			return inFile;
+			return inputFile;
 		}
 
-		/* 
-		 * 03/26/2011 jg:
-		 * Don't rely on sloppy runtime behaviour: reset the state of the stream explicitly.
-		 * If inFile->open() fails, which happens when include dirs are tested, the fail bit
-		 * is set by the runtime library. Currently the VS runtime library opens new files,
-		 * but when it comes to reading it refuses to work.
-		 */
-		inFile->clear();
-
 		check += 1;
 	}
 
 	found = -1;
-	delete inFile;
 	return 0;
 }
 
@@ -1176,9 +1158,7 @@ ifstream *Scanner::tryOpenInclude( char **pathChecks, long &found )
 
 void Scanner::do_scan()
 {
-	int bufsize = 8;
-	char *buf = new char[bufsize];
-	int cs, act, have = 0;
+	int cs, act;
 	int top;
 
 	/* The stack is two deep, one level for going into ragel defs from the main
@@ -1186,7 +1166,6 @@ void Scanner::do_scan()
 	 * from either a ragel spec, or a regular expression. */
 	int stack[2];
 	int curly_count = 0;
-	bool execute = true;
 	bool singleLineSpec = false;
 	InlineBlockType inlineBlockType = CurlyDelimited;
 
@@ -1201,70 +1180,19 @@ void Scanner::do_scan()
 		cs = rlscan_en_main_ruby;
 	else
 		cs = rlscan_en_main;
-	
-	while ( execute ) {
-		char *p = buf + have;
-		int space = bufsize - have;
-
-		if ( space == 0 ) {
-			/* We filled up the buffer trying to scan a token. Grow it. */
-			bufsize = bufsize * 2;
-			char *newbuf = new char[bufsize];
-
-			/* Recompute p and space. */
-			p = newbuf + have;
-			space = bufsize - have;
-
-			/* Patch up pointers possibly in use. */
-			if ( ts != 0 )
-				ts = newbuf + ( ts - buf );
-			te = newbuf + ( te - buf );
-
-			/* Copy the new buffer in. */
-			memcpy( newbuf, buf, have );
-			delete[] buf;
-			buf = newbuf;
-		}
-
-		input.read( p, space );
-		int len = input.gcount();
-		char *pe = p + len;
-
-		/* If we see eof then append the eof var. */
-		char *eof = 0;
-	 	if ( len == 0 ) {
-			eof = pe;
-			execute = false;
-		}
-
-		%% write exec;
 
-		/* Check if we failed. */
-		if ( cs == rlscan_error ) {
-			/* Machine failed before finding a token. I'm not yet sure if this
-			 * is reachable. */
-			scan_error() << "scanner error" << endl;
-			exit(1);
-		}
+	/* The whole file is in memory, it is scanned in one go. */
+	char *p = input.data;
+	char *pe = input.data + input.length;
+	char *eof = pe;
 
-		/* Decide if we need to preserve anything. */
-		char *preserve = ts;
+	%% write exec;
 
-		/* Now set up the prefix. */
-		if ( preserve == 0 )
-			have = 0;
-		else {
-			/* There is data that needs to be shifted over. */
-			have = pe - preserve;
-			memmove( buf, preserve, have );
-			unsigned int shiftback = preserve - buf;
-			if ( ts != 0 )
-				ts -= shiftback;
-			te -= shiftback;
-
-			preserve = buf;
-		}
+	/* Check if we failed. */
+	if ( cs == rlscan_error ) {
+		/* Machine failed before finding a token. I'm not yet sure if this
+		 * is reachable. */
+		scan_error() << "scanner error" << endl;
+		exit(1);
 	}
-
-	delete[] buf;
 }
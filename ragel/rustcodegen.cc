@@ -151,7 +151,7 @@ void RustTabCodeGen::RET( ostream &ret, bool inFinish )
 	ret <<
 		"{\n"
 		"    " << TOP() << " -= 1;\n"
-		"    " << vCS() << " = " << STACK() << "[" << TOP() << "] as int;";
+		"    " << vCS() << " = " << STACK() << "[" << TOP() << "] as " << STATE_TYPE() << ";";
 
 	if ( postPopExpr != 0 ) {
 		ret << "    {";
@@ -1260,6 +1260,9 @@ std::ostream &RustTabCodeGen::OPEN_ARRAY( string type, string name )
 	item_count = 0;
 	div_count = 1;
 
+	if ( currentRust )
+		out << "#[allow(dead_code, non_upper_case_globals)]\n";
+
 	out <<
 		"static " << name << ": &'static [" << type << "] = &[\n";
 
@@ -1294,9 +1297,12 @@ std::ostream &RustTabCodeGen::CLOSE_ARRAY()
 
 std::ostream &RustTabCodeGen::STATIC_VAR( string type, string name )
 {
-	out <<
-		"#[allow(dead_code)]\n" <<
-		"static " << name << ": " << type;
+	if ( currentRust )
+		out << "#[allow(dead_code, non_upper_case_globals)]\n";
+	else
+		out << "#[allow(dead_code)]\n";
+
+	out << "static " << name << ": " << type;
 	return out;
 }
 
@@ -1305,9 +1311,40 @@ string RustTabCodeGen::ARR_OFF( string ptr, string offset )
 	return ptr + " + " + offset;
 }
 
+/* Reads an item of a table or of the input. The index is a usize. Without
+ * bounds checks the caller of the machine must keep p and pe within the
+ * data. */
+string RustTabCodeGen::ARR_REF( string table, string index )
+{
+	if ( unchecked )
+		return "(unsafe { *" + table + ".get_unchecked(" + index + ") })";
+	return table + "[" + index + "]";
+}
+
+/* The current state as an index into the tables. */
+string RustTabCodeGen::CS_INDEX()
+{
+	return "(" + vCS() + " as usize)";
+}
+
+/* The type that states are held in. */
+string RustTabCodeGen::STATE_TYPE()
+{
+	return currentRust ? "i32" : "int";
+}
+
+/* The arm of a match that is never taken. */
+string RustTabCodeGen::UNREACHABLE()
+{
+	return currentRust ? "unreachable!()" : "fail!()";
+}
+
 string RustTabCodeGen::NULL_ITEM()
 {
-	/* In rust we use integers instead of pointers. */
+	/* In rust we use integers instead of pointers. With usize positions the
+	 * token start and end are cleared to zero. */
+	if ( currentRust )
+		return "0";
 	return "-1";
 }
 
@@ -1322,7 +1359,10 @@ string RustTabCodeGen::GET_KEY()
 	}
 	else {
 		/* Expression for retrieving the key, use simple dereference. */
-		ret << DATA() << "[" << P() << "]";
+		if ( currentRust )
+			ret << ARR_REF( DATA(), P() );
+		else
+			ret << DATA() << "[" << P() << "]";
 	}
 	return ret.str();
 }
@@ -1332,18 +1372,32 @@ string RustTabCodeGen::CTRL_FLOW()
 	return "";
 }
 
-unsigned int RustTabCodeGen::arrayTypeSize( unsigned long maxVal )
+/* The items of the tables other than the keys are never negative, so the
+ * current dialect gives them the smallest unsigned type. */
+HostType *RustTabCodeGen::arrayHostType( unsigned long maxVal )
 {
 	long long maxValLL = (long long) maxVal;
-	HostType *arrayType = keyOps->typeSubsumes( maxValLL );
+	if ( !currentRust )
+		return keyOps->typeSubsumes( maxValLL );
+
+	for ( int i = 0; i < hostLang->numHostTypes; i++ ) {
+		if ( !hostLang->hostTypes[i].isSigned &&
+				maxValLL <= hostLang->hostTypes[i].maxVal )
+			return hostLang->hostTypes + i;
+	}
+	return 0;
+}
+
+unsigned int RustTabCodeGen::arrayTypeSize( unsigned long maxVal )
+{
+	HostType *arrayType = arrayHostType( maxVal );
 	assert( arrayType != 0 );
 	return arrayType->size;
 }
 
 string RustTabCodeGen::ARRAY_TYPE( unsigned long maxVal )
 {
-	long long maxValLL = (long long) maxVal;
-	HostType *arrayType = keyOps->typeSubsumes( maxValLL );
+	HostType *arrayType = arrayHostType( maxVal );
 	assert( arrayType != 0 );
 
 	string ret = arrayType->data1;
@@ -1573,10 +1627,13 @@ void RustTabCodeGen::LM_SWITCH( ostream &ret, GenInlineItem *item,
 	ret <<
 		"    match " << ACT() << " {\n";
 
+	bool anyDefault = false;
 	for ( GenInlineList::Iter lma = *item->children; lma.lte(); lma++ ) {
 		/* Write the match label and the action. */
-		if ( lma->lmId < 0 )
+		if ( lma->lmId < 0 ) {
 			ret << "      _ => {\n";
+			anyDefault = true;
+		}
 		else
 			ret << "      " << lma->lmId << " => {\n";
 
@@ -1588,8 +1645,11 @@ void RustTabCodeGen::LM_SWITCH( ostream &ret, GenInlineItem *item,
 		ret << "      }\n";
 	}
 
-  ret <<
-	"        _ => fail!()";
+	/* A second catch all arm would not be reachable. */
+	if ( !currentRust )
+		ret << "        _ => fail!()";
+	else if ( !anyDefault )
+		ret << "        _ => " << UNREACHABLE() << "\n";
 
 	ret <<
 		"    }\n"
@@ -1709,7 +1769,10 @@ void RustTabCodeGen::finishRagelDef()
 	redFsm->chooseDefaultSpan();
 		
 	/* Maybe do flat expand, otherwise choose single. */
-	redFsm->chooseSingle();
+	if ( codeStyle == GenFFlat )
+		redFsm->makeFlat();
+	else
+		redFsm->chooseSingle();
 
 	/* If any errors have occured in the input file then don't write anything. */
 	if ( gblErrorCount > 0 )
@@ -38,7 +38,15 @@ using std::ostream;
 struct RustTabCodeGen : public CodeGenData
 {
 	RustTabCodeGen( ostream &out ) :
-		CodeGenData(out) {}
+		CodeGenData(out), unchecked(false), currentRust(false) {}
+
+	/* Read the input and the tables with get_unchecked. */
+	bool unchecked;
+
+	/* Write the Rust that current compilers accept: the input and the tables
+	 * are indexed with usize and the state is an i32. Set by the -F1 and -G1
+	 * styles. -T0 writes the dialect it always has. */
+	bool currentRust;
 
 	std::ostream &TO_STATE_ACTION_SWITCH();
 	std::ostream &FROM_STATE_ACTION_SWITCH();
@@ -86,10 +94,10 @@ struct RustTabCodeGen : public CodeGenData
 	void NEXT( ostream &ret, int nextDest, bool inFinish );
 	void NEXT_EXPR( ostream &ret, GenInlineItem *ilItem, bool inFinish );
 
-	int TO_STATE_ACTION( RedStateAp *state );
-	int FROM_STATE_ACTION( RedStateAp *state );
-	int EOF_ACTION( RedStateAp *state );
-	int TRANS_ACTION( RedTransAp *trans );
+	virtual int TO_STATE_ACTION( RedStateAp *state );
+	virtual int FROM_STATE_ACTION( RedStateAp *state );
+	virtual int EOF_ACTION( RedStateAp *state );
+	virtual int TRANS_ACTION( RedTransAp *trans );
 
 	/* Determine if we should use indicies. */
 	void calcIndexSize();
@@ -109,6 +117,10 @@ public:
 	virtual ostream &CLOSE_ARRAY();
 	virtual ostream &STATIC_VAR( string type, string name );
 	virtual string ARR_OFF( string ptr, string offset );
+	string ARR_REF( string table, string index );
+	string CS_INDEX();
+	string STATE_TYPE();
+	string UNREACHABLE();
 	virtual string GET_KEY();
 	virtual string CTRL_FLOW();
 
@@ -185,6 +197,7 @@ public:
 	ostream &source_warning(const InputLoc &loc);
 	ostream &source_error(const InputLoc &loc);
 
+	HostType *arrayHostType( unsigned long maxVal );
 	unsigned int arrayTypeSize( unsigned long maxVal );
 
 	bool outLabelUsed;
@@ -0,0 +1,659 @@
+/*
+ *  Copyright 2006-2007 Adrian Thurston <thurston@complang.org>
+ *            2007 Colin Fleming <colin.fleming@caverock.com>
+ *            2026 Ragel contributors
+ */
+
+/*  This file is part of Ragel.
+ *
+ *  Ragel is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  Ragel is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with Ragel; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
+ */
+
+#include "ragel.h"
+#include "rustfflat.h"
+#include "redfsm.h"
+#include "gendata.h"
+
+#define _resume    1
+#define _again     2
+#define _eof_trans 3
+#define _test_eof  4
+#define _out       5
+
+int RustFFlatCodeGen::TO_STATE_ACTION( RedStateAp *state )
+{
+	int act = 0;
+	if ( state->toStateAction != 0 )
+		act = state->toStateAction->actListId+1;
+	return act;
+}
+
+int RustFFlatCodeGen::FROM_STATE_ACTION( RedStateAp *state )
+{
+	int act = 0;
+	if ( state->fromStateAction != 0 )
+		act = state->fromStateAction->actListId+1;
+	return act;
+}
+
+int RustFFlatCodeGen::EOF_ACTION( RedStateAp *state )
+{
+	int act = 0;
+	if ( state->eofAction != 0 )
+		act = state->eofAction->actListId+1;
+	return act;
+}
+
+int RustFFlatCodeGen::TRANS_ACTION( RedTransAp *trans )
+{
+	int act = 0;
+	if ( trans->action != 0 )
+		act = trans->action->actListId+1;
+	return act;
+}
+
+/* Write out the function match. This match is keyed on the values
+ * of the func index. */
+std::ostream &RustFFlatCodeGen::TO_STATE_ACTION_SWITCH()
+{
+	/* Loop the actions. */
+	for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+		if ( redAct->numToStateRefs > 0 ) {
+			/* Write the match label. */
+			out << "                " << redAct->actListId+1 << " => {\n";
+
+			/* Write each action in the list of action items. */
+			for ( GenActionTable::Iter item = redAct->key; item.lte(); item++ )
+				ACTION( out, item->value, 0, false );
+
+			out << "                }\n";
+		}
+	}
+
+	genLineDirective( out );
+	return out;
+}
+
+/* Write out the function match. This match is keyed on the values
+ * of the func index. */
+std::ostream &RustFFlatCodeGen::FROM_STATE_ACTION_SWITCH()
+{
+	/* Loop the actions. */
+	for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+		if ( redAct->numFromStateRefs > 0 ) {
+			/* Write the match label. */
+			out << "                " << redAct->actListId+1 << " => {\n";
+
+			/* Write each action in the list of action items. */
+			for ( GenActionTable::Iter item = redAct->key; item.lte(); item++ )
+				ACTION( out, item->value, 0, false );
+
+			out << "                }\n";
+		}
+	}
+
+	genLineDirective( out );
+	return out;
+}
+
+std::ostream &RustFFlatCodeGen::EOF_ACTION_SWITCH()
+{
+	/* Loop the actions. */
+	for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+		if ( redAct->numEofRefs > 0 ) {
+			/* Write the match label. */
+			out << "                    " << redAct->actListId+1 << " => {\n";
+
+			/* Write each action in the list of action items. */
+			for ( GenActionTable::Iter item = redAct->key; item.lte(); item++ )
+				ACTION( out, item->value, 0, true );
+
+			out << "                    }\n";
+		}
+	}
+
+	genLineDirective( out );
+	return out;
+}
+
+/* Write out the function match. This match is keyed on the values
+ * of the func index. */
+std::ostream &RustFFlatCodeGen::ACTION_SWITCH()
+{
+	/* Loop the actions. */
+	for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+		if ( redAct->numTransRefs > 0 ) {
+			/* Write the match label. */
+			out << "                " << redAct->actListId+1 << " => {\n";
+
+			/* Write each action in the list of action items. */
+			for ( GenActionTable::Iter item = redAct->key; item.lte(); item++ )
+				ACTION( out, item->value, 0, false );
+
+			out << "                }\n";
+		}
+	}
+
+	genLineDirective( out );
+	return out;
+}
+
+std::ostream &RustFFlatCodeGen::KEYS()
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		/* Emit just low key and high key. */
+		ARRAY_ITEM( KEY( st->lowKey ), false );
+		ARRAY_ITEM( KEY( st->highKey ), false );
+	}
+
+	/* Output one last number so we don't have to figure out when the last
+	 * entry is and avoid writing a comma. */
+	ARRAY_ITEM( INT(0), true );
+	return out;
+}
+
+std::ostream &RustFFlatCodeGen::INDICIES()
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st->transList != 0 ) {
+			/* Walk the singles. */
+			unsigned long long span = keyOps->span( st->lowKey, st->highKey );
+			for ( unsigned long long pos = 0; pos < span; pos++ )
+				ARRAY_ITEM( INT( st->transList[pos]->id ), false );
+		}
+
+		/* The state's default index goes next. */
+		if ( st->defTrans != 0 )
+			ARRAY_ITEM( INT( st->defTrans->id ), false );
+	}
+
+	/* Output one last number so we don't have to figure out when the last
+	 * entry is and avoid writing a comma. */
+	ARRAY_ITEM( INT(0), true );
+	return out;
+}
+
+std::ostream &RustFFlatCodeGen::FLAT_INDEX_OFFSET()
+{
+	int curIndOffset = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		/* Write the index offset. */
+		ARRAY_ITEM( INT(curIndOffset), st.last() );
+
+		/* Move the index offset ahead. */
+		if ( st->transList != 0 )
+			curIndOffset += keyOps->span( st->lowKey, st->highKey );
+
+		if ( st->defTrans != 0 )
+			curIndOffset += 1;
+	}
+	return out;
+}
+
+std::ostream &RustFFlatCodeGen::KEY_SPANS()
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		/* Write singles length. */
+		unsigned long long span = 0;
+		if ( st->transList != 0 )
+			span = keyOps->span( st->lowKey, st->highKey );
+		ARRAY_ITEM( INT(span), st.last() );
+	}
+	return out;
+}
+
+std::ostream &RustFFlatCodeGen::TRANS_TARGS()
+{
+	/* Transitions must be written ordered by their id. */
+	RedTransAp **transPtrs = new RedTransAp*[redFsm->transSet.length()];
+	for ( TransApSet::Iter trans = redFsm->transSet; trans.lte(); trans++ )
+		transPtrs[trans->id] = trans;
+
+	/* Keep a count of the num of items in the array written. */
+	for ( int t = 0; t < redFsm->transSet.length(); t++ ) {
+		/* Save the position. Needed for eofTargs. */
+		RedTransAp *trans = transPtrs[t];
+		trans->pos = t;
+
+		/* Write out the target state. */
+		ARRAY_ITEM( INT(trans->targ->id), ( t >= redFsm->transSet.length()-1 ) );
+	}
+	delete[] transPtrs;
+	return out;
+}
+
+std::ostream &RustFFlatCodeGen::TRANS_ACTIONS()
+{
+	/* Transitions must be written ordered by their id. */
+	RedTransAp **transPtrs = new RedTransAp*[redFsm->transSet.length()];
+	for ( TransApSet::Iter trans = redFsm->transSet; trans.lte(); trans++ )
+		transPtrs[trans->id] = trans;
+
+	/* Keep a count of the num of items in the array written. */
+	for ( int t = 0; t < redFsm->transSet.length(); t++ ) {
+		/* Write the function for the transition. */
+		RedTransAp *trans = transPtrs[t];
+		ARRAY_ITEM( INT(TRANS_ACTION( trans )), ( t >= redFsm->transSet.length()-1 ) );
+	}
+	delete[] transPtrs;
+	return out;
+}
+
+void RustFFlatCodeGen::LOCATE_TRANS()
+{
+	/* The key is read once. Without conditions it keeps the alphabet type
+	 * of the data and is compared with the bounds of the span as it is. The
+	 * offset into the span is taken in isize so that signed keys cannot
+	 * overflow. */
+	string cast = redFsm->anyConditions() ? " as isize" : "";
+
+	out <<
+		"            let _key = " << GET_WIDE_KEY() << ";\n"
+		"            _keys = " << CS_INDEX() << " << 1;\n"
+		"            let _low = " << ARR_REF( K(), "_keys" ) << cast << ";\n"
+		"            let _high = " << ARR_REF( K(), "_keys + 1" ) << cast << ";\n"
+		"            _inds = " << ARR_REF( IO(), CS_INDEX() ) << " as usize;\n"
+		"            _slen = " << ARR_REF( SP(), CS_INDEX() ) << " as usize;\n"
+		"            _trans = if _slen > 0 && _low <= _key && _key <= _high {\n"
+		"                (_key as isize - _low as isize) as usize\n"
+		"            } else {\n"
+		"                _slen\n"
+		"            };\n"
+		"            _trans = " << ARR_REF( I(), "_inds + _trans" ) << " as usize;\n"
+		"\n";
+}
+
+std::ostream &RustFFlatCodeGen::COND_INDEX_OFFSET()
+{
+	int curIndOffset = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		/* Write the index offset. */
+		ARRAY_ITEM( INT(curIndOffset), st.last() );
+
+		/* Move the index offset ahead. */
+		if ( st->condList != 0 )
+			curIndOffset += keyOps->span( st->condLowKey, st->condHighKey );
+	}
+	return out;
+}
+
+void RustFFlatCodeGen::COND_TRANSLATE()
+{
+	out <<
+		"            _widec = " << GET_KEY() << " as isize;\n"
+		"            _keys = " << CS_INDEX() << " << 1;\n"
+		"            let _low = " << ARR_REF( CK(), "_keys" ) << " as isize;\n"
+		"            let _high = " << ARR_REF( CK(), "_keys + 1" ) << " as isize;\n"
+		"            _conds = " << ARR_REF( CO(), CS_INDEX() ) << " as usize;\n"
+		"            _slen = " << ARR_REF( CSP(), CS_INDEX() ) << " as usize;\n"
+		"            _cond = if _slen > 0 && _low <= _widec && _widec <= _high {\n"
+		"                " << ARR_REF( C(), "_conds + (_widec - _low) as usize" ) << " as i32\n"
+		"            } else {\n"
+		"                0\n"
+		"            };\n"
+		"\n";
+
+	out <<
+		"            match _cond {\n";
+	for ( CondSpaceList::Iter csi = condSpaceList; csi.lte(); csi++ ) {
+		GenCondSpace *condSpace = csi;
+		out << "                " << condSpace->condSpaceId + 1 << " => {\n";
+		out << "                    _widec = " << KEY(condSpace->baseKey) <<
+				" + (" << GET_KEY() << " as isize - " << KEY(keyOps->minKey) << ");\n";
+
+		for ( GenCondSet::Iter csi = condSpace->condSet; csi.lte(); csi++ ) {
+			out << "                    if ";
+			CONDITION( out, *csi );
+			Size condValOffset = ((1 << csi.pos()) * keyOps->alphSize());
+			out << " { _widec += " << condValOffset << "; }\n";
+		}
+
+		out <<
+			"                }\n";
+	}
+
+	out <<
+		"                _ => {}\n"
+		"            }\n"
+		"\n";
+}
+
+std::ostream &RustFFlatCodeGen::CONDS()
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st->condList != 0 ) {
+			/* Walk the singles. */
+			unsigned long long span = keyOps->span( st->condLowKey, st->condHighKey );
+			for ( unsigned long long pos = 0; pos < span; pos++ ) {
+				if ( st->condList[pos] != 0 )
+					ARRAY_ITEM( INT( st->condList[pos]->condSpaceId + 1 ), false );
+				else
+					ARRAY_ITEM( INT(0), false );
+			}
+		}
+	}
+
+	/* Output one last number so we don't have to figure out when the last
+	 * entry is and avoid writing a comma. */
+	ARRAY_ITEM( INT(0), true );
+	return out;
+}
+
+std::ostream &RustFFlatCodeGen::COND_KEYS()
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		/* Emit just cond low key and cond high key. */
+		ARRAY_ITEM( KEY( st->condLowKey ), false );
+		ARRAY_ITEM( KEY( st->condHighKey ), false );
+	}
+
+	/* Output one last number so we don't have to figure out when the last
+	 * entry is and avoid writing a comma. */
+	ARRAY_ITEM( INT(0), true );
+	return out;
+}
+
+std::ostream &RustFFlatCodeGen::COND_KEY_SPANS()
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		/* Write singles length. */
+		unsigned long long span = 0;
+		if ( st->condList != 0 )
+			span = keyOps->span( st->condLowKey, st->condHighKey );
+		ARRAY_ITEM( INT(span), st.last() );
+	}
+	return out;
+}
+
+void RustFFlatCodeGen::writeData()
+{
+	if ( redFsm->anyConditions() ) {
+		OPEN_ARRAY( WIDE_ALPH_TYPE(), CK() );
+		COND_KEYS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxCondSpan), CSP() );
+		COND_KEY_SPANS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxCond), C() );
+		CONDS();
+		CLOSE_ARRAY() <<
+		"\n";
+
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxCondIndexOffset), CO() );
+		COND_INDEX_OFFSET();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	OPEN_ARRAY( WIDE_ALPH_TYPE(), K() );
+	KEYS();
+	CLOSE_ARRAY() <<
+	"\n";
+
+	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxSpan), SP() );
+	KEY_SPANS();
+	CLOSE_ARRAY() <<
+	"\n";
+
+	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxFlatIndexOffset), IO() );
+	FLAT_INDEX_OFFSET();
+	CLOSE_ARRAY() <<
+	"\n";
+
+	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxIndex), I() );
+	INDICIES();
+	CLOSE_ARRAY() <<
+	"\n";
+
+	OPEN_ARRAY( ARRAY_TYPE(redFsm->maxState), TT() );
+	TRANS_TARGS();
+	CLOSE_ARRAY() <<
+	"\n";
+
+	if ( redFsm->anyActions() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxActListId), TA() );
+		TRANS_ACTIONS();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( redFsm->anyToStateActions() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxActListId), TSA() );
+		TO_STATE_ACTIONS();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( redFsm->anyFromStateActions() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxActListId), FSA() );
+		FROM_STATE_ACTIONS();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( redFsm->anyEofActions() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxActListId), EA() );
+		EOF_ACTIONS();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( redFsm->anyEofTrans() ) {
+		OPEN_ARRAY( ARRAY_TYPE(redFsm->maxIndexOffset+1), ET() );
+		EOF_TRANS();
+		CLOSE_ARRAY() <<
+		"\n";
+	}
+
+	if ( redFsm->startState != 0 )
+		STATIC_VAR( "i32", START() ) << " = " << START_STATE_ID() << ";\n";
+
+	if ( !noFinal )
+		STATIC_VAR( "i32", FIRST_FINAL() ) << " = " << FIRST_FINAL_STATE() << ";\n";
+
+	if ( !noError )
+		STATIC_VAR( "i32", ERROR() ) << " = " << ERROR_STATE() << ";\n";
+	
+	out << "\n";
+
+	if ( entryPointNames.length() > 0 ) {
+		for ( EntryNameVect::Iter en = entryPointNames; en.lte(); en++ ) {
+			STATIC_VAR( "i32", DATA_PREFIX() + "en_" + *en ) <<
+					" = " << entryPointIds[en.pos()] << ";\n";
+		}
+		out << "\n";
+	}
+}
+
+void RustFFlatCodeGen::writeExec()
+{
+	out <<
+		"{\n"
+		"    let mut _slen: usize;\n";
+
+	if ( redFsm->anyRegCurStateRef() )
+		out << "    let mut _ps: i32 = 0;\n";
+
+	out << "    let mut _trans: usize = 0;\n";
+
+	if ( redFsm->anyConditions() ) {
+		out <<
+			"    let mut _widec: isize;\n"
+			"    let mut _cond: i32;\n"
+			"    let mut _conds: usize;\n";
+	}
+
+	out <<
+		"    let mut _keys: usize;\n"
+		"    let mut _inds: usize;\n"
+		"    let mut _goto_targ = 0;\n"
+		"\n";
+
+	out <<
+		"    '_goto: loop {\n"
+		"        match _goto_targ {\n"
+		"          0 => {\n";
+
+	if ( !noEnd ) {
+		out <<
+			"            if " << P() << " == " << PE() << " {\n"
+			"                _goto_targ = " << _test_eof << ";\n"
+			"                continue '_goto;\n"
+			"            }\n";
+	}
+
+	if ( redFsm->errState != 0 ) {
+		out <<
+			"            if " << vCS() << " == " << redFsm->errState->id << " {\n"
+			"                _goto_targ = " << _out << ";\n"
+			"                continue '_goto;\n"
+			"            }\n";
+	}
+
+	out <<
+		"            _goto_targ = " << _resume << ";\n"
+		"            continue '_goto;\n"
+		"          }\n"
+		"          " << _resume << " => {\n";
+
+	if ( redFsm->anyFromStateActions() ) {
+		out <<
+			"            match " << ARR_REF( FSA(), CS_INDEX() ) << " {\n";
+			FROM_STATE_ACTION_SWITCH() <<
+			"                _ => {}\n"
+			"            }\n"
+			"\n";
+	}
+
+	if ( redFsm->anyConditions() )
+		COND_TRANSLATE();
+
+	LOCATE_TRANS();
+
+	if ( redFsm->anyEofTrans() ) {
+		out <<
+			"            _goto_targ = " << _eof_trans << ";\n"
+			"            continue '_goto;\n"
+			"          }\n"
+			"          " << _eof_trans << " => {\n";
+	}
+
+	if ( redFsm->anyRegCurStateRef() )
+		out << "            _ps = " << vCS() << ";\n";
+
+	out <<
+		"            " << vCS() << " = " << ARR_REF( TT(), "_trans" ) << " as i32;\n"
+		"\n";
+
+	if ( redFsm->anyRegActions() ) {
+		out <<
+			"            match " << ARR_REF( TA(), "_trans" ) << " {\n";
+			ACTION_SWITCH() <<
+			"                _ => {}\n"
+			"            }\n"
+			"\n";
+	}
+
+	out <<
+		"            _goto_targ = " << _again << ";\n"
+		"            continue '_goto;\n"
+		"          }\n"
+		"          " << _again << " => {\n";
+
+	if ( redFsm->anyToStateActions() ) {
+		out <<
+			"            match " << ARR_REF( TSA(), CS_INDEX() ) << " {\n";
+			TO_STATE_ACTION_SWITCH() <<
+			"                _ => {}\n"
+			"            }\n"
+			"\n";
+	}
+
+	if ( redFsm->errState != 0 ) {
+		out <<
+			"            if " << vCS() << " == " << redFsm->errState->id << " {\n"
+			"                _goto_targ = " << _out << ";\n"
+			"                continue '_goto;\n"
+			"            }\n";
+	}
+
+	if ( !noEnd ) {
+		out <<
+			"            " << P() << " += 1;\n"
+			"            if " << P() << " != " << PE() << " {\n"
+			"                _goto_targ = " << _resume << ";\n"
+			"                continue '_goto;\n"
+			"            }\n"
+			"            _goto_targ = " << _test_eof << ";\n"
+			"            continue '_goto;\n";
+	}
+	else {
+		out <<
+			"            " << P() << " += 1;\n"
+			"            _goto_targ = " << _resume << ";\n"
+			"            continue '_goto;\n";
+	}
+
+	out <<
+		"          }\n";
+
+	if ( redFsm->anyEofTrans() || redFsm->anyEofActions() ) {
+		out <<
+			"          " << _test_eof << " => {\n"
+			"            if " << P() << " == " << vEOF() << " {\n";
+
+		if ( redFsm->anyEofTrans() ) {
+			out <<
+				"                if " << ARR_REF( ET(), CS_INDEX() ) << " > 0 {\n"
+				"                    _trans = " << ARR_REF( ET(), CS_INDEX() ) << " as usize - 1;\n"
+				"                    _goto_targ = " << _eof_trans << ";\n"
+				"                    continue '_goto;\n"
+				"                }\n";
+		}
+
+		if ( redFsm->anyEofActions() ) {
+			out <<
+				"                match " << ARR_REF( EA(), CS_INDEX() ) << " {\n";
+				EOF_ACTION_SWITCH() <<
+				"                    _ => {}\n"
+				"                }\n";
+		}
+
+		out <<
+			"            }\n"
+			"          }\n";
+	}
+	else {
+		out <<
+			"          " << _test_eof << " => { }\n";
+	}
+
+	out <<
+		"          " << _out << " => { }\n"
+		"          _ => " << UNREACHABLE() << ",\n";
+
+	/* The match and goto loop. */
+	out <<
+		"        }\n"
+		"        break;\n"
+		"    }\n";
+
+	/* The execute block. */
+	out << "}\n";
+}
@@ -0,0 +1,469 @@
+/*
+ *  Copyright 2006-2007 Adrian Thurston <thurston@complang.org>
+ *            2007 Colin Fleming <colin.fleming@caverock.com>
+ *            2026 Ragel contributors
+ */
+
+/*  This file is part of Ragel.
+ *
+ *  Ragel is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  Ragel is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with Ragel; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
+ */
+
+#include "ragel.h"
+#include "rustfgoto.h"
+#include "redfsm.h"
+#include "gendata.h"
+#include <sstream>
+
+using std::ostringstream;
+
+#define _resume    1
+#define _again     2
+#define _eof_trans 3
+#define _test_eof  4
+#define _out       5
+
+/* Rust has no goto. The states are the arms of a match on the current state
+ * and each one matches the key, giving the target state and the action list
+ * of the transition. The action lists are then run from a match on the list
+ * id, as the goto code of other languages does. */
+
+/* Write out the function match. This match is keyed on the action list ids
+ * that the transitions give. */
+std::ostream &RustFGotoCodeGen::ACTION_SWITCH()
+{
+	/* Loop the actions. */
+	for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+		if ( redAct->numTransRefs > 0 ) {
+			/* Write the match label. */
+			out << "                " << redAct->actListId+1 << " => {\n";
+
+			/* Write each action in the list of action items. */
+			for ( GenActionTable::Iter item = redAct->key; item.lte(); item++ )
+				ACTION( out, item->value, 0, false );
+
+			out << "                }\n";
+		}
+	}
+
+	genLineDirective( out );
+	return out;
+}
+
+/* The state actions are matched on the state. The states that share an
+ * action list share an arm. */
+std::ostream &RustFGotoCodeGen::TO_STATE_ACTION_SWITCH()
+{
+	for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+		if ( redAct->numToStateRefs > 0 ) {
+			out << "               ";
+			const char *sep = " ";
+			for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+				if ( st->toStateAction == redAct ) {
+					out << sep << st->id;
+					sep = " | ";
+				}
+			}
+			out << " => {\n";
+
+			/* Write each action in the list of action items. */
+			for ( GenActionTable::Iter item = redAct->key; item.lte(); item++ )
+				ACTION( out, item->value, 0, false );
+
+			out << "                }\n";
+		}
+	}
+
+	genLineDirective( out );
+	return out;
+}
+
+std::ostream &RustFGotoCodeGen::FROM_STATE_ACTION_SWITCH()
+{
+	for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+		if ( redAct->numFromStateRefs > 0 ) {
+			out << "               ";
+			const char *sep = " ";
+			for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+				if ( st->fromStateAction == redAct ) {
+					out << sep << st->id;
+					sep = " | ";
+				}
+			}
+			out << " => {\n";
+
+			/* Write each action in the list of action items. */
+			for ( GenActionTable::Iter item = redAct->key; item.lte(); item++ )
+				ACTION( out, item->value, 0, false );
+
+			out << "                }\n";
+		}
+	}
+
+	genLineDirective( out );
+	return out;
+}
+
+std::ostream &RustFGotoCodeGen::EOF_ACTION_SWITCH()
+{
+	for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+		if ( redAct->numEofRefs > 0 ) {
+			out << "                   ";
+			const char *sep = " ";
+			for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+				if ( st->eofAction == redAct ) {
+					out << sep << st->id;
+					sep = " | ";
+				}
+			}
+			out << " => {\n";
+
+			/* Write each action in the list of action items. */
+			for ( GenActionTable::Iter item = redAct->key; item.lte(); item++ )
+				ACTION( out, item->value, 0, true );
+
+			out << "                    }\n";
+		}
+	}
+
+	genLineDirective( out );
+	return out;
+}
+
+/* The eof transitions set the state and action list like the transitions
+ * taken on a key, then join them. */
+std::ostream &RustFGotoCodeGen::EOF_TRANS_SWITCH()
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st->eofTrans != 0 ) {
+			out << "                    " << st->id << " => {\n";
+
+			if ( redFsm->anyRegCurStateRef() )
+				out << "                        _ps = " << vCS() << ";\n";
+
+			out << "                        " << vCS() << " = " << st->eofTrans->targ->id << ";\n";
+
+			if ( redFsm->anyRegActions() ) {
+				int act = 0;
+				if ( st->eofTrans->action != 0 )
+					act = st->eofTrans->action->actListId+1;
+				out <<
+					"                        _acts = " << act << ";\n"
+					"                        _goto_targ = " << _eof_trans << ";\n";
+			}
+			else {
+				out << "                        _goto_targ = " << _again << ";\n";
+			}
+
+			out <<
+				"                        continue '_goto;\n"
+				"                    }\n";
+		}
+	}
+	return out;
+}
+
+/* Conditions are resolved in the states that have them by widening the key
+ * before matching it. */
+void RustFGotoCodeGen::COND_TRANSLATE( RedStateAp *state )
+{
+	out << "                    _widec = " << GET_KEY() << " as isize;\n";
+
+	for ( GenStateCondList::Iter sc = state->stateCondList; sc.lte(); sc++ ) {
+		GenCondSpace *condSpace = sc->condSpace;
+
+		out << "                    " << ( sc.first() ? "if " : "else if " ) <<
+				KEY(sc->lowKey) << " <= _widec && _widec <= " <<
+				KEY(sc->highKey) << " {\n";
+
+		out << "                        _widec = " << KEY(condSpace->baseKey) <<
+				" + (_widec - " << KEY(keyOps->minKey) << ");\n";
+
+		for ( GenCondSet::Iter csi = condSpace->condSet; csi.lte(); csi++ ) {
+			out << "                        if ";
+			CONDITION( out, *csi );
+			Size condValOffset = ((1 << csi.pos()) * keyOps->alphSize());
+			out << " { _widec += " << condValOffset << "; }\n";
+		}
+
+		out << "                    }\n";
+	}
+}
+
+/* Pattern of a match arm that takes a range of keys. A range over the whole
+ * alphabet gives an empty pattern, meaning any key. */
+string RustFGotoCodeGen::RANGE_PATTERN( RedStateAp *state, Key lowKey, Key highKey )
+{
+	bool wide = state->stateCondList.length() > 0;
+	if ( !wide && lowKey == keyOps->minKey && highKey == keyOps->maxKey )
+		return "";
+	return KEY(lowKey) + "..=" + KEY(highKey);
+}
+
+/* Write the body of a match arm that takes a transition. */
+void RustFGotoCodeGen::TRANS_GOTO( RedTransAp *trans )
+{
+	out << "{ " << vCS() << " = " << trans->targ->id << ";";
+
+	if ( redFsm->anyRegActions() ) {
+		int act = 0;
+		if ( trans->action != 0 )
+			act = trans->action->actListId+1;
+		out << " " << act;
+	}
+
+	out << " }\n";
+}
+
+std::ostream &RustFGotoCodeGen::STATE_GOTOS()
+{
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		/* The error state is left by the check before the resume. */
+		if ( st == redFsm->errState )
+			continue;
+
+		out << "                " << st->id << " => {\n";
+
+		if ( st->stateCondList.length() > 0 )
+			COND_TRANSLATE( st );
+
+		out << "                    match " << GET_WIDE_KEY( st ) << " {\n";
+
+		/* The arm that is last gets the keys not otherwise matched. Without
+		 * a default transition the ranges cover them. */
+		int numArms = st->outSingle.length() + st->outRange.length();
+		bool anyCatchAll = false;
+		int arm = 0;
+
+		for ( RedTransList::Iter stel = st->outSingle; stel.lte(); stel++, arm++ ) {
+			if ( st->defTrans == 0 && arm == numArms - 1 )
+				out << "                        _ => ";
+			else
+				out << "                        " << KEY(stel->lowKey) << " => ";
+			TRANS_GOTO( stel->value );
+		}
+
+		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++, arm++ ) {
+			string pattern = RANGE_PATTERN( st, rtel->lowKey, rtel->highKey );
+			if ( ( st->defTrans == 0 && arm == numArms - 1 ) || pattern.size() == 0 ) {
+				out << "                        _ => ";
+				TRANS_GOTO( rtel->value );
+				anyCatchAll = true;
+				break;
+			}
+
+			out << "                        " << pattern << " => ";
+			TRANS_GOTO( rtel->value );
+		}
+
+		if ( st->defTrans != 0 && !anyCatchAll ) {
+			out << "                        _ => ";
+			TRANS_GOTO( st->defTrans );
+		}
+
+		out <<
+			"                    }\n"
+			"                }\n";
+	}
+	return out;
+}
+
+void RustFGotoCodeGen::writeData()
+{
+	if ( redFsm->startState != 0 )
+		STATIC_VAR( "i32", START() ) << " = " << START_STATE_ID() << ";\n";
+
+	if ( !noFinal )
+		STATIC_VAR( "i32", FIRST_FINAL() ) << " = " << FIRST_FINAL_STATE() << ";\n";
+
+	if ( !noError )
+		STATIC_VAR( "i32", ERROR() ) << " = " << ERROR_STATE() << ";\n";
+	
+	out << "\n";
+
+	if ( entryPointNames.length() > 0 ) {
+		for ( EntryNameVect::Iter en = entryPointNames; en.lte(); en++ ) {
+			STATIC_VAR( "i32", DATA_PREFIX() + "en_" + *en ) <<
+					" = " << entryPointIds[en.pos()] << ";\n";
+		}
+		out << "\n";
+	}
+}
+
+void RustFGotoCodeGen::writeExec()
+{
+	out << "{\n";
+
+	if ( redFsm->anyRegCurStateRef() )
+		out << "    let mut _ps: i32 = 0;\n";
+
+	if ( redFsm->anyConditions() )
+		out << "    let mut _widec: isize;\n";
+
+	if ( redFsm->anyRegActions() )
+		out << "    let mut _acts: i32 = 0;\n";
+
+	out <<
+		"    let mut _goto_targ = 0;\n"
+		"\n";
+
+	out <<
+		"    '_goto: loop {\n"
+		"        match _goto_targ {\n"
+		"          0 => {\n";
+
+	if ( !noEnd ) {
+		out <<
+			"            if " << P() << " == " << PE() << " {\n"
+			"                _goto_targ = " << _test_eof << ";\n"
+			"                continue '_goto;\n"
+			"            }\n";
+	}
+
+	if ( redFsm->errState != 0 ) {
+		out <<
+			"            if " << vCS() << " == " << redFsm->errState->id << " {\n"
+			"                _goto_targ = " << _out << ";\n"
+			"                continue '_goto;\n"
+			"            }\n";
+	}
+
+	out <<
+		"            _goto_targ = " << _resume << ";\n"
+		"            continue '_goto;\n"
+		"          }\n"
+		"          " << _resume << " => {\n";
+
+	if ( redFsm->anyFromStateActions() ) {
+		out <<
+			"            match " << vCS() << " {\n";
+			FROM_STATE_ACTION_SWITCH() <<
+			"                _ => {}\n"
+			"            }\n"
+			"\n";
+	}
+
+	if ( redFsm->anyRegCurStateRef() )
+		out << "            _ps = " << vCS() << ";\n";
+
+	if ( redFsm->anyRegActions() )
+		out << "            _acts = match " << vCS() << " {\n";
+	else
+		out << "            match " << vCS() << " {\n";
+
+	STATE_GOTOS() <<
+		"                _ => " << UNREACHABLE() << ",\n"
+		"            };\n"
+		"\n";
+
+	if ( redFsm->anyRegActions() ) {
+		out <<
+			"            _goto_targ = " << _eof_trans << ";\n"
+			"            continue '_goto;\n"
+			"          }\n"
+			"          " << _eof_trans << " => {\n"
+			"            match _acts {\n";
+			ACTION_SWITCH() <<
+			"                _ => {}\n"
+			"            }\n"
+			"\n";
+	}
+
+	out <<
+		"            _goto_targ = " << _again << ";\n"
+		"            continue '_goto;\n"
+		"          }\n"
+		"          " << _again << " => {\n";
+
+	if ( redFsm->anyToStateActions() ) {
+		out <<
+			"            match " << vCS() << " {\n";
+			TO_STATE_ACTION_SWITCH() <<
+			"                _ => {}\n"
+			"            }\n"
+			"\n";
+	}
+
+	if ( redFsm->errState != 0 ) {
+		out <<
+			"            if " << vCS() << " == " << redFsm->errState->id << " {\n"
+			"                _goto_targ = " << _out << ";\n"
+			"                continue '_goto;\n"
+			"            }\n";
+	}
+
+	if ( !noEnd ) {
+		out <<
+			"            " << P() << " += 1;\n"
+			"            if " << P() << " != " << PE() << " {\n"
+			"                _goto_targ = " << _resume << ";\n"
+			"                continue '_goto;\n"
+			"            }\n"
+			"            _goto_targ = " << _test_eof << ";\n"
+			"            continue '_goto;\n";
+	}
+	else {
+		out <<
+			"            " << P() << " += 1;\n"
+			"            _goto_targ = " << _resume << ";\n"
+			"            continue '_goto;\n";
+	}
+
+	out <<
+		"          }\n";
+
+	if ( redFsm->anyEofTrans() || redFsm->anyEofActions() ) {
+		out <<
+			"          " << _test_eof << " => {\n"
+			"            if " << P() << " == " << vEOF() << " {\n";
+
+		if ( redFsm->anyEofTrans() ) {
+			out <<
+				"                match " << vCS() << " {\n";
+				EOF_TRANS_SWITCH() <<
+				"                    _ => {}\n"
+				"                }\n";
+		}
+
+		if ( redFsm->anyEofActions() ) {
+			out <<
+				"                match " << vCS() << " {\n";
+				EOF_ACTION_SWITCH() <<
+				"                    _ => {}\n"
+				"                }\n";
+		}
+
+		out <<
+			"            }\n"
+			"          }\n";
+	}
+	else {
+		out <<
+			"          " << _test_eof << " => { }\n";
+	}
+
+	out <<
+		"          " << _out << " => { }\n"
+		"          _ => " << UNREACHABLE() << ",\n";
+
+	/* The match and goto loop. */
+	out <<
+		"        }\n"
+		"        break;\n"
+		"    }\n";
+
+	/* The execute block. */
+	out << "}\n";
+}
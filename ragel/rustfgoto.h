@@ -0,0 +1,53 @@
+/*
+ *  Copyright 2006-2007 Adrian Thurston <thurston@complang.org>
+ *            2007 Colin Fleming <colin.fleming@caverock.com>
+ *            2026 Ragel contributors
+ */
+
+/*  This file is part of Ragel.
+ *
+ *  Ragel is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ * 
+ *  Ragel is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with Ragel; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
+ */
+
+#ifndef _RUSTFGOTO_H
+#define _RUSTFGOTO_H
+
+#include <iostream>
+#include "rustcodegen.h"
+
+/*
+ * RustFGotoCodeGen
+ */
+struct RustFGotoCodeGen : public RustTabCodeGen
+{
+	RustFGotoCodeGen( ostream &out ) :
+		RustTabCodeGen(out) { currentRust = true; }
+
+	std::ostream &TO_STATE_ACTION_SWITCH();
+	std::ostream &FROM_STATE_ACTION_SWITCH();
+	std::ostream &EOF_ACTION_SWITCH();
+	std::ostream &ACTION_SWITCH();
+	std::ostream &EOF_TRANS_SWITCH();
+
+	std::ostream &STATE_GOTOS();
+	void COND_TRANSLATE( RedStateAp *state );
+	void TRANS_GOTO( RedTransAp *trans );
+	string RANGE_PATTERN( RedStateAp *state, Key lowKey, Key highKey );
+
+	virtual void writeData();
+	virtual void writeExec();
+};
+
+#endif
@@ -0,0 +1,56 @@
+/* 
+ * @LANG: indep
+ * @ALLOW_GENFLAGS: -T0 -T1 -G0 -G1 -G2
+ */
+bool i;
+bool j;
+%%
+
+%%{
+	machine foo;
+
+	action c1 {i}
+	action c2 {j}
+	action one { prints "  one\n";}
+	action two { prints "  two\n";}
+
+	action seti { if ( fc == 48 ) i = false; else i = true; }
+	action setj { if ( fc == 48 ) j = false; else j = true; }
+
+	action break {fbreak;}
+
+	# Both alternatives take the same strings, so c1 does not matter. Only
+	# c2 needs to be tested on 'a'.
+	one = ( 'a' when c1 'bc' | 'abc' ) @one;
+	two = [a-z] when c2 'x' @two;
+
+	main := 
+		[01] @seti
+		[01] @setj
+		( one | two ) '\n' @break;
+	
+}%%
+
+/* _____INPUT_____ 
+"00abc\n"
+"10abc\n"
+"01abc\n"
+"01ax\n"
+"00ax\n"
+"11zx\n"
+"10zx\n"
+_____INPUT_____ */
+/* _____OUTPUT_____
+  one
+ACCEPT
+  one
+ACCEPT
+  one
+ACCEPT
+  two
+ACCEPT
+FAIL
+  two
+ACCEPT
+FAIL
+_____OUTPUT_____ */
@@ -0,0 +1,71 @@
+/*
+ * @LANG: c
+ * @RAGELFLAGS: --reduce-conds
+ * @ALLOW_MINFLAGS: -m -l -e
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/* Both branches of one go to the same place after minimization, so c1 decides
+ * nothing and --reduce-conds drops it. Without the reduction it is still
+ * evaluated on every 'a' and ni counts up. The c2 test is kept. */
+
+%%{
+	machine cond9;
+
+	action c1 { ( ni++, i ) }
+	action c2 { ( nj++, j ) }
+	action seti { i = fc == '1'; }
+	action setj { j = fc == '1'; }
+	action one { printf( "  one\n" ); }
+	action two { printf( "  two\n" ); }
+
+	one = ( 'a' when c1 'bc' | 'abc' ) @one;
+	two = [a-z] when c2 'x' @two;
+
+	main := [01] @seti [01] @setj ( one | two ) '\n';
+}%%
+
+%% write data;
+
+void test( const char *data )
+{
+	int cs, i = 0, j = 0, ni = 0, nj = 0;
+	const char *p = data, *pe = data + strlen( data );
+
+	%% write init;
+	%% write exec;
+
+	if ( cs >= cond9_first_final )
+		printf( "ACCEPT %d %d\n", ni, nj );
+	else
+		printf( "FAIL %d %d\n", ni, nj );
+}
+
+int main()
+{
+	test( "00abc\n" );
+	test( "01abc\n" );
+	test( "11ax\n" );
+	test( "10ax\n" );
+	test( "01bx\n" );
+	test( "00bx\n" );
+	test( "10abc\n" );
+	return 0;
+}
+
+#ifdef _____OUTPUT_____
+  one
+ACCEPT 0 1
+  one
+ACCEPT 0 1
+  two
+ACCEPT 0 1
+FAIL 0 1
+  two
+ACCEPT 0 1
+FAIL 0 1
+  one
+ACCEPT 0 1
+#endif
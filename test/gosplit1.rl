@@ -0,0 +1,64 @@
+/*
+ * @LANG: go
+ * @ALLOW_GENFLAGS: -P4
+ */
+
+package main
+
+import "fmt"
+
+%%{
+	machine gosplit1;
+
+	action word { words++ }
+	action num { nums++ }
+	action kw { kws++ }
+	action fin { fin = true }
+
+	paren := [^)]* ')' @{ parens++; fret; };
+
+	keyword = ( 'if' | 'else' | 'return' | 'while' ) %kw;
+	word = ( [a-z]+ - keyword ) %word;
+	number = [0-9]+ %num;
+	item = keyword | word | number | '(' @{ fcall paren; };
+
+	main := item ( ' ' item )* %fin;
+}%%
+
+%% write data;
+
+func test(data string) {
+	var cs, top int
+	var stack [4]int
+	p, pe := 0, len(data)
+	eof := pe
+	words, nums, kws, parens := 0, 0, 0, 0
+	fin := false
+
+	%% write init;
+	%% write exec;
+
+	if cs >= gosplit1_first_final {
+		fmt.Println("ACCEPT", words, nums, kws, parens, fin)
+	} else {
+		fmt.Println("FAIL")
+	}
+}
+
+func main() {
+	test("if x 12 (a b) while")
+	test("else elsewhere 7")
+	test("if  x")
+	test("(x")
+	test("")
+	test("return 3 (y) z")
+}
+
+/* _____OUTPUT_____
+ACCEPT 1 1 2 1 true
+ACCEPT 1 1 1 0 true
+FAIL
+FAIL
+FAIL
+ACCEPT 1 1 1 1 true
+*/
@@ -0,0 +1,70 @@
+/*
+ * @LANG: java
+ * @ALLOW_GENFLAGS: -T0 -F0 -F1 -G0
+ */
+
+class java3
+{
+	%%{
+		machine java3;
+		alphtype byte;
+
+		action dgt { val = val * 10 + ( fc - '0' ); }
+		action num { sum += val; val = 0; }
+		action short { len < 4 }
+		action letter { len += 1; }
+		action word { words += 1; len = 0; }
+
+		paren := [^)]* ')' @{ parens += 1; fret; };
+
+		number = [0-9]+ $dgt %num;
+		word = ( [a-z] when short )+ $letter %word;
+		item = number | word | '(' @{ fcall paren; };
+
+		main := ( item ( ' ' item )* '\n' )+ %/{ fin = true; };
+	}%%
+
+	%% write data;
+
+	static void test( String str )
+	{
+		byte data[] = str.getBytes();
+		int cs, p = 0, pe = data.length, eof = pe;
+		int top;
+		int stack[] = new int[4];
+		int val = 0, sum = 0, len = 0, words = 0, parens = 0;
+		boolean fin = false;
+
+		%% write init;
+		%% write exec;
+
+		if ( cs >= java3_first_final ) {
+			System.out.println( "ACCEPT " + sum + " " + words + " " +
+					parens + " " + fin );
+		}
+		else {
+			System.out.println( "FAIL" );
+		}
+	}
+
+	public static void main( String args[] )
+	{
+		test( "12 ab 3\n" );
+		test( "abcd 7 (x y) 10\n20\n" );
+		test( "abcde\n" );
+		test( "(a) (b) ((c)\n" );
+		test( "1 2 3" );
+		test( "ab (cd 5\n" );
+		test( "xyz (q)\nab 99\n" );
+	}
+}
+
+/* _____OUTPUT_____
+ACCEPT 15 1 0 true
+ACCEPT 37 1 1 true
+FAIL
+ACCEPT 0 0 3 true
+FAIL
+FAIL
+ACCEPT 99 2 1 true
+*/
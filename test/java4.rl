@@ -0,0 +1,82 @@
+/*
+ * @LANG: java
+ * @ALLOW_GENFLAGS: -T0 -F0 -F1 -G0
+ *
+ * The keyword states are enough to split the -G0 transitions over several
+ * methods.
+ */
+
+class java4
+{
+	%%{
+		machine java4;
+		alphtype byte;
+
+		action kw { kws += 1; }
+		action id { ids += 1; }
+
+		keyword =
+			'abstract' | 'assert' | 'boolean' | 'break' | 'byte' |
+			'case' | 'catch' | 'char' | 'class' | 'const' |
+			'continue' | 'default' | 'do' | 'double' | 'else' |
+			'enum' | 'extends' | 'final' | 'finally' | 'float' |
+			'for' | 'goto' | 'if' | 'implements' | 'import' |
+			'instanceof' | 'int' | 'interface' | 'long' | 'native' |
+			'new' | 'package' | 'private' | 'protected' | 'public' |
+			'return' | 'short' | 'static' | 'strictfp' | 'super' |
+			'switch' | 'synchronized' | 'this' | 'throw' | 'throws' |
+			'transient' | 'try' | 'void' | 'volatile' | 'while';
+
+		ident = ( [a-z_] [a-z0-9_]* ) - keyword;
+
+		word = keyword %kw | ident %id;
+
+		main := ( word ( ' '+ word )* )? '\n';
+	}%%
+
+	%% write data;
+
+	static void test( String str )
+	{
+		byte data[] = str.getBytes();
+		int cs, p = 0, pe = data.length;
+		int kws = 0, ids = 0;
+
+		%% write init;
+		%% write exec;
+
+		if ( cs >= java4_first_final )
+			System.out.println( "ACCEPT " + kws + " " + ids );
+		else
+			System.out.println( "FAIL" );
+	}
+
+	public static void main( String args[] )
+	{
+		test( "public static void main\n" );
+		test( "synchronized transient volatile strictfp\n" );
+		test( "publics statics voids mains\n" );
+		test( "do done double doubles dou\n" );
+		test( "instanceof interface int integer in i\n" );
+		test( "_private private_ x9 y_1 z\n" );
+		test( "9lives\n" );
+		test( "class  Foo\n" );
+		test( "\n" );
+		test( "goto const enum assert\n" );
+		test( "if else while for" );
+	}
+}
+
+/* _____OUTPUT_____
+ACCEPT 3 1
+ACCEPT 4 0
+ACCEPT 0 4
+ACCEPT 2 3
+ACCEPT 3 3
+ACCEPT 0 5
+FAIL
+FAIL
+ACCEPT 0 0
+ACCEPT 4 0
+FAIL
+*/
@@ -0,0 +1,94 @@
+/*
+ * @LANG: c
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+struct kw
+{
+	int cs;
+};
+
+%%{
+	machine kw;
+	variable cs fsm->cs;
+
+	action keyword { printf("keyword\n"); }
+	action number { printf("number\n"); }
+
+	# A union of plain literals, with a repeat, a prefix of another
+	# keyword, the empty string and a non-literal at the end.
+	word = (
+		'if' | 'in' | 'int' | 'for' | 'float' | 'if' |
+		'while' | 'whilst' | '' | 'do'
+	) @keyword | [0-9]+ @number;
+
+	main := word . '\n';
+}%%
+
+%% write data;
+
+void kw_init( struct kw *fsm )
+{
+	%% write init;
+}
+
+void kw_execute( struct kw *fsm, const char *_data, int _len )
+{
+	const char *p = _data;
+	const char *pe = _data+_len;
+
+	%% write exec;
+}
+
+int kw_finish( struct kw *fsm )
+{
+	if ( fsm->cs == kw_error )
+		return -1;
+	if ( fsm->cs >= kw_first_final )
+		return 1;
+	return 0;
+}
+
+struct kw fsm;
+
+void test( char *buf )
+{
+	int len = strlen( buf );
+	kw_init( &fsm );
+	kw_execute( &fsm, buf, len );
+	if ( kw_finish( &fsm ) > 0 )
+		printf("ACCEPT\n");
+	else
+		printf("FAIL\n");
+}
+
+int main()
+{
+	test( "int\n" );
+	test( "in\n" );
+	test( "whilst\n" );
+	test( "\n" );
+	test( "42\n" );
+	test( "whil\n" );
+	test( "dof\n" );
+	return 0;
+}
+
+#ifdef _____OUTPUT_____
+keyword
+keyword
+ACCEPT
+keyword
+ACCEPT
+keyword
+ACCEPT
+ACCEPT
+number
+number
+ACCEPT
+FAIL
+keyword
+FAIL
+#endif
@@ -0,0 +1,67 @@
+/*
+ * @LANG: rust
+ * @ALLOW_GENFLAGS: -F1 -G1
+ */
+
+%%{
+	machine rust1;
+
+	action dgt { val = val * 10 + (fc - b'0') as i32; }
+	action num { total += val; val = 0; }
+	action short { len < 4 }
+	action letter { len += 1; }
+	action word { words += 1; len = 0; }
+
+	paren := [^)]* ')' @{ parens += 1; fret; };
+
+	number = [0-9]+ $dgt %num;
+	word = ( [a-z] when short )+ $letter %word;
+	item = number | word | '(' @{ fcall paren; };
+
+	main := item ( ' ' item )* '\n';
+}%%
+
+%% write data;
+
+fn test( data: &[u8] )
+{
+	let mut cs: i32;
+	let mut p: usize = 0;
+	let pe: usize = data.len();
+	let mut top: usize;
+	let mut stack: [i32; 4] = [0; 4];
+	let mut val: i32 = 0;
+	let mut total: i32 = 0;
+	let mut len: i32 = 0;
+	let mut words: i32 = 0;
+	let mut parens: i32 = 0;
+
+	%% write init;
+	%% write exec;
+
+	if cs >= rust1_first_final {
+		println!( "ACCEPT {} {} {}", total, words, parens );
+	}
+	else {
+		println!( "FAIL" );
+	}
+}
+
+fn main()
+{
+	test( b"12 ab 3\n" );
+	test( b"abcd (x y) 40\n" );
+	test( b"abcde 1\n" );
+	test( b"7 (a) (b) xy\n" );
+	test( b"abcd efgh\n" );
+	test( b"1 2" );
+}
+
+/* _____OUTPUT_____
+ACCEPT 15 1 0
+ACCEPT 40 1 1
+FAIL
+ACCEPT 7 1 2
+ACCEPT 0 2 0
+FAIL
+*/
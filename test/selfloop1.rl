@@ -0,0 +1,70 @@
+/*
+ * @LANG: c
+ *
+ * In the goto styles the comment, string and block bodies scan ahead to
+ * their exit keys. The number loop leaves on too many keys to be scanned.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+%%{
+	machine selfloop1;
+
+	action str { strs++; }
+	action blk { blks++; }
+	action num { nums++; }
+	action com { coms++; }
+
+	string = '"' [^"\\\n]* '"' @str;
+	block = '{' [^{}()<>;\n]* '}' @blk;
+	number = [0-9]+ %num;
+	word = [a-z]+;
+	comment = '#' @com [^\n]*;
+
+	item = string | block | number | word;
+
+	main := ( item ( ' '+ item )* )? ' '* comment? '\n';
+}%%
+
+%% write data;
+
+void test( const char *data )
+{
+	int cs, strs = 0, blks = 0, nums = 0, coms = 0;
+	const char *p = data, *pe = data + strlen( data );
+
+	%% write init;
+	%% write exec;
+
+	if ( cs >= selfloop1_first_final )
+		printf( "ACCEPT %d %d %d %d\n", strs, blks, nums, coms );
+	else
+		printf( "FAIL\n" );
+}
+
+int main()
+{
+	test( "\"a string that is quite long\" 42 {block body with words and = signs} x\n" );
+	test( "# only a comment running to the newline\n" );
+	test( "{unterminated block that runs to the end" );
+	test( "\"unterminated string" );
+	test( "# comment without a newline" );
+	test( "7 8 9 {a;b}\n" );
+	test( "{} \"\" 1 #\n" );
+	test( "{nested {x}}\n" );
+	test( "12 345 6789 {0123456789} \"#{}\" #\"{}\n" );
+	return 0;
+}
+
+#ifdef _____OUTPUT_____
+ACCEPT 1 1 1 0
+ACCEPT 0 0 0 1
+FAIL
+FAIL
+FAIL
+FAIL
+ACCEPT 1 1 1 1
+FAIL
+ACCEPT 1 1 3 1
+#endif
@@ -0,0 +1,69 @@
+/*
+ * @LANG: c
+ * @RAGELFLAGS: --simd
+ * @CFLAGS: -msse4.2
+ * @ALLOW_GENFLAGS: -T0 -T1 -F0 -F1
+ *
+ * The string and comment bodies are skipped over sixteen bytes at a time.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+%%{
+	machine simd1;
+
+	action str { strs++; }
+	action esc { escs++; }
+	action com { coms++; }
+	action sym { syms++; }
+
+	string = '"' ( [^"\\\n] | '\\' [^\n] @esc )* '"' @str;
+	comment = '#' @com [^\n]*;
+	symbol = [;,(){}=+*<>!\-/] @sym;
+	word = [a-z_] [a-z0-9_]*;
+
+	main := ( ' '* ( string | symbol | word ) )* comment? '\n';
+}%%
+
+%% write data;
+
+void test( const char *data )
+{
+	int cs, strs = 0, escs = 0, coms = 0, syms = 0;
+	const char *p = data, *pe = data + strlen( data );
+
+	%% write init;
+	%% write exec;
+
+	if ( cs >= simd1_first_final )
+		printf( "ACCEPT %d %d %d %d\n", strs, escs, coms, syms );
+	else
+		printf( "FAIL\n" );
+}
+
+int main()
+{
+	test( "x = \"a fairly long string that goes well past sixteen bytes\";\n" );
+	test( "print(\"escaped \\\" quote and \\\\ backslash in a long string\", y);\n" );
+	test( "a+b# a comment that is long enough to cover several sixteen byte blocks\n" );
+	test( "let y = \"short\";#c\n" );
+	test( "\"this string never ends and runs to the end of the buffer" );
+	test( "s = \"a newline inside\n a string\";\n" );
+	test( "\"0123456789abcdef\"\n" );
+	test( "\"0123456789abcde\\\"0123456789abcdef\\\\\\\"\"\n" );
+	test( "#0123456789abcdef0123456789abcdef\n" );
+	return 0;
+}
+
+#ifdef _____OUTPUT_____
+ACCEPT 1 0 0 2
+ACCEPT 1 2 0 4
+ACCEPT 0 0 1 1
+ACCEPT 1 0 1 2
+FAIL
+FAIL
+ACCEPT 1 0 0 0
+ACCEPT 1 3 0 0
+ACCEPT 0 0 1 0
+#endif